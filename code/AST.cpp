@@ -0,0 +1,242 @@
+#include "AST.h"
+
+// Indented dump of the tree, one construct per line; names print as
+// identifier ids since a node does not know its IdentifierTable.
+
+static void pad(llvm::raw_ostream &os, int indent) {
+    os.indent(indent * 2);
+}
+
+static void printChild(llvm::raw_ostream &os, const ASTNode *node, int indent) {
+    if (node) {
+        node->print(os, indent);
+    } else {
+        pad(os, indent);
+        os << "<none>\n";
+    }
+}
+
+// expressions print on one line; statements end their own lines
+static void printExpr(llvm::raw_ostream &os, const ASTNode *node) {
+    if (node) {
+        node->print(os, 0);
+    }
+}
+
+static const char *typeName(VarType type) {
+    switch (type) {
+    case VarType::INT: return "int";
+    case VarType::BOOL: return "bool";
+    case VarType::FLOAT: return "float";
+    case VarType::CHAR: return "char";
+    case VarType::STRING: return "string";
+    case VarType::ARRAY: return "array";
+    default: return "?";
+    }
+}
+
+static const char *opName(BinaryOp op) {
+    switch (op) {
+    case BinaryOp::ADD: case BinaryOp::ARRAY_ADD: return "+";
+    case BinaryOp::SUBTRACT: case BinaryOp::ARRAY_SUBTRACT: return "-";
+    case BinaryOp::MULTIPLY: case BinaryOp::ARRAY_MULTIPLY: return "*";
+    case BinaryOp::DIVIDE: case BinaryOp::ARRAY_DIVIDE: return "/";
+    case BinaryOp::MOD: return "%";
+    case BinaryOp::EQUAL: return "==";
+    case BinaryOp::NOT_EQUAL: return "!=";
+    case BinaryOp::LESS: return "<";
+    case BinaryOp::LESS_EQUAL: return "<=";
+    case BinaryOp::GREATER: return ">";
+    case BinaryOp::GREATER_EQUAL: return ">=";
+    case BinaryOp::AND: return "&&";
+    case BinaryOp::OR: return "||";
+    case BinaryOp::INDEX: return "index";
+    case BinaryOp::CONCAT: return "concat";
+    case BinaryOp::POW: return "pow";
+    }
+    return "?";
+}
+
+static const char *opName(UnaryOp op) {
+    switch (op) {
+    case UnaryOp::INCREMENT: return "++";
+    case UnaryOp::DECREMENT: return "--";
+    case UnaryOp::LENGTH: return "length";
+    case UnaryOp::MIN: return "min";
+    case UnaryOp::MAX: return "max";
+    case UnaryOp::SUM: return "sum";
+    case UnaryOp::ABS: return "abs";
+    case UnaryOp::MINUS: return "-";
+    case UnaryOp::NOT: return "!";
+    }
+    return "?";
+}
+
+static void printName(llvm::raw_ostream &os, Identifier name) {
+    os << "$" << name.getID();
+}
+
+static void printStatements(llvm::raw_ostream &os, llvm::ArrayRef<ASTNode *> statements, int indent) {
+    for (const ASTNode *statement : statements) {
+        printChild(os, statement, indent);
+    }
+}
+
+void ProgramNode::print(llvm::raw_ostream &os, int indent) const {
+    printStatements(os, statements, indent);
+}
+
+void VarDeclNode::print(llvm::raw_ostream &os, int indent) const {
+    pad(os, indent);
+    os << typeName(type) << " ";
+    printName(os, name);
+    if (value) {
+        os << " = ";
+        printExpr(os, value);
+    }
+    os << "\n";
+}
+
+void MultiVarDeclNode::print(llvm::raw_ostream &os, int indent) const {
+    for (const VarDeclNode *decl : declarations) {
+        decl->print(os, indent);
+    }
+}
+
+void AssignNode::print(llvm::raw_ostream &os, int indent) const {
+    pad(os, indent);
+    printName(os, target);
+    os << " " << (op == BinaryOp::EQUAL ? "" : opName(op)) << "= ";
+    printExpr(os, value);
+    os << "\n";
+}
+
+void VarRefNode::print(llvm::raw_ostream &os, int) const {
+    printName(os, name);
+}
+
+void BinaryOpNode::print(llvm::raw_ostream &os, int) const {
+    os << "(";
+    printExpr(os, left);
+    os << " " << opName(op) << " ";
+    printExpr(os, right);
+    os << ")";
+}
+
+void UnaryOpNode::print(llvm::raw_ostream &os, int) const {
+    os << opName(op) << "(";
+    printExpr(os, operand);
+    os << ")";
+}
+
+void BlockNode::print(llvm::raw_ostream &os, int indent) const {
+    pad(os, indent);
+    os << "{\n";
+    printStatements(os, statements, indent + 1);
+    pad(os, indent);
+    os << "}\n";
+}
+
+void IfElseNode::print(llvm::raw_ostream &os, int indent) const {
+    pad(os, indent);
+    os << "if ";
+    printExpr(os, condition);
+    os << "\n";
+    printChild(os, thenBlock, indent);
+    if (elseBlock) {
+        pad(os, indent);
+        os << "else\n";
+        printChild(os, elseBlock, indent);
+    }
+}
+
+void ForLoopNode::print(llvm::raw_ostream &os, int indent) const {
+    pad(os, indent);
+    os << "for\n";
+    printChild(os, init, indent + 1);
+    pad(os, indent + 1);
+    printExpr(os, condition);
+    os << "\n";
+    printChild(os, update, indent + 1);
+    printChild(os, body, indent);
+}
+
+void WhileLoopNode::print(llvm::raw_ostream &os, int indent) const {
+    pad(os, indent);
+    os << "while ";
+    printExpr(os, condition);
+    os << "\n";
+    printChild(os, body, indent);
+}
+
+void ForeachLoopNode::print(llvm::raw_ostream &os, int indent) const {
+    pad(os, indent);
+    os << "foreach ";
+    printName(os, varName);
+    os << " in ";
+    printExpr(os, collection);
+    os << "\n";
+    printChild(os, body, indent);
+}
+
+void PrintNode::print(llvm::raw_ostream &os, int indent) const {
+    pad(os, indent);
+    os << "print ";
+    printExpr(os, expr);
+    os << "\n";
+}
+
+void ArrayNode::print(llvm::raw_ostream &os, int) const {
+    os << "[";
+    for (size_t i = 0; i < elements.size(); ++i) {
+        if (i) {
+            os << ", ";
+        }
+        printExpr(os, elements[i]);
+    }
+    if (count) {
+        os << "; ";
+        printExpr(os, count);
+    }
+    os << "]";
+}
+
+void ArrayAccessNode::print(llvm::raw_ostream &os, int) const {
+    printName(os, arrayName);
+    os << "[";
+    printExpr(os, index);
+    os << "]";
+}
+
+void ConcatNode::print(llvm::raw_ostream &os, int) const {
+    os << "concat(";
+    printExpr(os, left);
+    os << ", ";
+    printExpr(os, right);
+    os << ")";
+}
+
+void PowNode::print(llvm::raw_ostream &os, int) const {
+    os << "pow(";
+    printExpr(os, base);
+    os << ", ";
+    printExpr(os, exponent);
+    os << ")";
+}
+
+void TryCatchNode::print(llvm::raw_ostream &os, int indent) const {
+    pad(os, indent);
+    os << "try\n";
+    printChild(os, tryBlock, indent);
+    pad(os, indent);
+    os << "catch\n";
+    printChild(os, catchBlock, indent);
+}
+
+void MatchNode::print(llvm::raw_ostream &os, int indent) const {
+    pad(os, indent);
+    os << "match ";
+    printExpr(os, expr);
+    os << "\n";
+    printStatements(os, cases, indent + 1);
+}
@@ -1,11 +1,17 @@
 #ifndef AST_H
 #define AST_H
 
-#include <memory>
 #include <vector>
 #include <string>
+#include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Casting.h>
 #include <llvm/Support/raw_ostream.h>
+#include "identifier.h"
+
+// All nodes live in an ASTContext arena; child pointers are non-owning and
+// names are Identifiers interned in the context.
+class ASTContext;
 
 enum class VarType { 
     INT, BOOL, FLOAT, CHAR, 
@@ -21,7 +27,8 @@ enum class BinaryOp {
 
 enum class UnaryOp { 
     INCREMENT, DECREMENT, 
-    LENGTH, MIN, MAX, ABS 
+    LENGTH, MIN, MAX, SUM, ABS,
+    MINUS, NOT
 };
 
 enum class LoopType { FOR, FOREACH, WHILE };
@@ -33,249 +40,423 @@ enum class StmtType {
     BLOCK, MATCH 
 };
 
+class ASTVisitor;
+
 class ASTNode {
 public:
+    // LLVM-style RTTI tag: isa/cast/dyn_cast and switch dispatch use it
+    // instead of dynamic_cast, so the build can run with -fno-rtti
+    enum NodeKind {
+        NK_Program,
+        NK_VarDecl,
+        NK_MultiVarDecl,
+        NK_Assign,
+        NK_VarRef,
+        NK_IntLiteral,
+        NK_FloatLiteral,
+        NK_BoolLiteral,
+        NK_CharLiteral,
+        NK_StrLiteral,
+        NK_BinaryOp,
+        NK_UnaryOp,
+        NK_Block,
+        NK_IfElse,
+        NK_ForLoop,
+        NK_WhileLoop,
+        NK_ForeachLoop,
+        NK_Print,
+        NK_Array,
+        NK_ArrayAccess,
+        NK_Concat,
+        NK_Pow,
+        NK_TryCatch,
+        NK_Match
+    };
+
+    ASTNode(NodeKind k) : kind(k) {}
     virtual ~ASTNode() = default;
     virtual void print(llvm::raw_ostream &os, int indent = 0) const = 0;
+
+    NodeKind getKind() const { return kind; }
+    void accept(ASTVisitor &visitor);
+
+    // filled in once by semantic analysis, NEUTRAL until then
+    VarType getType() const { return type; }
+    void setType(VarType t) { type = t; }
+    // type of the elements of an ARRAY-typed node, also set by semantic analysis
+    VarType getElementType() const { return elementType; }
+    void setElementType(VarType t) { elementType = t; }
+
+private:
+    const NodeKind kind;
+    VarType type = VarType::NEUTRAL;
+    VarType elementType = VarType::NEUTRAL;
 };
 
 // barname  - majmoo e ii az gozaare ha
 class ProgramNode : public ASTNode {
 public:
-    std::vector<std::unique_ptr<ASTNode>> statements;
+    ProgramNode() : ASTNode(NK_Program) {}
+
+    llvm::ArrayRef<ASTNode *> statements;
     
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_Program; }
 };
 
 // Var decleration
 class VarDeclNode : public ASTNode {
 public:
     VarType type;
-    std::string name;
-    std::unique_ptr<ASTNode> value;
+    Identifier name;
+    ASTNode *value;
     
-    VarDeclNode(VarType t, std::string n, std::unique_ptr<ASTNode> v)
-        : type(t), name(n), value(std::move(v)) {}
+    VarDeclNode(VarType t, Identifier n, ASTNode *v)
+        : ASTNode(NK_VarDecl), type(t), name(n), value(v) {}
         
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_VarDecl; }
 };
 
 // tarif chand moteghayyer
 class MultiVarDeclNode : public ASTNode {
 public:
-    std::vector<std::unique_ptr<VarDeclNode>> declarations;
+    llvm::ArrayRef<VarDeclNode *> declarations;
     
+    MultiVarDeclNode(llvm::ArrayRef<VarDeclNode *> decls)
+        : ASTNode(NK_MultiVarDecl), declarations(decls) {}
+        
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_MultiVarDecl; }
 };
 
 // Assignment
 class AssignNode : public ASTNode {
 public:
-    std::string target;
+    Identifier target;
     BinaryOp op;
-    std::unique_ptr<ASTNode> value;
+    ASTNode *value;
     
-    AssignNode(std::string t, BinaryOp o, std::unique_ptr<ASTNode> v)
-        : target(t), op(o), value(std::move(v)) {}
+    AssignNode(Identifier t, BinaryOp o, ASTNode *v)
+        : ASTNode(NK_Assign), target(t), op(o), value(v) {}
         
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_Assign; }
 };
 
 // Refrence to Variable
 class VarRefNode : public ASTNode {
 public:
-    std::string name;
+    Identifier name;
     
-    VarRefNode(std::string n) : name(n) {}
+    VarRefNode(Identifier n) : ASTNode(NK_VarRef), name(n) {}
     
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_VarRef; }
 };
 
 // Literals
+template<typename T> struct LiteralKind;
+template<> struct LiteralKind<int> { static const ASTNode::NodeKind value = ASTNode::NK_IntLiteral; };
+template<> struct LiteralKind<float> { static const ASTNode::NodeKind value = ASTNode::NK_FloatLiteral; };
+template<> struct LiteralKind<bool> { static const ASTNode::NodeKind value = ASTNode::NK_BoolLiteral; };
+template<> struct LiteralKind<char> { static const ASTNode::NodeKind value = ASTNode::NK_CharLiteral; };
+template<> struct LiteralKind<llvm::StringRef> { static const ASTNode::NodeKind value = ASTNode::NK_StrLiteral; };
+
 template<typename T>
 class LiteralNode : public ASTNode {
 public:
     T value;
     
-    LiteralNode(T val) : value(val) {}
+    LiteralNode(T val) : ASTNode(LiteralKind<T>::value), value(val) {}
     
     void print(llvm::raw_ostream &os, int indent = 0) const override {
         os << value;
     }
+
+    static bool classof(const ASTNode *n) { return n->getKind() == LiteralKind<T>::value; }
 };
 
 using IntLiteral = LiteralNode<int>;
 using FloatLiteral = LiteralNode<float>;
 using BoolLiteral = LiteralNode<bool>;
 using CharLiteral = LiteralNode<char>;
-using StrLiteral = LiteralNode<std::string>;
+using StrLiteral = LiteralNode<llvm::StringRef>;
 
 // Binaray
 class BinaryOpNode : public ASTNode {
 public:
     BinaryOp op;
-    std::unique_ptr<ASTNode> left;
-    std::unique_ptr<ASTNode> right;
+    ASTNode *left;
+    ASTNode *right;
     
-    BinaryOpNode(BinaryOp o, std::unique_ptr<ASTNode> l, std::unique_ptr<ASTNode> r)
-        : op(o), left(std::move(l)), right(std::move(r)) {}
+    BinaryOpNode(BinaryOp o, ASTNode *l, ASTNode *r)
+        : ASTNode(NK_BinaryOp), op(o), left(l), right(r) {}
         
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_BinaryOp; }
 };
 
 // Unary
 class UnaryOpNode : public ASTNode {
 public:
     UnaryOp op;
-    std::unique_ptr<ASTNode> operand;
+    ASTNode *operand;
     
-    UnaryOpNode(UnaryOp o, std::unique_ptr<ASTNode> opnd)
-        : op(o), operand(std::move(opnd)) {}
+    UnaryOpNode(UnaryOp o, ASTNode *opnd)
+        : ASTNode(NK_UnaryOp), op(o), operand(opnd) {}
         
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_UnaryOp; }
 };
 
 // Code Block
 class BlockNode : public ASTNode {
 public:
-    std::vector<std::unique_ptr<ASTNode>> statements;
+    BlockNode() : ASTNode(NK_Block) {}
+
+    llvm::ArrayRef<ASTNode *> statements;
     
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_Block; }
 };
 
 // if/else
 class IfElseNode : public ASTNode {
 public:
-    std::unique_ptr<ASTNode> condition;
-    std::unique_ptr<BlockNode> thenBlock;
-    std::unique_ptr<ASTNode> elseBlock; // Can be BlockNode or IfElseNode
+    ASTNode *condition;
+    BlockNode *thenBlock;
+    ASTNode *elseBlock; // Can be BlockNode or IfElseNode
     
-    IfElseNode(std::unique_ptr<ASTNode> cond, 
-              std::unique_ptr<BlockNode> thenBlk,
-              std::unique_ptr<ASTNode> elseBlk = nullptr)
-        : condition(std::move(cond)), 
-          thenBlock(std::move(thenBlk)),
-          elseBlock(std::move(elseBlk)) {}
+    IfElseNode(ASTNode *cond, 
+              BlockNode *thenBlk,
+              ASTNode *elseBlk = nullptr)
+        : ASTNode(NK_IfElse), condition(cond), 
+          thenBlock(thenBlk),
+          elseBlock(elseBlk) {}
           
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_IfElse; }
 };
 
 // for
 class ForLoopNode : public ASTNode {
 public:
-    std::unique_ptr<ASTNode> init;
-    std::unique_ptr<ASTNode> condition;
-    std::unique_ptr<ASTNode> update;
-    std::unique_ptr<BlockNode> body;
+    ASTNode *init;
+    ASTNode *condition;
+    ASTNode *update;
+    BlockNode *body;
     
-    ForLoopNode(std::unique_ptr<ASTNode> i, 
-               std::unique_ptr<ASTNode> cond,
-               std::unique_ptr<ASTNode> upd,
-               std::unique_ptr<BlockNode> b)
-        : init(std::move(i)), condition(std::move(cond)),
-          update(std::move(upd)), body(std::move(b)) {}
+    ForLoopNode(ASTNode *i, 
+               ASTNode *cond,
+               ASTNode *upd,
+               BlockNode *b)
+        : ASTNode(NK_ForLoop), init(i), condition(cond),
+          update(upd), body(b) {}
           
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_ForLoop; }
+};
+
+// while
+class WhileLoopNode : public ASTNode {
+public:
+    ASTNode *condition;
+    BlockNode *body;
+    
+    WhileLoopNode(ASTNode *cond, BlockNode *b)
+        : ASTNode(NK_WhileLoop), condition(cond), body(b) {}
+        
+    void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_WhileLoop; }
 };
 
 // foreach
 class ForeachLoopNode : public ASTNode {
 public:
-    std::string varName;
-    std::unique_ptr<ASTNode> collection;
-    std::unique_ptr<BlockNode> body;
+    Identifier varName;
+    ASTNode *collection;
+    BlockNode *body;
     
-    ForeachLoopNode(std::string var, 
-                   std::unique_ptr<ASTNode> coll,
-                   std::unique_ptr<BlockNode> b)
-        : varName(var), collection(std::move(coll)), body(std::move(b)) {}
+    ForeachLoopNode(Identifier var, 
+                   ASTNode *coll,
+                   BlockNode *b)
+        : ASTNode(NK_ForeachLoop), varName(var), collection(coll), body(b) {}
         
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_ForeachLoop; }
 };
 
 // print
 class PrintNode : public ASTNode {
 public:
-    std::unique_ptr<ASTNode> expr;
+    ASTNode *expr;
     
-    PrintNode(std::unique_ptr<ASTNode> e) : expr(std::move(e)) {}
+    PrintNode(ASTNode *e) : ASTNode(NK_Print), expr(e) {}
     
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_Print; }
 };
 
 // araye
 class ArrayNode : public ASTNode {
 public:
-    std::vector<std::unique_ptr<ASTNode>> elements;
+    llvm::ArrayRef<ASTNode *> elements;
+    // [value; count] repeats its one element; null for a list of elements
+    ASTNode *count;
     
-    ArrayNode(std::vector<std::unique_ptr<ASTNode>> elems)
-        : elements(std::move(elems)) {}
+    ArrayNode(llvm::ArrayRef<ASTNode *> elems, ASTNode *n = nullptr)
+        : ASTNode(NK_Array), elements(elems), count(n) {}
         
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_Array; }
 };
 
 // nth khoone Arraye  
 class ArrayAccessNode : public ASTNode {
 public:
-    std::string arrayName;
-    std::unique_ptr<ASTNode> index;
+    Identifier arrayName;
+    ASTNode *index;
     
-    ArrayAccessNode(std::string name, std::unique_ptr<ASTNode> idx)
-        : arrayName(name), index(std::move(idx)) {}
+    ArrayAccessNode(Identifier name, ASTNode *idx)
+        : ASTNode(NK_ArrayAccess), arrayName(name), index(idx) {}
         
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_ArrayAccess; }
 };
 
 // Concat
 class ConcatNode : public ASTNode {
 public:
-    std::unique_ptr<ASTNode> left;
-    std::unique_ptr<ASTNode> right;
+    ASTNode *left;
+    ASTNode *right;
     
-    ConcatNode(std::unique_ptr<ASTNode> l, std::unique_ptr<ASTNode> r)
-        : left(std::move(l)), right(std::move(r)) {}
+    ConcatNode(ASTNode *l, ASTNode *r)
+        : ASTNode(NK_Concat), left(l), right(r) {}
         
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_Concat; }
 };
 
 class PowNode : public ASTNode {
 public:
-    std::unique_ptr<ASTNode> base;
-    std::unique_ptr<ASTNode> exponent;
+    ASTNode *base;
+    ASTNode *exponent;
     
-    PowNode(std::unique_ptr<ASTNode> b, std::unique_ptr<ASTNode> e)
-        : base(std::move(b)), exponent(std::move(e)) {}
+    PowNode(ASTNode *b, ASTNode *e)
+        : ASTNode(NK_Pow), base(b), exponent(e) {}
         
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_Pow; }
 };
 
 // Error Control
 class TryCatchNode : public ASTNode {
 public:
-    std::unique_ptr<BlockNode> tryBlock;
-    std::unique_ptr<BlockNode> catchBlock;
-    std::string errorVar;
+    BlockNode *tryBlock;
+    BlockNode *catchBlock;
+    Identifier errorVar;
     
-    TryCatchNode(std::unique_ptr<BlockNode> tryBlk,
-                std::unique_ptr<BlockNode> catchBlk,
-                std::string errVar)
-        : tryBlock(std::move(tryBlk)), 
-          catchBlock(std::move(catchBlk)),
+    TryCatchNode(BlockNode *tryBlk,
+                BlockNode *catchBlk,
+                Identifier errVar)
+        : ASTNode(NK_TryCatch), tryBlock(tryBlk), 
+          catchBlock(catchBlk),
           errorVar(errVar) {}
           
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_TryCatch; }
 };
 
 // match pattern
 class MatchNode : public ASTNode {
 public:
-    std::unique_ptr<ASTNode> expr;
-    std::vector<std::unique_ptr<ASTNode>> cases;
+    ASTNode *expr;
+    llvm::ArrayRef<ASTNode *> cases;
     
-    MatchNode(std::unique_ptr<ASTNode> e, std::vector<std::unique_ptr<ASTNode>> c)
-        : expr(std::move(e)), cases(std::move(c)) {}
+    MatchNode(ASTNode *e, llvm::ArrayRef<ASTNode *> c)
+        : ASTNode(NK_Match), expr(e), cases(c) {}
         
     void print(llvm::raw_ostream &os, int indent = 0) const override;
+
+    static bool classof(const ASTNode *n) { return n->getKind() == NK_Match; }
 };
 
+// Visitor with empty defaults; accept() dispatches on the kind tag
+class ASTVisitor {
+public:
+    virtual ~ASTVisitor() = default;
+    virtual void visit(ProgramNode &) {}
+    virtual void visit(VarDeclNode &) {}
+    virtual void visit(MultiVarDeclNode &) {}
+    virtual void visit(AssignNode &) {}
+    virtual void visit(VarRefNode &) {}
+    virtual void visit(IntLiteral &) {}
+    virtual void visit(FloatLiteral &) {}
+    virtual void visit(BoolLiteral &) {}
+    virtual void visit(CharLiteral &) {}
+    virtual void visit(StrLiteral &) {}
+    virtual void visit(BinaryOpNode &) {}
+    virtual void visit(UnaryOpNode &) {}
+    virtual void visit(BlockNode &) {}
+    virtual void visit(IfElseNode &) {}
+    virtual void visit(ForLoopNode &) {}
+    virtual void visit(WhileLoopNode &) {}
+    virtual void visit(ForeachLoopNode &) {}
+    virtual void visit(PrintNode &) {}
+    virtual void visit(ArrayNode &) {}
+    virtual void visit(ArrayAccessNode &) {}
+    virtual void visit(ConcatNode &) {}
+    virtual void visit(PowNode &) {}
+    virtual void visit(TryCatchNode &) {}
+    virtual void visit(MatchNode &) {}
+};
+
+inline void ASTNode::accept(ASTVisitor &visitor) {
+    switch (kind) {
+    case NK_Program:      visitor.visit(*llvm::cast<ProgramNode>(this)); break;
+    case NK_VarDecl:      visitor.visit(*llvm::cast<VarDeclNode>(this)); break;
+    case NK_MultiVarDecl: visitor.visit(*llvm::cast<MultiVarDeclNode>(this)); break;
+    case NK_Assign:       visitor.visit(*llvm::cast<AssignNode>(this)); break;
+    case NK_VarRef:       visitor.visit(*llvm::cast<VarRefNode>(this)); break;
+    case NK_IntLiteral:   visitor.visit(*llvm::cast<IntLiteral>(this)); break;
+    case NK_FloatLiteral: visitor.visit(*llvm::cast<FloatLiteral>(this)); break;
+    case NK_BoolLiteral:  visitor.visit(*llvm::cast<BoolLiteral>(this)); break;
+    case NK_CharLiteral:  visitor.visit(*llvm::cast<CharLiteral>(this)); break;
+    case NK_StrLiteral:   visitor.visit(*llvm::cast<StrLiteral>(this)); break;
+    case NK_BinaryOp:     visitor.visit(*llvm::cast<BinaryOpNode>(this)); break;
+    case NK_UnaryOp:      visitor.visit(*llvm::cast<UnaryOpNode>(this)); break;
+    case NK_Block:        visitor.visit(*llvm::cast<BlockNode>(this)); break;
+    case NK_IfElse:       visitor.visit(*llvm::cast<IfElseNode>(this)); break;
+    case NK_ForLoop:      visitor.visit(*llvm::cast<ForLoopNode>(this)); break;
+    case NK_WhileLoop:    visitor.visit(*llvm::cast<WhileLoopNode>(this)); break;
+    case NK_ForeachLoop:  visitor.visit(*llvm::cast<ForeachLoopNode>(this)); break;
+    case NK_Print:        visitor.visit(*llvm::cast<PrintNode>(this)); break;
+    case NK_Array:        visitor.visit(*llvm::cast<ArrayNode>(this)); break;
+    case NK_ArrayAccess:  visitor.visit(*llvm::cast<ArrayAccessNode>(this)); break;
+    case NK_Concat:       visitor.visit(*llvm::cast<ConcatNode>(this)); break;
+    case NK_Pow:          visitor.visit(*llvm::cast<PowNode>(this)); break;
+    case NK_TryCatch:     visitor.visit(*llvm::cast<TryCatchNode>(this)); break;
+    case NK_Match:        visitor.visit(*llvm::cast<MatchNode>(this)); break;
+    }
+}
+
 #endif
@@ -0,0 +1,52 @@
+#ifndef AST_CONTEXT_H
+#define AST_CONTEXT_H
+
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Allocator.h>
+#include "identifier.h"
+
+// Owns every node, literal, child list and interned name of one AST. Nodes are bump-allocated
+// and never destroyed one by one: the whole tree is released together with
+// the context, in O(number of slabs).
+class ASTContext {
+    llvm::BumpPtrAllocator allocator;
+    IdentifierTable identifiers;
+
+public:
+    ASTContext() = default;
+    ASTContext(const ASTContext &) = delete;
+    ASTContext &operator=(const ASTContext &) = delete;
+
+    template <typename T, typename... Args>
+    T *create(Args &&...args) {
+        return new (allocator.Allocate<T>()) T(std::forward<Args>(args)...);
+    }
+
+    IdentifierTable &getIdentifiers() { return identifiers; }
+    const IdentifierTable &getIdentifiers() const { return identifiers; }
+
+    // copy a literal out of the source buffer so the tree outlives it
+    llvm::StringRef copyString(llvm::StringRef str) {
+        if (str.empty()) return llvm::StringRef();
+        char *buf = allocator.Allocate<char>(str.size());
+        std::memcpy(buf, str.data(), str.size());
+        return llvm::StringRef(buf, str.size());
+    }
+
+    // freeze a child list built by the parser into the arena
+    template <typename T>
+    llvm::ArrayRef<T> copyArray(llvm::ArrayRef<T> elems) {
+        if (elems.empty()) return llvm::ArrayRef<T>();
+        T *buf = allocator.Allocate<T>(elems.size());
+        std::uninitialized_copy(elems.begin(), elems.end(), buf);
+        return llvm::ArrayRef<T>(buf, elems.size());
+    }
+
+    size_t getBytesAllocated() const { return allocator.getBytesAllocated(); }
+};
+
+#endif
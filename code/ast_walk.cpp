@@ -0,0 +1,178 @@
+#include "ast_walk.h"
+
+using namespace llvm;
+
+void getChildren(ASTNode *node, SmallVectorImpl<ASTNode *> &out) {
+    auto add = [&](ASTNode *child) { if (child) out.push_back(child); };
+    switch (node->getKind()) {
+    case ASTNode::NK_Program:
+        out.append(cast<ProgramNode>(node)->statements.begin(), cast<ProgramNode>(node)->statements.end());
+        break;
+    case ASTNode::NK_VarDecl:
+        add(cast<VarDeclNode>(node)->value);
+        break;
+    case ASTNode::NK_MultiVarDecl:
+        for (auto *decl : cast<MultiVarDeclNode>(node)->declarations) add(decl);
+        break;
+    case ASTNode::NK_Assign:
+        add(cast<AssignNode>(node)->value);
+        break;
+    case ASTNode::NK_BinaryOp:
+        add(cast<BinaryOpNode>(node)->left);
+        add(cast<BinaryOpNode>(node)->right);
+        break;
+    case ASTNode::NK_UnaryOp:
+        add(cast<UnaryOpNode>(node)->operand);
+        break;
+    case ASTNode::NK_Block:
+        out.append(cast<BlockNode>(node)->statements.begin(), cast<BlockNode>(node)->statements.end());
+        break;
+    case ASTNode::NK_IfElse: {
+        auto *ifElse = cast<IfElseNode>(node);
+        add(ifElse->condition);
+        add(ifElse->thenBlock);
+        add(ifElse->elseBlock);
+        break;
+    }
+    case ASTNode::NK_ForLoop: {
+        auto *loop = cast<ForLoopNode>(node);
+        add(loop->init);
+        add(loop->condition);
+        add(loop->update);
+        add(loop->body);
+        break;
+    }
+    case ASTNode::NK_WhileLoop:
+        add(cast<WhileLoopNode>(node)->condition);
+        add(cast<WhileLoopNode>(node)->body);
+        break;
+    case ASTNode::NK_ForeachLoop:
+        add(cast<ForeachLoopNode>(node)->collection);
+        add(cast<ForeachLoopNode>(node)->body);
+        break;
+    case ASTNode::NK_Print:
+        add(cast<PrintNode>(node)->expr);
+        break;
+    case ASTNode::NK_Array:
+        out.append(cast<ArrayNode>(node)->elements.begin(), cast<ArrayNode>(node)->elements.end());
+        add(cast<ArrayNode>(node)->count);
+        break;
+    case ASTNode::NK_ArrayAccess:
+        add(cast<ArrayAccessNode>(node)->index);
+        break;
+    case ASTNode::NK_Concat:
+        add(cast<ConcatNode>(node)->left);
+        add(cast<ConcatNode>(node)->right);
+        break;
+    case ASTNode::NK_Pow:
+        add(cast<PowNode>(node)->base);
+        add(cast<PowNode>(node)->exponent);
+        break;
+    case ASTNode::NK_TryCatch:
+        add(cast<TryCatchNode>(node)->tryBlock);
+        add(cast<TryCatchNode>(node)->catchBlock);
+        break;
+    case ASTNode::NK_Match:
+        add(cast<MatchNode>(node)->expr);
+        out.append(cast<MatchNode>(node)->cases.begin(), cast<MatchNode>(node)->cases.end());
+        break;
+    default:
+        break;
+    }
+}
+
+int64_t countNodes(ASTNode *node) {
+    SmallVector<ASTNode *, 4> children;
+    getChildren(node, children);
+    int64_t count = 1;
+    for (auto *child : children) count += countNodes(child);
+    return count;
+}
+
+bool mayWrite(ASTNode *node, Identifier id) {
+    switch (node->getKind()) {
+    case ASTNode::NK_VarDecl:
+        if (cast<VarDeclNode>(node)->name == id) return true;
+        break;
+    case ASTNode::NK_Assign:
+        if (cast<AssignNode>(node)->target == id) return true;
+        break;
+    case ASTNode::NK_UnaryOp: {
+        auto *unary = cast<UnaryOpNode>(node);
+        auto *ref = dyn_cast<VarRefNode>(unary->operand);
+        if (ref && ref->name == id &&
+            (unary->op == UnaryOp::INCREMENT || unary->op == UnaryOp::DECREMENT))
+            return true;
+        break;
+    }
+    case ASTNode::NK_ForeachLoop:
+        if (cast<ForeachLoopNode>(node)->varName == id) return true;
+        break;
+    case ASTNode::NK_TryCatch:
+        if (cast<TryCatchNode>(node)->errorVar == id) return true;
+        break;
+    default:
+        break;
+    }
+    SmallVector<ASTNode *, 4> children;
+    getChildren(node, children);
+    for (auto *child : children)
+        if (mayWrite(child, id)) return true;
+    return false;
+}
+
+bool hasSideEffects(ASTNode *node) {
+    switch (node->getKind()) {
+    case ASTNode::NK_Assign:
+    case ASTNode::NK_Print:
+        return true;
+    case ASTNode::NK_UnaryOp: {
+        UnaryOp op = cast<UnaryOpNode>(node)->op;
+        if (op == UnaryOp::INCREMENT || op == UnaryOp::DECREMENT) return true;
+        break;
+    }
+    default:
+        break;
+    }
+    SmallVector<ASTNode *, 4> children;
+    getChildren(node, children);
+    for (auto *child : children)
+        if (hasSideEffects(child)) return true;
+    return false;
+}
+
+bool mayTrap(ASTNode *node) {
+    switch (node->getKind()) {
+    case ASTNode::NK_ArrayAccess:
+        return true;
+    case ASTNode::NK_Array: {
+        // a repeat count may be negative
+        auto *count = cast<ArrayNode>(node)->count;
+        if (count && !isa<IntLiteral>(count)) return true;
+        break;
+    }
+    case ASTNode::NK_BinaryOp: {
+        auto *binary = cast<BinaryOpNode>(node);
+        // any element of an array divisor may be zero
+        if (binary->op == BinaryOp::ARRAY_DIVIDE) return true;
+        // two array operands may differ in length
+        if (binary->getType() == VarType::ARRAY &&
+            binary->left->getType() == VarType::ARRAY && binary->right->getType() == VarType::ARRAY)
+            return true;
+        if ((binary->op == BinaryOp::DIVIDE || binary->op == BinaryOp::MOD) &&
+            binary->getType() != VarType::FLOAT) {
+            // only a literal divisor other than 0 and -1 is known to be safe
+            auto *divisor = dyn_cast<IntLiteral>(binary->right);
+            if (!divisor || divisor->value == 0 || divisor->value == -1) return true;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    SmallVector<ASTNode *, 4> children;
+    getChildren(node, children);
+    for (auto *child : children)
+        if (mayTrap(child)) return true;
+    return false;
+}
@@ -0,0 +1,26 @@
+#ifndef AST_WALK_H
+#define AST_WALK_H
+
+#include <cstdint>
+#include <llvm/ADT/SmallVector.h>
+#include "AST.h"
+
+// Generic structural queries shared by the AST passes (unroller, folder, DCE).
+
+// direct children of a node, in source order; null children are skipped
+void getChildren(ASTNode *node, llvm::SmallVectorImpl<ASTNode *> &out);
+
+// size of the subtree, used as a code size estimate
+int64_t countNodes(ASTNode *node);
+
+// does the subtree assign, increment or (re)declare `id`?
+bool mayWrite(ASTNode *node, Identifier id);
+
+// does evaluating the subtree change any variable or print anything?
+bool hasSideEffects(ASTNode *node);
+
+// can evaluating the subtree fail a run-time check (bounds, zero divisor,
+// length mismatch, negative count)?
+bool mayTrap(ASTNode *node);
+
+#endif
@@ -0,0 +1,242 @@
+#include "autotune.h"
+#include "jit.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace llvm;
+
+namespace {
+const unsigned UnrollFactors[] = {1, 2, 4, 8};
+const OptLevel Levels[] = {OptLevel::O1, OptLevel::O2, OptLevel::O3};
+const unsigned VectorWidths[] = {0, 1, 4, 8};
+
+const char *levelName(OptLevel level) {
+    switch (level) {
+    case OptLevel::O0: return "O0";
+    case OptLevel::O1: return "O1";
+    case OptLevel::O2: return "O2";
+    case OptLevel::O3: return "O3";
+    case OptLevel::Os: return "Os";
+    }
+    llvm_unreachable("unknown optimization level");
+}
+
+bool parseLevel(StringRef name, OptLevel &level) {
+    for (OptLevel candidate : {OptLevel::O0, OptLevel::O1, OptLevel::O2, OptLevel::O3, OptLevel::Os}) {
+        if (name == levelName(candidate)) {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// retired user-space instructions of this thread, when the kernel allows it
+class InstructionCounter {
+    int fd = -1;
+
+public:
+    InstructionCounter() {
+#ifdef __linux__
+        perf_event_attr attr = {};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+    ~InstructionCounter() {
+        if (fd >= 0) close(fd);
+    }
+
+    bool available() const { return fd >= 0; }
+
+    void start() {
+#ifdef __linux__
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    uint64_t stop() {
+        uint64_t count = 0;
+#ifdef __linux__
+        if (fd < 0) return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count)) count = 0;
+#endif
+        return count;
+    }
+};
+
+// best of `runs`, so one-off noise (page faults, scheduling) drops out
+TuneMetrics runAll(JITProgram &program, unsigned runs) {
+    // stdout goes nowhere; the counter has to be opened by the thread it counts
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) {
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+    InstructionCounter counter;
+
+    TuneMetrics best;
+    for (unsigned i = 0; i < runs; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        counter.start();
+        program.run();
+        uint64_t instructions = counter.stop();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+        if (i == 0 || elapsed.count() < best.millis) best = {elapsed.count(), instructions};
+    }
+    std::fflush(stdout);
+    return best;
+}
+
+// The variant runs in a forked child, so a failed run-time check (which
+// exits) or a crash only loses that variant. The child hands its
+// measurement back through a pipe.
+Optional<TuneMetrics> measure(const TuneConfig &config, ModuleBuilder build, unsigned runs) {
+    std::unique_ptr<LLVMContext> context;
+    std::unique_ptr<Module> module = build(config, context);
+    if (!module) return None;
+    std::unique_ptr<JITProgram> program = JITProgram::create(std::move(context), std::move(module));
+    if (!program) return None;
+
+    int fds[2];
+    if (pipe(fds) != 0) return None;
+    std::fflush(stdout);
+    outs().flush();
+    pid_t child = fork();
+    if (child < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return None;
+    }
+    if (child == 0) {
+        close(fds[0]);
+        TuneMetrics metrics = runAll(*program, runs);
+        bool sent = write(fds[1], &metrics, sizeof(metrics)) == sizeof(metrics);
+        _exit(sent ? 0 : 1);
+    }
+
+    close(fds[1]);
+    TuneMetrics metrics;
+    bool received = read(fds[0], &metrics, sizeof(metrics)) == sizeof(metrics);
+    close(fds[0]);
+    int status = 0;
+    pid_t waited;
+    do {
+        waited = waitpid(child, &status, 0);
+    } while (waited < 0 && errno == EINTR);
+    if (waited < 0 || !received || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        if (WIFSIGNALED(status))
+            errs() << "killed by signal " << WTERMSIG(status) << ", ";
+        else if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+            errs() << "exit status " << WEXITSTATUS(status) << ", ";
+        return None;
+    }
+    return metrics;
+}
+}
+
+Optional<TuneResult> autotune(ModuleBuilder build, unsigned runs) {
+    bool counted = InstructionCounter().available();
+    if (!counted)
+        errs() << "autotune: hardware counters unavailable, timing only\n";
+
+    Optional<TuneResult> best;
+    for (OptLevel level : Levels) {
+        for (unsigned unroll : UnrollFactors) {
+            for (unsigned width : VectorWidths) {
+                TuneConfig config;
+                config.unroll = unroll;
+                config.level = level;
+                config.vectorWidth = width;
+
+                errs() << "autotune: -" << levelName(level) << " --unroll=" << unroll
+                       << " --vector-width=" << width << ": ";
+                Optional<TuneMetrics> result = measure(config, build, runs);
+                if (!result) {
+                    errs() << "failed\n";
+                    continue;
+                }
+                result->counted = counted;
+                errs() << format("%.3f ms", result->millis);
+                if (counted) errs() << ", " << result->instructions << " instructions";
+                errs() << "\n";
+
+                if (!best || result->millis < best->metrics.millis)
+                    best = TuneResult{config, *result};
+            }
+        }
+    }
+    if (best)
+        errs() << "autotune: best is -" << levelName(best->config.level) << " --unroll=" << best->config.unroll
+               << " --vector-width=" << best->config.vectorWidth << "\n";
+    return best;
+}
+
+bool loadTuneConfig(StringRef path, uint64_t sourceHash, TuneConfig &config) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> file = MemoryBuffer::getFile(path);
+    if (!file) return false;
+
+    TuneConfig loaded;
+    bool hashMatches = false;
+    SmallVector<StringRef, 4> lines;
+    (*file)->getBuffer().split(lines, '\n', -1, false);
+    for (StringRef line : lines) {
+        std::pair<StringRef, StringRef> entry = line.trim().split('=');
+        StringRef key = entry.first.trim(), value = entry.second.trim();
+        uint64_t hash;
+        if (key == "hash")
+            hashMatches = !value.getAsInteger(16, hash) && hash == sourceHash;
+        else if (key == "unroll" && value.getAsInteger(10, loaded.unroll))
+            return false;
+        else if (key == "opt" && !parseLevel(value, loaded.level))
+            return false;
+        else if (key == "vector-width" && value.getAsInteger(10, loaded.vectorWidth))
+            return false;
+    }
+    if (!hashMatches) return false;
+    config = loaded;
+    return true;
+}
+
+bool saveTuneConfig(StringRef path, uint64_t sourceHash, const TuneResult &result) {
+    const TuneConfig &config = result.config;
+    std::error_code ec;
+    raw_fd_ostream out(path, ec, sys::fs::OF_Text);
+    if (ec) {
+        errs() << "Error writing " << path << ": " << ec.message() << "\n";
+        return true;
+    }
+    out << "# written by --autotune; ignored once the source changes\n"
+        << "hash=" << utohexstr(sourceHash) << "\n"
+        << "opt=" << levelName(config.level) << "\n"
+        << "unroll=" << config.unroll << "\n"
+        << "vector-width=" << config.vectorWidth << "\n"
+        << "# what it measured, best of the tuning runs\n"
+        << format("millis=%.6f", result.metrics.millis) << "\n";
+    if (result.metrics.counted)
+        out << "instructions=" << result.metrics.instructions << "\n";
+    return false;
+}
@@ -0,0 +1,51 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <cstdint>
+#include <memory>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/STLFunctionalExtras.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include "passes.h"
+
+// The knobs the auto-tuner searches over.
+struct TuneConfig {
+    unsigned unroll = 2;
+    OptLevel level = OptLevel::O2;
+    unsigned vectorWidth = 0; // 0 leaves it to the vectorizer's cost model
+};
+
+// What one configuration measured: its fastest run, and the instructions
+// that run retired when perf counters are available.
+struct TuneMetrics {
+    double millis = 0;
+    uint64_t instructions = 0;
+    bool counted = false;
+};
+
+struct TuneResult {
+    TuneConfig config;
+    TuneMetrics metrics;
+};
+
+// Builds one optimized module for a configuration; null on error.
+using ModuleBuilder = llvm::function_ref<std::unique_ptr<llvm::Module>(
+    const TuneConfig &config, std::unique_ptr<llvm::LLVMContext> &context)>;
+
+// JIT-compiles the program once per configuration in the search space and
+// runs main `runs` times in a forked child with stdout silenced, timing each
+// run and, where perf counters are available, counting retired instructions.
+// A variant whose child exits early or crashes counts as failed. Reports
+// every variant to errs() and returns the fastest, or None if none could run.
+llvm::Optional<TuneResult> autotune(ModuleBuilder build, unsigned runs);
+
+// Sidecar file holding the winning configuration for one version of a
+// source file, with the metrics it won on. load returns false when the file
+// is missing, unreadable or was tuned for a different source hash, and
+// skips the metrics; save reports errors and returns true on failure.
+bool loadTuneConfig(llvm::StringRef path, uint64_t sourceHash, TuneConfig &config);
+bool saveTuneConfig(llvm::StringRef path, uint64_t sourceHash, const TuneResult &result);
+
+#endif
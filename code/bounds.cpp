@@ -0,0 +1,149 @@
+#include "bounds.h"
+#include "ast_walk.h"
+#include <algorithm>
+
+using namespace llvm;
+
+namespace {
+// iv, iv + c, c + iv, iv - c
+Optional<int64_t> inductionOffset(ASTNode *index, Identifier iv) {
+    if (auto *ref = dyn_cast<VarRefNode>(index))
+        return ref->name == iv ? Optional<int64_t>(0) : None;
+    auto *binary = dyn_cast<BinaryOpNode>(index);
+    if (!binary) return None;
+    auto *ref = dyn_cast<VarRefNode>(binary->left);
+    auto *literal = dyn_cast<IntLiteral>(binary->right);
+    if (binary->op == BinaryOp::ADD && !ref) {
+        ref = dyn_cast<VarRefNode>(binary->right);
+        literal = dyn_cast<IntLiteral>(binary->left);
+    }
+    if (!ref || !literal || ref->name != iv) return None;
+    if (binary->op == BinaryOp::ADD) return int64_t(literal->value);
+    if (binary->op == BinaryOp::SUBTRACT) return -int64_t(literal->value);
+    return None;
+}
+
+class RangeAnalysis {
+    LoopRange range;
+    ArrayRef<ASTNode *> body;
+    ASTNode *update;
+
+public:
+    RangeAnalysis(ArrayRef<ASTNode *> statements, ASTNode *forUpdate) : body(statements), update(forUpdate) {}
+
+    Optional<LoopRange> run(ASTNode *condition, ASTNode *init) {
+        CountedLoop &loop = range.loop;
+        if (!findInductionVariable()) return None;
+
+        // walk the top-level statements, tracking how far iv has moved
+        int64_t delta = 0;
+        bool increasing = loop.step > 0;
+        for (auto *stmt : body) {
+            CountedLoop step;
+            if (matchUpdate(stmt, step) && step.iv == loop.iv) {
+                if ((step.step > 0) != increasing) return None;
+                delta += step.step;
+                continue;
+            }
+            if (mayWrite(stmt, loop.iv)) return None;
+            collectAccesses(stmt, delta);
+        }
+        if (update) {
+            CountedLoop step;
+            if (!matchUpdate(update, step) || step.iv != loop.iv || (step.step > 0) != increasing)
+                return None;
+            delta += step.step;
+        }
+        if (!fitsInt(delta)) return None;
+
+        loop.step = delta;
+        if (!matchCondition(condition, loop) || loop.cmp == BinaryOp::NOT_EQUAL) return None;
+        if (hasSideEffects(loop.bound) || !isInvariant(loop.bound)) return None;
+        loop.start = startValue(init, loop.iv);
+
+        // an array reassigned in the loop may change size under the check
+        auto written = [&](const InductionAccess &entry) { return writesAnywhere(entry.access->arrayName); };
+        range.accesses.erase(std::remove_if(range.accesses.begin(), range.accesses.end(), written),
+                             range.accesses.end());
+        return std::move(range);
+    }
+
+private:
+    // the variable of the for update, or of the first top-level update in a while body
+    bool findInductionVariable() {
+        if (update) return matchUpdate(update, range.loop);
+        for (auto *stmt : body)
+            if (matchUpdate(stmt, range.loop)) return true;
+        return false;
+    }
+
+    void collectAccesses(ASTNode *node, int64_t delta) {
+        if (auto *access = dyn_cast<ArrayAccessNode>(node)) {
+            if (Optional<int64_t> offset = inductionOffset(access->index, range.loop.iv))
+                range.accesses.push_back({access, delta + *offset});
+        }
+        SmallVector<ASTNode *, 4> children;
+        getChildren(node, children);
+        for (auto *child : children) collectAccesses(child, delta);
+    }
+
+    bool writesAnywhere(Identifier id) {
+        for (auto *stmt : body)
+            if (mayWrite(stmt, id)) return true;
+        return update && mayWrite(update, id);
+    }
+
+    bool isInvariant(ASTNode *node) {
+        if (auto *ref = dyn_cast<VarRefNode>(node)) return !writesAnywhere(ref->name);
+        if (auto *access = dyn_cast<ArrayAccessNode>(node))
+            if (writesAnywhere(access->arrayName)) return false;
+        SmallVector<ASTNode *, 4> children;
+        getChildren(node, children);
+        for (auto *child : children)
+            if (!isInvariant(child)) return false;
+        return true;
+    }
+};
+}
+
+Optional<LoopRange> analyzeLoopRange(ASTNode *loop) {
+    if (auto *forLoop = dyn_cast<ForLoopNode>(loop)) {
+        if (!forLoop->update || !forLoop->body) return None;
+        return RangeAnalysis(forLoop->body->statements, forLoop->update).run(forLoop->condition, forLoop->init);
+    }
+    if (auto *whileLoop = dyn_cast<WhileLoopNode>(loop)) {
+        if (!whileLoop->body) return None;
+        return RangeAnalysis(whileLoop->body->statements, nullptr).run(whileLoop->condition, nullptr);
+    }
+    return None;
+}
+
+bool provenInBounds(const LoopRange &range, const InductionAccess &access, uint64_t size) {
+    const CountedLoop &loop = range.loop;
+    auto *limit = dyn_cast<IntLiteral>(loop.bound);
+    if (!loop.start || !limit) return false;
+    int64_t start = *loop.start, bound = limit->value, lo, hi;
+    switch (loop.cmp) {
+    case BinaryOp::LESS:
+        if (start >= bound) return true;
+        lo = start, hi = bound - 1;
+        break;
+    case BinaryOp::LESS_EQUAL:
+        if (start > bound) return true;
+        lo = start, hi = bound;
+        break;
+    case BinaryOp::GREATER:
+        if (start <= bound) return true;
+        lo = bound + 1, hi = start;
+        break;
+    case BinaryOp::GREATER_EQUAL:
+        if (start < bound) return true;
+        lo = bound, hi = start;
+        break;
+    default:
+        return false;
+    }
+    // a wrapping induction variable would leave the range
+    if (!fitsInt(loop.step > 0 ? hi + loop.step : lo + loop.step)) return false;
+    return lo + access.offset >= 0 && hi + access.offset < int64_t(size);
+}
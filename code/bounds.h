@@ -0,0 +1,40 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <cstdint>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallVector.h>
+#include "AST.h"
+#include "counted_loop.h"
+
+// How indexed array accesses are checked at run time:
+//   full     every access compares its index against the array size
+//   hoisted  accesses proven in range go unchecked; those indexed by a loop
+//            induction variable are checked once before the loop, which
+//            then runs unchecked, or checked if the test fails
+//   off      nothing is checked
+enum class BoundsChecks { Full, Hoisted, Off };
+
+// a[iv + offset], with iv taken at the top of the iteration
+struct InductionAccess {
+    ArrayAccessNode *access;
+    int64_t offset;
+};
+
+// A counted for or while loop whose induction variable only moves one way:
+// by constant updates among the body's top-level statements (and the for
+// update) and nowhere else. At the top of each iteration it lies between its
+// value on entry and the bound, and no array it indexes is reassigned.
+struct LoopRange {
+    CountedLoop loop; // step is the net step of a whole iteration
+    llvm::SmallVector<InductionAccess, 4> accesses;
+};
+
+// for a ForLoopNode or WhileLoopNode; the for init is not part of the range
+llvm::Optional<LoopRange> analyzeLoopRange(ASTNode *loop);
+
+// With a literal start and bound, does `access` stay within [0, size) on
+// every iteration? Also true when the loop never runs.
+bool provenInBounds(const LoopRange &range, const InductionAccess &access, uint64_t size);
+
+#endif
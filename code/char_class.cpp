@@ -0,0 +1,213 @@
+#include "char_class.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CHAR_CLASS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace charclass {
+
+namespace {
+constexpr std::array<uint8_t, 256> buildTable() {
+    std::array<uint8_t, 256> t = {};
+    const char spaces[] = {' ', '\t', '\n', '\v', '\f', '\r'};
+    for (char c : spaces) t[static_cast<unsigned char>(c)] |= Space;
+    for (int c = 'a'; c <= 'z'; ++c) t[c] |= Alpha | IdentBody;
+    for (int c = 'A'; c <= 'Z'; ++c) t[c] |= Alpha | IdentBody;
+    for (int c = '0'; c <= '9'; ++c) t[c] |= Digit | IdentBody;
+    t['_'] |= IdentBody;
+    return t;
+}
+}
+
+const std::array<uint8_t, 256> table = buildTable();
+
+namespace {
+
+// scalar fallback and tail handling
+
+const char *skipClassScalar(const char *p, const char *end, uint8_t cls) {
+    while (p < end && is(*p, cls)) ++p;
+    return p;
+}
+
+const char *findCommentEndScalar(const char *p, const char *end) {
+    for (; p + 1 < end; ++p)
+        if (p[0] == '*' && p[1] == '/') return p;
+    return end;
+}
+
+const char *skipSpaceScalar(const char *p, const char *end) { return skipClassScalar(p, end, Space); }
+const char *skipIdentBodyScalar(const char *p, const char *end) { return skipClassScalar(p, end, IdentBody); }
+const char *skipDigitsScalar(const char *p, const char *end) { return skipClassScalar(p, end, Digit); }
+
+#ifdef CHAR_CLASS_X86
+
+// Byte-range tests use signed compares; bytes >= 0x80 are negative and
+// therefore never fall in an ASCII range.
+
+inline __m128i inRange16(__m128i v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+inline __m128i spaceMask16(__m128i v) {
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), inRange16(v, '\t', '\r'));
+}
+
+inline __m128i digitMask16(__m128i v) { return inRange16(v, '0', '9'); }
+
+inline __m128i identMask16(__m128i v) {
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    return _mm_or_si128(_mm_or_si128(inRange16(lower, 'a', 'z'), inRange16(v, '0', '9')),
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+}
+
+template <__m128i (*Mask)(__m128i)>
+const char *skipSSE2(const char *p, const char *end, const char *(*tail)(const char *, const char *)) {
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned miss = ~static_cast<unsigned>(_mm_movemask_epi8(Mask(v))) & 0xFFFFu;
+        if (miss) return p + __builtin_ctz(miss);
+        p += 16;
+    }
+    return tail(p, end);
+}
+
+const char *skipSpaceSSE2(const char *p, const char *end) {
+    return skipSSE2<spaceMask16>(p, end, skipSpaceScalar);
+}
+const char *skipIdentBodySSE2(const char *p, const char *end) {
+    return skipSSE2<identMask16>(p, end, skipIdentBodyScalar);
+}
+const char *skipDigitsSSE2(const char *p, const char *end) {
+    return skipSSE2<digitMask16>(p, end, skipDigitsScalar);
+}
+
+const char *findCommentEndSSE2(const char *p, const char *end) {
+    const __m128i star = _mm_set1_epi8('*');
+    const __m128i slash = _mm_set1_epi8('/');
+    while (end - p >= 17) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+        unsigned hit = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, star), _mm_cmpeq_epi8(b, slash)));
+        if (hit) return p + __builtin_ctz(hit);
+        p += 16;
+    }
+    return findCommentEndScalar(p, end);
+}
+
+#define AVX2_FN __attribute__((target("avx2")))
+
+AVX2_FN inline __m256i inRange32(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+AVX2_FN inline __m256i spaceMask32(__m256i v) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), inRange32(v, '\t', '\r'));
+}
+
+AVX2_FN inline __m256i digitMask32(__m256i v) { return inRange32(v, '0', '9'); }
+
+AVX2_FN inline __m256i identMask32(__m256i v) {
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    return _mm256_or_si256(_mm256_or_si256(inRange32(lower, 'a', 'z'), inRange32(v, '0', '9')),
+                           _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+}
+
+AVX2_FN const char *skipSpaceAVX2(const char *p, const char *end) {
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        unsigned miss = ~static_cast<unsigned>(_mm256_movemask_epi8(spaceMask32(v)));
+        if (miss) return p + __builtin_ctz(miss);
+        p += 32;
+    }
+    return skipSpaceSSE2(p, end);
+}
+
+AVX2_FN const char *skipIdentBodyAVX2(const char *p, const char *end) {
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        unsigned miss = ~static_cast<unsigned>(_mm256_movemask_epi8(identMask32(v)));
+        if (miss) return p + __builtin_ctz(miss);
+        p += 32;
+    }
+    return skipIdentBodySSE2(p, end);
+}
+
+AVX2_FN const char *skipDigitsAVX2(const char *p, const char *end) {
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        unsigned miss = ~static_cast<unsigned>(_mm256_movemask_epi8(digitMask32(v)));
+        if (miss) return p + __builtin_ctz(miss);
+        p += 32;
+    }
+    return skipDigitsSSE2(p, end);
+}
+
+AVX2_FN const char *findCommentEndAVX2(const char *p, const char *end) {
+    const __m256i star = _mm256_set1_epi8('*');
+    const __m256i slash = _mm256_set1_epi8('/');
+    while (end - p >= 33) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1));
+        unsigned hit = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, star),
+                                                             _mm256_cmpeq_epi8(b, slash)));
+        if (hit) return p + __builtin_ctz(hit);
+        p += 32;
+    }
+    return findCommentEndSSE2(p, end);
+}
+
+#undef AVX2_FN
+
+#endif // CHAR_CLASS_X86
+
+using ScanFn = const char *(*)(const char *, const char *);
+
+struct Scanners {
+    ScanFn skipSpace;
+    ScanFn skipIdentBody;
+    ScanFn skipDigits;
+    ScanFn findCommentEnd;
+};
+
+Scanners selectScanners() {
+#ifdef CHAR_CLASS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {skipSpaceAVX2, skipIdentBodyAVX2, skipDigitsAVX2, findCommentEndAVX2};
+    if (__builtin_cpu_supports("sse2"))
+        return {skipSpaceSSE2, skipIdentBodySSE2, skipDigitsSSE2, findCommentEndSSE2};
+#endif
+    return {skipSpaceScalar, skipIdentBodyScalar, skipDigitsScalar, findCommentEndScalar};
+}
+
+const Scanners scanners = selectScanners();
+
+}
+
+// Short runs (a single blank between tokens, a one-letter name) are the
+// common case, so test the first byte inline before taking the bulk path.
+
+const char *skipSpace(const char *p, const char *end) {
+    if (p == end || !isSpace(*p)) return p;
+    return scanners.skipSpace(p + 1, end);
+}
+
+const char *skipIdentBody(const char *p, const char *end) {
+    if (p == end || !isIdentBody(*p)) return p;
+    return scanners.skipIdentBody(p + 1, end);
+}
+
+const char *skipDigits(const char *p, const char *end) {
+    if (p == end || !isDigit(*p)) return p;
+    return scanners.skipDigits(p + 1, end);
+}
+
+const char *findCommentEnd(const char *p, const char *end) {
+    return scanners.findCommentEnd(p, end);
+}
+
+}
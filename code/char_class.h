@@ -0,0 +1,38 @@
+#ifndef CHAR_CLASS_H
+#define CHAR_CLASS_H
+
+#include <array>
+#include <cstdint>
+
+// Locale-independent character classes for the lexer, plus bulk scanners
+// that skip whole runs of a class. The scanners use AVX2 or SSE2 when the
+// CPU has them (picked once at startup) and fall back to the table.
+namespace charclass {
+
+enum : uint8_t {
+    Space = 1 << 0,     // ' ' \t \n \v \f \r
+    Alpha = 1 << 1,     // A-Z a-z
+    Digit = 1 << 2,     // 0-9
+    IdentBody = 1 << 3  // A-Z a-z 0-9 _
+};
+
+extern const std::array<uint8_t, 256> table;
+
+inline bool is(char c, uint8_t cls) { return table[static_cast<unsigned char>(c)] & cls; }
+inline bool isSpace(char c) { return is(c, Space); }
+inline bool isAlpha(char c) { return is(c, Alpha); }
+inline bool isDigit(char c) { return is(c, Digit); }
+inline bool isIdentBody(char c) { return is(c, IdentBody); }
+
+// Each returns the first position in [p, end) that is not in the class,
+// or end.
+const char *skipSpace(const char *p, const char *end);
+const char *skipIdentBody(const char *p, const char *end);
+const char *skipDigits(const char *p, const char *end);
+
+// Returns the position of the "*/" that closes a comment, or end.
+const char *findCommentEnd(const char *p, const char *end);
+
+}
+
+#endif
@@ -1,12 +1,73 @@
-#include "codegen.h"
+#include "code_generator.h"
 #include "AST.h"
 #include "semantic.h"
+#include "ast_walk.h"
 #include <llvm/IR/Verifier.h>
 #include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
 
 using namespace llvm;
 
+// branch weight of the path that is all but certain to be taken
+static const uint32_t LikelyWeight = 1 << 20;
+
+// Array arithmetic. A tree of ARRAY_ ops is fused into one pass: every
+// array and scalar it reads is evaluated once up front, then each element of
+// the result is computed straight from the operands, with no intermediate
+// arrays. Up to MaxInlineLanes elements that is one vector instruction per
+// operator; longer arrays run in strips of ArrayStrip lanes, and a lone
+// operator calls the SIMD kernels of rtArray.c.
+static const uint64_t MaxInlineLanes = 64;
+static const unsigned ArrayStrip = 8;
+
+// An array value points at its first element. The 24 bytes before it hold
+// its reference count, the length in elements and the capacity in bytes,
+// all int64, and the elements start on an ArrayAlign boundary. Ints and
+// floats take 4 bytes, chars 1, and bools one bit, bit i in bit i % 8 of
+// byte i / 8. Arrays of a known size up to StackArrayBytes live in main's
+// frame; the others come from mas_array_alloc. A string is laid out like a
+// char array, with a NUL after its last char.
+static const uint64_t StackArrayBytes = 4096;
+static const unsigned ArrayAlign = 64;
+
+// the reference count of a stack slot or constant, which is never counted
+// or freed
+static const int64_t StaticRefs = -1;
+
+// element codes of mas_array_print
+enum ArrayKind { KindInt, KindFloat, KindChar, KindBool };
+
+static bool isArrayOp(ASTNode* node) {
+    auto* binary = dyn_cast<BinaryOpNode>(node);
+    if (!binary) {
+        return false;
+    }
+    switch (binary->op) {
+        case BinaryOp::ARRAY_ADD: case BinaryOp::ARRAY_SUBTRACT:
+        case BinaryOp::ARRAY_MULTIPLY: case BinaryOp::ARRAY_DIVIDE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// a variable of this type holds a reference to an array or string buffer
+static bool holdsBuffer(VarType type) {
+    return type == VarType::ARRAY || type == VarType::STRING;
+}
+
+// a literal made of literals, emitted as a read-only constant
+static bool isConstantValue(ASTNode* node) {
+    if (isa<StrLiteral>(node)) {
+        return true;
+    }
+    auto* literal = dyn_cast<ArrayNode>(node);
+    return literal && !literal->count && all_of(literal->elements, [](ASTNode* element) {
+        return isa<IntLiteral, FloatLiteral, BoolLiteral, CharLiteral>(element);
+    });
+}
+
 CodeGen::CodeGen() : context(std::make_unique<LLVMContext>()),
                      module(std::make_unique<Module>("main", *context)),
                      builder(std::make_unique<IRBuilder<>>(*context)) {
@@ -16,32 +77,126 @@ CodeGen::CodeGen() : context(std::make_unique<LLVMContext>()),
     BasicBlock* entry = BasicBlock::Create(*context, "entry", mainFunc);
     builder->SetInsertPoint(entry);
 
+    // placeholder the entry-block allocas are inserted before; erased once main is done
+    allocaPoint = new BitCastInst(UndefValue::get(Type::getInt32Ty(*context)),
+                                  Type::getInt32Ty(*context), "allocapt", entry);
+    allocaBuilder = std::make_unique<IRBuilder<>>(allocaPoint);
+
     printfFunc = Function::Create(
         FunctionType::get(Type::getInt32Ty(*context), {Type::getInt8PtrTy(*context)}, true),
         Function::ExternalLinkage, "printf", module.get()
     );
+}
 
-    Function::Create(
-        FunctionType::get(Type::getInt8PtrTy(*context), {Type::getInt32Ty(*context)}, false),
-        Function::ExternalLinkage, "malloc", module.get()
-    );
+void CodeGen::compile(ProgramNode* root, const IdentifierTable& identifiers, const CodeGenOptions& opts) {
+    idents = &identifiers;
+    options = opts;
+    symbols.reset(identifiers.size());
+    scopeSlots.assign(1, {});
+    scopeCounted.assign(1, {});
+    ssa.reset();
+    ssa.sealBlock(builder->GetInsertBlock());
+    findRedefinedArrays(root);
+    findEscapingValues(root);
+    generate(*root);
+}
 
-    Function::Create(
-        FunctionType::get(Type::getVoidTy(*context), 
-        {Type::getInt8PtrTy(*context), Type::getInt8PtrTy(*context), Type::getInt32Ty(*context)}, 
-        false),
-        Function::ExternalLinkage, "memcpy", module.get()
-    );
+AllocaInst* CodeGen::lookupSymbol(Identifier id) const {
+    const Variable* var = symbols.lookup(id);
+    return var ? var->slot : nullptr;
+}
+
+Value* CodeGen::loadVariable(Identifier id) {
+    const Variable* var = symbols.lookup(id);
+    if (!var) {
+        throw std::runtime_error("Undefined variable: " + idents->getName(id).str());
+    }
+    if (!var->slot) {
+        return ssa.readVariable(var->ssaVar, builder->GetInsertBlock());
+    }
+    return builder->CreateLoad(var->slot->getAllocatedType(), var->slot);
+}
+
+void CodeGen::storeVariable(Identifier id, Value* value) {
+    const Variable* var = symbols.lookup(id);
+    if (!var) {
+        throw std::runtime_error("Undefined variable: " + idents->getName(id).str());
+    }
+    if (!var->slot) {
+        ssa.writeVariable(var->ssaVar, builder->GetInsertBlock(), value);
+        return;
+    }
+    builder->CreateStore(value, var->slot);
+}
+
+// Stack slot in the entry block, so a declaration inside a loop reuses one
+// slot instead of growing the stack per iteration and mem2reg can promote
+// it. Its lifetime starts here and ends when the enclosing scope closes.
+AllocaInst* CodeGen::createSlot(Type* type, const Twine& name) {
+    AllocaInst* slot = allocaBuilder->CreateAlloca(type, nullptr, name);
+    builder->CreateLifetimeStart(slot);
+    scopeSlots.back().push_back(slot);
+    return slot;
+}
+
+// A slot for an array or string variable that counts as a holder of its
+// value. It is null from the entry block on and has no lifetime markers, so
+// a declaration run again still finds the value it replaces.
+AllocaInst* CodeGen::createCountedSlot(Type* type, const Twine& name) {
+    AllocaInst* slot = allocaBuilder->CreateAlloca(type, nullptr, name);
+    allocaBuilder->CreateStore(Constant::getNullValue(type), slot);
+    scopeCounted.back().push_back(slot);
+    return slot;
+}
+
+// Stores into a counted slot: one more holder for `value`, one fewer for
+// what the slot held. Retaining first keeps `x = x` from freeing x.
+void CodeGen::storeCounted(AllocaInst* slot, Value* value) {
+    Type* bytePtr = Type::getInt8PtrTy(*context);
+    builder->CreateCall(getArrayRuntime("mas_array_retain"), {builder->CreateBitCast(value, bytePtr)});
+    Value* old = builder->CreateLoad(slot->getAllocatedType(), slot);
+    builder->CreateCall(getArrayRuntime("mas_array_release"), {builder->CreateBitCast(old, bytePtr)});
+    builder->CreateStore(value, slot);
+}
+
+void CodeGen::pushScope() {
+    symbols.pushScope();
+    scopeSlots.emplace_back();
+    scopeCounted.emplace_back();
+}
+
+void CodeGen::popScope() {
+    // a block that already returned or trapped has nothing left to end
+    if (!builder->GetInsertBlock()->getTerminator()) {
+        for (AllocaInst* slot : scopeCounted.back()) {
+            Value* value = builder->CreateLoad(slot->getAllocatedType(), slot);
+            builder->CreateCall(getArrayRuntime("mas_array_release"),
+                                {builder->CreateBitCast(value, Type::getInt8PtrTy(*context))});
+            builder->CreateStore(Constant::getNullValue(slot->getAllocatedType()), slot);
+        }
+        for (AllocaInst* slot : scopeSlots.back()) {
+            builder->CreateLifetimeEnd(slot);
+        }
+    }
+    scopeCounted.pop_back();
+    scopeSlots.pop_back();
+    symbols.popScope();
 }
 
 void CodeGen::generate(ProgramNode& ast) {
-    for (auto& stmt : ast.statements) {
-        generateStatement(stmt.get());
+    for (auto* stmt : ast.statements) {
+        generateStatement(stmt);
     }
     
     if (!builder->GetInsertBlock()->getTerminator()) {
         builder->CreateRet(ConstantInt::get(Type::getInt32Ty(*context), 0));
     }
+    if (options.directSSA) {
+        // each construct seals the blocks it creates; this only catches one left open
+        ssa.sealAll(*builder->GetInsertBlock()->getParent());
+    }
+    allocaPoint->eraseFromParent();
+    allocaPoint = nullptr;
     
     std::string error;
     raw_string_ostream os(error);
@@ -51,28 +206,35 @@ void CodeGen::generate(ProgramNode& ast) {
 }
 
 void CodeGen::generateStatement(ASTNode* node) {
-    if (auto multiVarDecl = dynamic_cast<MultiVarDeclNode*>(node)) {
-        for (auto& decl : multiVarDecl->declarations) {
-            generateVarDecl(decl.get());
-        }
-    } else if (auto assign = dynamic_cast<AssignNode*>(node)) {
-        generateAssign(assign);
-    } else if (auto ifElse = dynamic_cast<IfElseNode*>(node)) {
-        generateIfElse(ifElse);
-    } else if (auto loop = dynamic_cast<ForLoopNode*>(node)) {
-        generateForLoop(loop);
-    } else if (auto print = dynamic_cast<PrintNode*>(node)) {
-        generatePrint(print);
-    } else if (auto block = dynamic_cast<BlockNode*>(node)) {
-        generateBlock(block);
-    } else if (auto tryCatch = dynamic_cast<TryCatchNode*>(node)) {
-        generateTryCatch(tryCatch);
-    } else if (auto match = dynamic_cast<MatchNode*>(node)) {
-        generateMatch(match);
-    } else if (auto unary = dynamic_cast<UnaryOpNode*>(node)) {
-        generateUnaryOp(unary);
-    } else if (auto concat = dynamic_cast<ConcatNode*>(node)) {
-        generateConcat(concat);
+    switch (node->getKind()) {
+        case ASTNode::NK_MultiVarDecl:
+            for (auto* decl : cast<MultiVarDeclNode>(node)->declarations) {
+                generateVarDecl(decl);
+            }
+            break;
+        case ASTNode::NK_Assign:
+            generateAssign(cast<AssignNode>(node));
+            break;
+        case ASTNode::NK_IfElse:
+            generateIfElse(cast<IfElseNode>(node));
+            break;
+        case ASTNode::NK_ForLoop:
+            generateForLoop(cast<ForLoopNode>(node));
+            break;
+        case ASTNode::NK_WhileLoop:
+            generateWhileLoop(cast<WhileLoopNode>(node));
+            break;
+        case ASTNode::NK_Print:
+            generatePrint(cast<PrintNode>(node));
+            break;
+        case ASTNode::NK_Block:
+            generateBlock(cast<BlockNode>(node));
+            break;
+        case ASTNode::NK_UnaryOp:
+            generateUnaryOp(cast<UnaryOpNode>(node));
+            break;
+        default:
+            break;
     }
 }
 
@@ -82,81 +244,187 @@ void CodeGen::generateVarDecl(VarDeclNode* node) {
         case VarType::INT: type = Type::getInt32Ty(*context); break;
         case VarType::FLOAT: type = Type::getFloatTy(*context); break;
         case VarType::BOOL: type = Type::getInt1Ty(*context); break;
+        case VarType::CHAR: type = Type::getInt8Ty(*context); break;
         case VarType::STRING: type = Type::getInt8PtrTy(*context); break;
         case VarType::ARRAY: 
-            type = PointerType::get(Type::getInt32Ty(*context), 0);
+            type = arrayType(node->getElementType());
             break;
         default: throw std::runtime_error("Unknown type");
     }
     
-    AllocaInst* alloca = builder->CreateAlloca(type, nullptr, node->name);
-    symbols[node->name] = alloca;
+    if (options.directSSA && !type->isPointerTy()) {
+        // scalars never touch memory; an uninitialized one reads as zero
+        Value* val = node->value ? generateValue(node->value, type) : Constant::getNullValue(type);
+        if (node->value && node->type == VarType::FLOAT) {
+            val = promoteToFloat(val, node->value);
+        }
+        unsigned var = ssa.addVariable(type);
+        symbols.bind(node->name, {nullptr, var});
+        ssa.writeVariable(var, builder->GetInsertBlock(), val);
+        return;
+    }
+
+    bool counted = holdsBuffer(node->type) && countedNames.count(node->name.getID());
+    AllocaInst* alloca = counted ? createCountedSlot(type, idents->getName(node->name))
+                                 : createSlot(type, idents->getName(node->name));
+    symbols.bind(node->name, {alloca, 0});
     
     if (node->value) {
-        Value* val = generateValue(node->value.get(), type);
-        builder->CreateStore(val, alloca);
+        Value* val = generateValue(node->value, type);
+        if (node->type == VarType::FLOAT) {
+            val = promoteToFloat(val, node->value);
+        }
+        if (counted) {
+            storeCounted(alloca, val);
+        } else {
+            builder->CreateStore(val, alloca);
+        }
         
-        if (node->type == VarType::ARRAY) {
-            if (auto arrLit = dynamic_cast<ArrayNode*>(node->value.get())) {
-                arraySizes[node->name] = arrLit->elements.size();
+        // a length is only tracked for an array defined once
+        if (node->type == VarType::ARRAY && !redefinedArrays.count(node->name.getID())) {
+            if (Optional<uint64_t> size = knownArraySize(node->value)) {
+                arraySizes[node->name.getID()] = *size;
             }
         }
     }
 }
 
+// `x = v`, or a compound `x += v`. An array or string is shared, not
+// copied: the target takes a reference to the same buffer.
+void CodeGen::generateAssign(AssignNode* node) {
+    Value* value;
+    if (node->op == BinaryOp::EQUAL) {
+        value = generateValue(node->value, nullptr);
+        if (node->getType() == VarType::FLOAT) {
+            value = promoteToFloat(value, node->value);
+        }
+    } else {
+        Value* current = loadVariable(node->target);
+        value = generateValue(node->value, current->getType());
+        bool isFloat = node->getType() == VarType::FLOAT;
+        if (isFloat) {
+            value = promoteToFloat(value, node->value);
+        }
+        switch (node->op) {
+            case BinaryOp::ADD:
+                value = isFloat ? builder->CreateFAdd(current, value) : builder->CreateAdd(current, value);
+                break;
+            case BinaryOp::SUBTRACT:
+                value = isFloat ? builder->CreateFSub(current, value) : builder->CreateSub(current, value);
+                break;
+            case BinaryOp::MULTIPLY:
+                value = isFloat ? builder->CreateFMul(current, value) : builder->CreateMul(current, value);
+                break;
+            case BinaryOp::DIVIDE:
+                value = isFloat ? builder->CreateFDiv(current, value) : builder->CreateSDiv(current, value);
+                break;
+            case BinaryOp::MOD:
+                value = isFloat ? builder->CreateFRem(current, value) : builder->CreateSRem(current, value);
+                break;
+            default:
+                throw std::runtime_error("Unsupported compound assignment");
+        }
+    }
+    if (holdsBuffer(node->getType()) && countedNames.count(node->target.getID())) {
+        storeCounted(lookupSymbol(node->target), value);
+    } else {
+        storeVariable(node->target, value);
+    }
+}
+
 Value* CodeGen::generateValue(ASTNode* node, Type* expectedType) {
-    if (auto binOp = dynamic_cast<BinaryOpNode*>(node)) {
-        return generateBinaryOp(binOp, expectedType);
-    } else if (auto varRef = dynamic_cast<VarRefNode*>(node)) {
-        if (!symbols.count(varRef->name)) {
-            throw std::runtime_error("Undefined variable: " + varRef->name);
-        }
-        return builder->CreateLoad(symbols[varRef->name]->getAllocatedType(), symbols[varRef->name]);
-    } else if (auto intLit = dynamic_cast<LiteralNode<int>*>(node)) {
-        return ConstantInt::get(Type::getInt32Ty(*context), intLit->value);
-    } else if (auto floatLit = dynamic_cast<LiteralNode<float>*>(node)) {
-        return ConstantFP::get(Type::getFloatTy(*context), floatLit->value);
-    } else if (auto strLit = dynamic_cast<LiteralNode<std::string>*>(node)) {
-        return builder->CreateGlobalStringPtr(strLit->value);
-    } else if (auto arr = dynamic_cast<ArrayNode*>(node)) {
-        return generateArray(arr, expectedType);
-    } else if (auto access = dynamic_cast<ArrayAccessNode*>(node)) {
-        return generateArrayAccess(access);
-    }
-    throw std::runtime_error("Unsupported node type");
+    switch (node->getKind()) {
+        case ASTNode::NK_BinaryOp:
+            return generateBinaryOp(cast<BinaryOpNode>(node), expectedType);
+        case ASTNode::NK_VarRef: {
+            return loadVariable(cast<VarRefNode>(node)->name);
+        }
+        case ASTNode::NK_IntLiteral:
+            return ConstantInt::get(Type::getInt32Ty(*context), cast<IntLiteral>(node)->value);
+        case ASTNode::NK_FloatLiteral:
+            return ConstantFP::get(Type::getFloatTy(*context), cast<FloatLiteral>(node)->value);
+        case ASTNode::NK_BoolLiteral:
+            return ConstantInt::getBool(*context, cast<BoolLiteral>(node)->value);
+        case ASTNode::NK_CharLiteral:
+            return ConstantInt::get(Type::getInt8Ty(*context), cast<CharLiteral>(node)->value, true);
+        case ASTNode::NK_StrLiteral:
+            return generateStringLiteral(cast<StrLiteral>(node)->value);
+        case ASTNode::NK_Concat: {
+            auto* concat = cast<ConcatNode>(node);
+            return generateStringConcat(generateValue(concat->left, nullptr), generateValue(concat->right, nullptr));
+        }
+        case ASTNode::NK_Pow:
+            return generatePow(cast<PowNode>(node));
+        case ASTNode::NK_Array:
+            return generateArray(cast<ArrayNode>(node), expectedType);
+        case ASTNode::NK_ArrayAccess:
+            return generateArrayAccess(cast<ArrayAccessNode>(node));
+        case ASTNode::NK_UnaryOp:
+            return generateUnaryOp(cast<UnaryOpNode>(node));
+        default:
+            throw std::runtime_error("Unsupported node type");
+    }
 }
 
 Value* CodeGen::generateBinaryOp(BinaryOpNode* node, Type* expectedType) {
-    Value* L = generateValue(node->left.get(), expectedType);
-    Value* R = generateValue(node->right.get(), expectedType);
+    if (isArrayOp(node)) {
+        return generateArrayOp(node);
+    }
+    if (node->op == BinaryOp::INDEX) {
+        return generateArraySearch(node);
+    }
+    switch (node->op) {
+        case BinaryOp::AND: case BinaryOp::OR:
+            return generateLogicalOp(node);
+        case BinaryOp::EQUAL: case BinaryOp::NOT_EQUAL:
+        case BinaryOp::LESS: case BinaryOp::LESS_EQUAL:
+        case BinaryOp::GREATER: case BinaryOp::GREATER_EQUAL:
+            return generateComparison(node);
+        default:
+            break;
+    }
+
+    Value* L = generateValue(node->left, expectedType);
+    Value* R = generateValue(node->right, expectedType);
     
+    // semantic analysis already typed the node: int op float is float
+    bool isFloat = node->getType() == VarType::FLOAT;
+    if (isFloat) {
+        L = promoteToFloat(L, node->left);
+        R = promoteToFloat(R, node->right);
+    }
+
     switch(node->op) {
         case BinaryOp::ADD:
-            if (L->getType()->isFloatTy() || R->getType()->isFloatTy()) {
+            if (isFloat) {
                 return builder->CreateFAdd(L, R);
             } else {
                 return builder->CreateAdd(L, R);
             }
         case BinaryOp::SUBTRACT:
-            if (L->getType()->isFloatTy() || R->getType()->isFloatTy()) {
+            if (isFloat) {
                 return builder->CreateFSub(L, R);
             } else {
                 return builder->CreateSub(L, R);
             }
         case BinaryOp::MULTIPLY:
-            if (L->getType()->isFloatTy() || R->getType()->isFloatTy()) {
+            if (isFloat) {
                 return builder->CreateFMul(L, R);
             } else {
                 return builder->CreateMul(L, R);
             }
         case BinaryOp::DIVIDE:
-            if (L->getType()->isFloatTy() || R->getType()->isFloatTy()) {
+            if (isFloat) {
                 return builder->CreateFDiv(L, R);
             } else {
                 return builder->CreateSDiv(L, R);
             }
-        case BinaryOp::INDEX:
-            return generateArrayIndex(L, R);
+        case BinaryOp::MOD:
+            if (isFloat) {
+                return builder->CreateFRem(L, R);
+            } else {
+                return builder->CreateSRem(L, R);
+            }
         case BinaryOp::CONCAT:
             return generateStringConcat(L, R);
         default:
@@ -164,30 +432,765 @@ Value* CodeGen::generateBinaryOp(BinaryOpNode* node, Type* expectedType) {
     }
 }
 
-Value* CodeGen::generateArrayIndex(Value* arrayPtr, Value* index) {
+// Ints and chars compare signed, bools unsigned so that false < true, and
+// an int against a float as floats. Strings compare by strcmp.
+Value* CodeGen::generateComparison(BinaryOpNode* node) {
+    Value* L = generateValue(node->left, nullptr);
+    Value* R = generateValue(node->right, nullptr);
+    VarType lt = node->left->getType();
+    VarType rt = node->right->getType();
+
+    if (lt == VarType::FLOAT || rt == VarType::FLOAT) {
+        L = promoteToFloat(L, node->left);
+        R = promoteToFloat(R, node->right);
+        CmpInst::Predicate pred;
+        switch (node->op) {
+            case BinaryOp::EQUAL: pred = CmpInst::FCMP_OEQ; break;
+            // NaN is unequal to everything
+            case BinaryOp::NOT_EQUAL: pred = CmpInst::FCMP_UNE; break;
+            case BinaryOp::LESS: pred = CmpInst::FCMP_OLT; break;
+            case BinaryOp::LESS_EQUAL: pred = CmpInst::FCMP_OLE; break;
+            case BinaryOp::GREATER: pred = CmpInst::FCMP_OGT; break;
+            default: pred = CmpInst::FCMP_OGE; break;
+        }
+        return builder->CreateFCmp(pred, L, R);
+    }
+
+    if (lt == VarType::STRING) {
+        Type* bytePtr = Type::getInt8PtrTy(*context);
+        FunctionCallee strcmpFunc = module->getOrInsertFunction(
+            "strcmp", FunctionType::get(Type::getInt32Ty(*context), {bytePtr, bytePtr}, false));
+        L = builder->CreateCall(strcmpFunc, {L, R});
+        R = ConstantInt::get(L->getType(), 0);
+    }
+    CmpInst::Predicate pred;
+    switch (node->op) {
+        case BinaryOp::EQUAL: pred = CmpInst::ICMP_EQ; break;
+        case BinaryOp::NOT_EQUAL: pred = CmpInst::ICMP_NE; break;
+        case BinaryOp::LESS: pred = CmpInst::ICMP_SLT; break;
+        case BinaryOp::LESS_EQUAL: pred = CmpInst::ICMP_SLE; break;
+        case BinaryOp::GREATER: pred = CmpInst::ICMP_SGT; break;
+        default: pred = CmpInst::ICMP_SGE; break;
+    }
+    if (lt == VarType::BOOL) {
+        pred = ICmpInst::getUnsignedPredicate(pred);
+    }
+    return builder->CreateICmp(pred, L, R);
+}
+
+// `and` and `or` only evaluate their right operand when the left one does
+// not decide the result
+Value* CodeGen::generateLogicalOp(BinaryOpNode* node) {
+    bool isAnd = node->op == BinaryOp::AND;
+    Function* func = builder->GetInsertBlock()->getParent();
+    BasicBlock* rightBB = BasicBlock::Create(*context, isAnd ? "and.rhs" : "or.rhs", func);
+    BasicBlock* endBB = BasicBlock::Create(*context, isAnd ? "and.end" : "or.end");
+
+    Value* L = generateValue(node->left, Type::getInt1Ty(*context));
+    BasicBlock* leftEnd = builder->GetInsertBlock();
+    if (isAnd) {
+        builder->CreateCondBr(L, rightBB, endBB);
+    } else {
+        builder->CreateCondBr(L, endBB, rightBB);
+    }
+    ssa.sealBlock(rightBB);
+
+    builder->SetInsertPoint(rightBB);
+    Value* R = generateValue(node->right, Type::getInt1Ty(*context));
+    BasicBlock* rightEnd = builder->GetInsertBlock();
+    builder->CreateBr(endBB);
+
+    func->getBasicBlockList().push_back(endBB);
+    builder->SetInsertPoint(endBB);
+    ssa.sealBlock(endBB);
+    PHINode* result = builder->CreatePHI(Type::getInt1Ty(*context), 2);
+    result->addIncoming(builder->getInt1(!isAnd), leftEnd);
+    result->addIncoming(R, rightEnd);
+    return result;
+}
+
+// float pow is the llvm.pow intrinsic; int pow calls mas_ipow, which
+// wraps the way the constant folder does
+Value* CodeGen::generatePow(PowNode* node) {
+    Value* base = generateValue(node->base, nullptr);
+    Value* exponent = generateValue(node->exponent, nullptr);
+    if (node->getType() == VarType::FLOAT) {
+        return builder->CreateBinaryIntrinsic(Intrinsic::pow, promoteToFloat(base, node->base),
+                                              promoteToFloat(exponent, node->exponent));
+    }
+    Type* intType = Type::getInt32Ty(*context);
+    FunctionCallee ipow = module->getOrInsertFunction(
+        "mas_ipow", FunctionType::get(intType, {intType, intType}, false));
+    if (auto* func = dyn_cast<Function>(ipow.getCallee())) {
+        func->setDoesNotThrow();
+        func->setDoesNotAccessMemory();
+    }
+    return builder->CreateCall(ipow, {builder->CreateSExt(base, intType), builder->CreateSExt(exponent, intType)});
+}
+
+Value* CodeGen::promoteToFloat(Value* val, ASTNode* operand) {
+    if (operand->getType() == VarType::INT) {
+        return builder->CreateSIToFP(val, Type::getFloatTy(*context));
+    }
+    return val;
+}
+
+// names whose compile-time length could go stale: a second declaration may
+// shadow or repeat the first with another length, and an assignment may
+// store an array of any length
+void CodeGen::findRedefinedArrays(ASTNode* node) {
+    DenseSet<uint32_t> declared;
+    SmallVector<ASTNode*, 16> worklist{node};
+    while (!worklist.empty()) {
+        ASTNode* next = worklist.pop_back_val();
+        if (auto* decl = dyn_cast<VarDeclNode>(next)) {
+            if (decl->type == VarType::ARRAY && !declared.insert(decl->name.getID()).second) {
+                redefinedArrays.insert(decl->name.getID());
+            }
+        } else if (auto* assign = dyn_cast<AssignNode>(next)) {
+            if (assign->getType() == VarType::ARRAY) {
+                redefinedArrays.insert(assign->target.getID());
+            }
+        }
+        getChildren(next, worklist);
+    }
+}
+
+// Array and string values that a variable may still hold when the site
+// that made them runs again, and every variable that may hold one. A site
+// outside any loop runs once. One in a loop runs again each iteration, when
+// the variables declared in that loop are out of scope, so its value only
+// escapes when it reaches, directly or through other variables, one
+// declared outside the loop. Only these sites and variables are counted;
+// every other site keeps reusing its storage, with no reference counting.
+void CodeGen::findEscapingValues(ASTNode* root) {
+    // each loop's enclosing loop, and the loops each variable is declared in
+    // (null at the top level)
+    DenseMap<ASTNode*, ASTNode*> outerLoop;
+    DenseMap<uint32_t, SmallVector<ASTNode*, 2>> declaredIn;
+    DenseMap<uint32_t, SmallVector<uint32_t, 2>> copiedTo;
+    struct Store {
+        ASTNode* value;
+        ASTNode* loop;
+        uint32_t target;
+    };
+    SmallVector<Store, 16> stores;
+    auto flow = [&](ASTNode* value, Identifier target, ASTNode* loop) {
+        if (auto* ref = dyn_cast<VarRefNode>(value)) {
+            copiedTo[ref->name.getID()].push_back(target.getID());
+        } else if (loop && !isConstantValue(value)) {
+            stores.push_back({value, loop, target.getID()});
+        }
+    };
+
+    SmallVector<std::pair<ASTNode*, ASTNode*>, 16> worklist{{root, nullptr}};
+    while (!worklist.empty()) {
+        auto [node, loop] = worklist.pop_back_val();
+        if (auto* decl = dyn_cast<VarDeclNode>(node)) {
+            if (holdsBuffer(decl->type)) {
+                declaredIn[decl->name.getID()].push_back(loop);
+                if (decl->value) {
+                    flow(decl->value, decl->name, loop);
+                }
+            }
+        } else if (auto* assign = dyn_cast<AssignNode>(node)) {
+            if (holdsBuffer(assign->getType())) {
+                flow(assign->value, assign->target, loop);
+            }
+        } else if (auto* forLoop = dyn_cast<ForLoopNode>(node)) {
+            outerLoop[node] = loop;
+            // the init runs once, before the loop
+            if (forLoop->init) {
+                worklist.push_back({forLoop->init, loop});
+            }
+            for (ASTNode* part : {forLoop->condition, forLoop->update, static_cast<ASTNode*>(forLoop->body)}) {
+                if (part) {
+                    worklist.push_back({part, node});
+                }
+            }
+            continue;
+        } else if (isa<WhileLoopNode>(node)) {
+            outerLoop[node] = loop;
+            loop = node;
+        }
+        SmallVector<ASTNode*, 4> children;
+        getChildren(node, children);
+        for (ASTNode* child : children) {
+            worklist.push_back({child, loop});
+        }
+    }
+
+    auto encloses = [&](ASTNode* loop, ASTNode* inner) {
+        for (; inner; inner = outerLoop.lookup(inner)) {
+            if (inner == loop) {
+                return true;
+            }
+        }
+        return false;
+    };
+    for (const Store& store : stores) {
+        SmallVector<uint32_t, 8> reached{store.target};
+        DenseSet<uint32_t> seen{store.target};
+        bool escapes = false;
+        for (size_t i = 0; i < reached.size(); ++i) {
+            for (ASTNode* scope : declaredIn.lookup(reached[i])) {
+                escapes |= !encloses(store.loop, scope);
+            }
+            for (uint32_t next : copiedTo.lookup(reached[i])) {
+                if (seen.insert(next).second) {
+                    reached.push_back(next);
+                }
+            }
+        }
+        if (escapes) {
+            escapingValues.insert(store.value);
+            countedNames.insert(reached.begin(), reached.end());
+        }
+    }
+}
+
+Optional<uint64_t> CodeGen::knownLength(Identifier array) const {
+    auto size = arraySizes.find(array.getID());
+    return size != arraySizes.end() ? Optional<uint64_t>(size->second) : None;
+}
+
+// length of an array literal, variable or array expression, if known here;
+// otherwise it is read from the array's header at run time
+Optional<uint64_t> CodeGen::knownArraySize(ASTNode* node) const {
+    if (auto* literal = dyn_cast<ArrayNode>(node)) {
+        if (!literal->count) {
+            return uint64_t(literal->elements.size());
+        }
+        auto* count = dyn_cast<IntLiteral>(literal->count);
+        return count && count->value >= 0 ? Optional<uint64_t>(count->value) : None;
+    }
+    if (auto* ref = dyn_cast<VarRefNode>(node)) {
+        return knownLength(ref->name);
+    }
+    if (auto* unary = dyn_cast<UnaryOpNode>(node)) {
+        return unary->op == UnaryOp::ABS ? knownArraySize(unary->operand) : None;
+    }
+    if (!isArrayOp(node)) {
+        return None;
+    }
+    auto* binary = cast<BinaryOpNode>(node);
+    Optional<uint64_t> size;
+    for (ASTNode* operand : {binary->left, binary->right}) {
+        if (operand->getType() != VarType::ARRAY) {
+            continue;
+        }
+        Optional<uint64_t> operandSize = knownArraySize(operand);
+        if (!operandSize) {
+            return None;
+        }
+        if (size && *size != *operandSize) {
+            throw std::runtime_error("Array operands differ in length");
+        }
+        size = operandSize;
+    }
+    return size;
+}
+
+Value* CodeGen::generateArrayOp(BinaryOpNode* node) {
+    Optional<uint64_t> size = knownArraySize(node);
+    Type* elemType = elementType(node->getElementType());
+    SmallVector<Value*, 4> leaves;
+    collectArrayLeaves(node, elemType, leaves);
+
+    // without a known length, every array operand has to match the first one
+    Value* length = nullptr;
+    if (size) {
+        length = ConstantInt::get(Type::getInt64Ty(*context), *size);
+    } else {
+        for (Value* leaf : leaves) {
+            if (!leaf->getType()->isPointerTy()) {
+                continue;
+            }
+            Value* leafLength = loadArrayLength(leaf);
+            if (length) {
+                generateErrorCheck(builder->CreateICmpEQ(leafLength, length), "Array operands differ in length");
+            } else {
+                length = leafLength;
+            }
+        }
+    }
+    // a fresh array, so it never aliases an operand
+    Value* dst = allocateArray(node, length, size, node->getElementType());
+    if (size && *size == 0) {
+        return dst;
+    }
+
+    if (size && *size <= MaxInlineLanes) {
+        auto* laneType = FixedVectorType::get(elemType, *size);
+        unsigned next = 0;
+        Value* lanes = combineLanes(node, leaves, next, laneType, nullptr);
+        storeLanes(lanes, dst, nullptr);
+    } else if (elemType->isIntegerTy() && !isArrayOp(node->left) && !isArrayOp(node->right)) {
+        // the kernels are for ints; float arrays take the strip loop
+        // kernel op codes follow the ARRAY_ order: add, subtract, multiply, divide
+        Value* op = ConstantInt::get(Type::getInt32Ty(*context),
+                                     static_cast<int>(node->op) - static_cast<int>(BinaryOp::ARRAY_ADD));
+        Value* lhs = leaves[0];
+        Value* rhs = leaves[1];
+        if (lhs->getType()->isPointerTy() && rhs->getType()->isPointerTy()) {
+            builder->CreateCall(getArrayRuntime("mas_array_op"), {op, dst, lhs, rhs, length});
+        } else {
+            bool scalarFirst = !lhs->getType()->isPointerTy();
+            Value* array = scalarFirst ? rhs : lhs;
+            Value* scalar = scalarFirst ? lhs : rhs;
+            Value* order = ConstantInt::get(Type::getInt32Ty(*context), scalarFirst);
+            builder->CreateCall(getArrayRuntime("mas_array_scalar_op"), {op, dst, array, scalar, order, length});
+        }
+    } else {
+        generateArrayLoop(elemType, dst, length, [&](FixedVectorType* laneType, Value* offset) {
+            unsigned next = 0;
+            return combineLanes(node, leaves, next, laneType, offset);
+        });
+    }
+    return dst;
+}
+
+// the operands of an ARRAY_ op tree, left to right: arrays as pointers to
+// their first element, scalars converted to the element type
+void CodeGen::collectArrayLeaves(ASTNode* node, Type* elemType, SmallVectorImpl<Value*>& leaves) {
+    if (isArrayOp(node)) {
+        auto* binary = cast<BinaryOpNode>(node);
+        collectArrayLeaves(binary->left, elemType, leaves);
+        collectArrayLeaves(binary->right, elemType, leaves);
+        return;
+    }
+    if (node->getType() == VarType::ARRAY) {
+        leaves.push_back(generateValue(node, elemType->getPointerTo()));
+        return;
+    }
+    Value* scalar = generateValue(node, elemType);
+    if (scalar->getType()->isFloatTy() && elemType->isIntegerTy()) {
+        scalar = builder->CreateFPToSI(scalar, elemType);
+    } else if (scalar->getType()->isIntegerTy() && elemType->isFloatTy()) {
+        scalar = builder->CreateSIToFP(scalar, elemType);
+    }
+    leaves.push_back(scalar);
+}
+
+// the lanes of `node` starting at element `offset`, or at 0 when it is null
+Value* CodeGen::combineLanes(ASTNode* node, ArrayRef<Value*> leaves, unsigned& next,
+                             FixedVectorType* laneType, Value* offset) {
+    if (isArrayOp(node)) {
+        auto* binary = cast<BinaryOpNode>(node);
+        Value* L = combineLanes(binary->left, leaves, next, laneType, offset);
+        Value* R = combineLanes(binary->right, leaves, next, laneType, offset);
+        bool isFloat = laneType->getElementType()->isFloatTy();
+        switch (binary->op) {
+            case BinaryOp::ARRAY_ADD:
+                return isFloat ? builder->CreateFAdd(L, R) : builder->CreateAdd(L, R);
+            case BinaryOp::ARRAY_SUBTRACT:
+                return isFloat ? builder->CreateFSub(L, R) : builder->CreateSub(L, R);
+            case BinaryOp::ARRAY_MULTIPLY:
+                return isFloat ? builder->CreateFMul(L, R) : builder->CreateMul(L, R);
+            default:
+                return isFloat ? builder->CreateFDiv(L, R) : builder->CreateSDiv(L, R);
+        }
+    }
+    Value* leaf = leaves[next++];
+    if (!leaf->getType()->isPointerTy()) {
+        return builder->CreateVectorSplat(laneType->getNumElements(), leaf);
+    }
+    return loadLanes(leaf, laneType, offset);
+}
+
+// elements of `array` from `offset` on, or from 0 when it is null, as one vector
+Value* CodeGen::loadLanes(Value* array, FixedVectorType* laneType, Value* offset) {
+    Value* elemPtr = offset ? builder->CreateInBoundsGEP(laneType->getElementType(), array, offset) : array;
+    Align align(laneType->getScalarSizeInBits() / 8);
+    return builder->CreateAlignedLoad(laneType, builder->CreateBitCast(elemPtr, laneType->getPointerTo()), align);
+}
+
+void CodeGen::storeLanes(Value* lanes, Value* array, Value* offset) {
+    auto* laneType = cast<FixedVectorType>(lanes->getType());
+    Value* elemPtr = offset ? builder->CreateInBoundsGEP(laneType->getElementType(), array, offset) : array;
+    Align align(laneType->getScalarSizeInBits() / 8);
+    builder->CreateAlignedStore(lanes, builder->CreateBitCast(elemPtr, laneType->getPointerTo()), align);
+}
+
+// Fills dst[0, length) with the lanes `lanesAt` gives for each offset:
+// whole strips while they fit, then the remaining elements one at a time
+void CodeGen::generateArrayLoop(Type* elemType, Value* dst, Value* length,
+                                function_ref<Value*(FixedVectorType*, Value*)> lanesAt) {
+    Type* indexType = Type::getInt64Ty(*context);
+    Function* func = builder->GetInsertBlock()->getParent();
+    BasicBlock* preheader = builder->GetInsertBlock();
+    BasicBlock* stripCond = BasicBlock::Create(*context, "array.strip.cond", func);
+    BasicBlock* stripBody = BasicBlock::Create(*context, "array.strip", func);
+    BasicBlock* tailCond = BasicBlock::Create(*context, "array.tail.cond", func);
+    BasicBlock* tailBody = BasicBlock::Create(*context, "array.tail", func);
+    BasicBlock* doneBB = BasicBlock::Create(*context, "array.done", func);
+    builder->CreateBr(stripCond);
+
+    builder->SetInsertPoint(stripCond);
+    PHINode* index = builder->CreatePHI(indexType, 2, "array.i");
+    index->addIncoming(ConstantInt::get(indexType, 0), preheader);
+    Value* stripEnd = builder->CreateNUWAdd(index, ConstantInt::get(indexType, ArrayStrip));
+    builder->CreateCondBr(builder->CreateICmpULE(stripEnd, length), stripBody, tailCond);
+    ssa.sealBlock(stripBody);
+
+    builder->SetInsertPoint(stripBody);
+    storeLanes(lanesAt(FixedVectorType::get(elemType, ArrayStrip), index), dst, index);
+    index->addIncoming(stripEnd, stripBody);
+    builder->CreateBr(stripCond);
+    ssa.sealBlock(stripCond);
+
+    builder->SetInsertPoint(tailCond);
+    PHINode* tailIndex = builder->CreatePHI(indexType, 2, "array.j");
+    tailIndex->addIncoming(index, stripCond);
+    builder->CreateCondBr(builder->CreateICmpULT(tailIndex, length), tailBody, doneBB);
+    ssa.sealBlock(tailBody);
+    ssa.sealBlock(doneBB);
+
+    builder->SetInsertPoint(tailBody);
+    storeLanes(lanesAt(FixedVectorType::get(elemType, 1), tailIndex), dst, tailIndex);
+    tailIndex->addIncoming(builder->CreateNUWAdd(tailIndex, ConstantInt::get(indexType, 1)), tailBody);
+    builder->CreateBr(tailCond);
+    ssa.sealBlock(tailCond);
+
+    builder->SetInsertPoint(doneBB);
+}
+
+// length, min, max, sum and abs of an array
+Value* CodeGen::generateArrayBuiltin(UnaryOpNode* node) {
+    Optional<uint64_t> size = knownArraySize(node->operand);
+    VarType element = node->operand->getElementType();
+    Type* elemType = elementType(element);
+    if (node->op == UnaryOp::LENGTH && size) {
+        return ConstantInt::get(Type::getInt32Ty(*context), *size);
+    }
+    Value* array = generateValue(node->operand, arrayType(element));
+    Value* length = size ? ConstantInt::get(Type::getInt64Ty(*context), *size) : loadArrayLength(array);
+    bool inline_ = size && *size <= MaxInlineLanes;
+    bool isFloat = element == VarType::FLOAT;
+
+    switch (node->op) {
+        case UnaryOp::LENGTH:
+            return builder->CreateTrunc(length, Type::getInt32Ty(*context));
+        case UnaryOp::ABS: {
+            Value* dst = allocateArray(node, length, size, element);
+            if (!inline_) {
+                builder->CreateCall(getArrayRuntime(isFloat ? "mas_farray_abs" : "mas_array_abs"), {dst, array, length});
+            } else if (*size > 0) {
+                Value* lanes = loadLanes(array, FixedVectorType::get(elemType, *size), nullptr);
+                storeLanes(isFloat ? builder->CreateUnaryIntrinsic(Intrinsic::fabs, lanes)
+                                   : builder->CreateBinaryIntrinsic(Intrinsic::abs, lanes, builder->getFalse()),
+                           dst, nullptr);
+            }
+            return dst;
+        }
+        default:
+            break;
+    }
+
+    if (element == VarType::BOOL) {
+        // sum of a bool array: the number of true elements
+        if (!inline_) {
+            return builder->CreateCall(getArrayRuntime("mas_barray_count"), {array, length});
+        }
+        if (*size == 0) {
+            return ConstantInt::get(Type::getInt32Ty(*context), 0);
+        }
+        Value* count = builder->CreateUnaryIntrinsic(Intrinsic::ctpop, loadBits(array, *size));
+        return builder->CreateZExtOrTrunc(count, Type::getInt32Ty(*context));
+    }
+    if (!inline_) {
+        const char* prefix = isFloat ? "mas_farray_" : element == VarType::CHAR ? "mas_carray_" : "mas_array_";
+        const char* op = node->op == UnaryOp::MIN ? "min" : node->op == UnaryOp::MAX ? "max" : "sum";
+        return builder->CreateCall(getArrayRuntime((Twine(prefix) + op).str()), {array, length});
+    }
+    // an empty array gives the identity of the reduction: the largest value
+    // for min, the smallest for max, 0 for sum
+    if (*size == 0) {
+        bool negative = node->op == UnaryOp::MAX;
+        switch (node->op) {
+            case UnaryOp::MIN: case UnaryOp::MAX:
+                if (isFloat) {
+                    return ConstantFP::getInfinity(elemType, negative);
+                }
+                return ConstantInt::get(elemType, negative ? APInt::getSignedMinValue(elemType->getIntegerBitWidth())
+                                                           : APInt::getSignedMaxValue(elemType->getIntegerBitWidth()));
+            default:
+                return Constant::getNullValue(elemType);
+        }
+    }
+    Value* lanes = loadLanes(array, FixedVectorType::get(elemType, *size), nullptr);
+    switch (node->op) {
+        case UnaryOp::MIN:
+            return isFloat ? builder->CreateFPMinReduce(lanes) : builder->CreateIntMinReduce(lanes, true);
+        case UnaryOp::MAX:
+            return isFloat ? builder->CreateFPMaxReduce(lanes) : builder->CreateIntMaxReduce(lanes, true);
+        default:
+            // in order, so the result matches the runtime's loop
+            return isFloat ? builder->CreateFAddReduce(ConstantFP::get(elemType, 0.0), lanes)
+                           : builder->CreateAddReduce(lanes);
+    }
+}
+
+// index(arr, value): the position of the first element equal to value, or -1
+Value* CodeGen::generateArraySearch(BinaryOpNode* node) {
+    Optional<uint64_t> size = knownArraySize(node->left);
+    VarType element = node->left->getElementType();
+    Type* elemType = elementType(element);
+    Value* array = generateValue(node->left, arrayType(element));
+    Value* value = generateValue(node->right, elemType);
+    if (element == VarType::FLOAT) {
+        value = promoteToFloat(value, node->right);
+    }
+    Type* intType = Type::getInt32Ty(*context);
+    Value* notFound = ConstantInt::get(intType, -1, true);
+
+    if (!size || *size > MaxInlineLanes) {
+        Value* length = size ? ConstantInt::get(Type::getInt64Ty(*context), *size) : loadArrayLength(array);
+        switch (element) {
+            case VarType::FLOAT:
+                return builder->CreateCall(getArrayRuntime("mas_farray_index"), {array, value, length});
+            case VarType::CHAR:
+                return builder->CreateCall(getArrayRuntime("mas_carray_index"),
+                                           {array, builder->CreateSExt(value, intType), length});
+            case VarType::BOOL:
+                return builder->CreateCall(getArrayRuntime("mas_barray_index"),
+                                           {array, builder->CreateZExt(value, intType), length});
+            default:
+                return builder->CreateCall(getArrayRuntime("mas_array_index"), {array, value, length});
+        }
+    }
+    if (*size == 0) {
+        return notFound;
+    }
+    // bit i of the mask is set when element i matches, so the first match is
+    // its lowest set bit
+    Value* mask;
+    if (element == VarType::BOOL) {
+        Value* bits = loadBits(array, *size);
+        mask = builder->CreateSelect(value, bits, builder->CreateNot(bits));
+    } else {
+        Value* lanes = loadLanes(array, FixedVectorType::get(elemType, *size), nullptr);
+        Value* splat = builder->CreateVectorSplat(*size, value);
+        Value* matches = element == VarType::FLOAT ? builder->CreateFCmpOEQ(lanes, splat)
+                                                   : builder->CreateICmpEQ(lanes, splat);
+        mask = builder->CreateBitCast(matches, builder->getIntNTy(*size));
+    }
+    Value* first = builder->CreateBinaryIntrinsic(Intrinsic::cttz, mask, builder->getFalse());
+    return builder->CreateSelect(builder->CreateIsNull(mask), notFound, builder->CreateZExtOrTrunc(first, intType));
+}
+
+// the first `count` bits of a bool array as an i<count>; bit i is element i
+Value* CodeGen::loadBits(Value* array, uint64_t count) {
+    // whole bytes, since the padding bits past `count` were never stored as such
+    Type* wordType = builder->getIntNTy(alignTo(count, 8));
+    Value* word = builder->CreateAlignedLoad(wordType, builder->CreateBitCast(array, wordType->getPointerTo()), Align(1));
+    return builder->CreateTrunc(word, builder->getIntNTy(count));
+}
+
+// in-register type of an array element; a bool is stored as a single bit
+Type* CodeGen::elementType(VarType element) {
+    switch (element) {
+        case VarType::FLOAT:
+            return Type::getFloatTy(*context);
+        case VarType::CHAR:
+            return Type::getInt8Ty(*context);
+        case VarType::BOOL:
+            return Type::getInt1Ty(*context);
+        default:
+            return Type::getInt32Ty(*context);
+    }
+}
+
+// an array value: a pointer to its first element, or to the byte holding
+// the first bits of a bool array
+PointerType* CodeGen::arrayType(VarType element) {
+    return storageType(element)->getPointerTo();
+}
+
+// Storage for `length` elements with its header filled in. A known small
+// size gets a slot in main's frame, unless the value escapes its site; any
+// other size a buffer from the runtime.
+Value* CodeGen::allocateArray(ASTNode* site, Value* length, Optional<uint64_t> knownLength, VarType element) {
+    if (knownLength && !escapingValues.count(site)) {
+        uint64_t units = storageUnits(*knownLength, element);
+        Type* storage = storageType(element);
+        if (units * storage->getPrimitiveSizeInBits() / 8 <= StackArrayBytes) {
+            StructType* frame = arrayFrame(element, units);
+            AllocaInst* slot = allocaBuilder->CreateAlloca(frame);
+            slot->setAlignment(Align(ArrayAlign));
+            // the header is written once, in the entry block
+            Type* i64 = Type::getInt64Ty(*context);
+            Value* known = ConstantInt::get(i64, *knownLength);
+            allocaBuilder->CreateStore(ConstantInt::get(i64, StaticRefs, true), allocaBuilder->CreateStructGEP(frame, slot, 1));
+            allocaBuilder->CreateStore(known, allocaBuilder->CreateStructGEP(frame, slot, 2));
+            allocaBuilder->CreateStore(arrayBytes(known, element), allocaBuilder->CreateStructGEP(frame, slot, 3));
+            return allocaBuilder->CreateBitCast(allocaBuilder->CreateStructGEP(frame, slot, 4), arrayType(element));
+        }
+    }
+    return builder->CreateBitCast(allocateSiteBuffer(length, arrayBytes(length, element)), arrayType(element));
+}
+
+// A buffer from the runtime for this allocation site, which holds a
+// reference to the last one it got. The runtime refills that buffer when no
+// variable holds it any more and it has room; otherwise the old contents
+// stay with whoever holds them and the site moves to a new buffer.
+Value* CodeGen::allocateSiteBuffer(Value* length, Value* bytes) {
+    Type* bufferType = Type::getInt8PtrTy(*context);
+    auto* site = new GlobalVariable(*module, bufferType, false, GlobalValue::InternalLinkage,
+                                    ConstantPointerNull::get(cast<PointerType>(bufferType)), "array.site");
+    Value* buffer = builder->CreateCall(getArrayRuntime("mas_array_alloc"),
+                                        {builder->CreateLoad(bufferType, site), length, bytes});
+    builder->CreateStore(buffer, site);
+    return buffer;
+}
+
+// An array literal of constants: a private constant laid out like a stack
+// slot, header included. Arrays are never written in place, so it is used
+// directly and creating the array costs nothing.
+Value* CodeGen::getConstantArray(ArrayRef<Constant*> units, uint64_t length, VarType element) {
+    Type* i64 = Type::getInt64Ty(*context);
+    StructType* frame = arrayFrame(element, units.size());
+    Constant* init = ConstantStruct::get(frame, {
+        Constant::getNullValue(frame->getElementType(0)),
+        ConstantInt::get(i64, StaticRefs, true),
+        ConstantInt::get(i64, length),
+        ConstantInt::get(i64, units.size() * storageType(element)->getPrimitiveSizeInBits() / 8),
+        ConstantArray::get(cast<ArrayType>(frame->getElementType(4)), units)});
+    auto* global = new GlobalVariable(*module, frame, true, GlobalValue::PrivateLinkage, init, "array.const");
+    global->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+    global->setAlignment(Align(ArrayAlign));
+    Type* i32 = Type::getInt32Ty(*context);
+    Constant* first[] = {ConstantInt::get(i32, 0), ConstantInt::get(i32, 4), ConstantInt::get(i32, 0)};
+    return ConstantExpr::getInBoundsGetElementPtr(frame, global, first);
+}
+
+// padding, reference count, length, capacity, then `units` storage units:
+// the header ends on the alignment boundary
+StructType* CodeGen::arrayFrame(VarType element, uint64_t units) {
+    Type* i64 = Type::getInt64Ty(*context);
+    return StructType::get(*context, {ArrayType::get(Type::getInt8Ty(*context), ArrayAlign - 24),
+                                      i64, i64, i64, ArrayType::get(storageType(element), units)});
+}
+
+// what an array stores its elements in: the element type, or bytes of bits for bools
+Type* CodeGen::storageType(VarType element) {
+    return element == VarType::BOOL ? Type::getInt8Ty(*context) : elementType(element);
+}
+
+uint64_t CodeGen::storageUnits(uint64_t length, VarType element) {
+    return element == VarType::BOOL ? alignTo(length, 8) / 8 : length;
+}
+
+// the size of `length` elements in bytes, as an int64
+Value* CodeGen::arrayBytes(Value* length, VarType element) {
+    Type* i64 = Type::getInt64Ty(*context);
+    if (element == VarType::BOOL) {
+        return builder->CreateLShr(builder->CreateAdd(length, ConstantInt::get(i64, 7)), 3);
+    }
+    return builder->CreateMul(length, ConstantInt::get(i64, storageType(element)->getPrimitiveSizeInBits() / 8));
+}
+
+// the length field of an array's header, as an int64
+Value* CodeGen::loadArrayLength(Value* array) {
+    Type* i64 = Type::getInt64Ty(*context);
+    Value* header = builder->CreateBitCast(array, i64->getPointerTo());
+    Value* lengthPtr = builder->CreateInBoundsGEP(i64, header, ConstantInt::get(i64, -2, true));
+    return builder->CreateAlignedLoad(i64, lengthPtr, Align(8), "array.length");
+}
+
+// A routine of rtArray.c, declared on first use with the signature runtime.h
+// gives it. The prefix names the element type: mas_array_ for ints,
+// mas_farray_ for floats, mas_carray_ for chars and mas_barray_ for bools.
+// None of them unwinds, and the reductions and searches only read memory.
+Function* CodeGen::getArrayRuntime(StringRef name) {
+    if (Function* existing = module->getFunction(name)) {
+        return existing;
+    }
+    Type* intType = Type::getInt32Ty(*context);
+    Type* countType = Type::getInt64Ty(*context);
+    Type* voidType = Type::getVoidTy(*context);
+    Type* bytePtr = Type::getInt8PtrTy(*context);
+    Type* elemType = name.startswith("mas_farray_") ? Type::getFloatTy(*context)
+                   : name.startswith("mas_carray_") || name.startswith("mas_barray_") ? Type::getInt8Ty(*context)
+                   : intType;
+    Type* ptrType = elemType->getPointerTo();
+    FunctionType* type;
+    bool readOnly = false;
+    if (name == "mas_array_alloc") {
+        type = FunctionType::get(bytePtr, {bytePtr, countType, countType}, false);
+    } else if (name == "mas_array_retain" || name == "mas_array_release") {
+        type = FunctionType::get(voidType, {bytePtr}, false);
+    } else if (name == "mas_array_print") {
+        type = FunctionType::get(voidType, {bytePtr, intType}, false);
+    } else if (name == "mas_array_op") {
+        type = FunctionType::get(voidType, {intType, ptrType, ptrType, ptrType, countType}, false);
+    } else if (name == "mas_array_scalar_op") {
+        type = FunctionType::get(voidType, {intType, ptrType, ptrType, intType, intType, countType}, false);
+    } else if (name.endswith("_abs")) {
+        type = FunctionType::get(voidType, {ptrType, ptrType, countType}, false);
+    } else if (name.endswith("_index")) {
+        // chars and bools are searched for as an int
+        Type* valueType = elemType->isFloatTy() ? elemType : intType;
+        type = FunctionType::get(intType, {ptrType, valueType, countType}, false);
+        readOnly = true;
+    } else if (name == "mas_barray_count") {
+        type = FunctionType::get(intType, {ptrType, countType}, false);
+        readOnly = true;
+    } else {
+        // min, max and sum return an element
+        type = FunctionType::get(elemType, {ptrType, countType}, false);
+        readOnly = true;
+    }
+    Function* func = Function::Create(type, Function::ExternalLinkage, name, module.get());
+    func->setDoesNotThrow();
+    if (readOnly) {
+        func->setOnlyReadsMemory();
+    }
+    if (name == "mas_array_alloc") {
+        func->addRetAttr(Attribute::getWithAlignment(*context, Align(ArrayAlign)));
+    }
+    return func;
+}
+
+Value* CodeGen::generateArrayIndex(Value* arrayPtr, Value* index, VarType element) {
+    if (element == VarType::BOOL) {
+        // bit index % 8 of byte index / 8
+        Value* byte = builder->CreateLoad(Type::getInt8Ty(*context),
+                                          builder->CreateGEP(Type::getInt8Ty(*context), arrayPtr, builder->CreateLShr(index, 3)));
+        Value* shift = builder->CreateTrunc(builder->CreateAnd(index, 7), byte->getType());
+        return builder->CreateTrunc(builder->CreateLShr(byte, shift), Type::getInt1Ty(*context));
+    }
+    Type* elemType = elementType(element);
     Value* gep = builder->CreateGEP(
-        Type::getInt32Ty(*context), 
+        elemType, 
         arrayPtr, 
         {index}
     );
-    return builder->CreateLoad(Type::getInt32Ty(*context), gep);
+    return builder->CreateLoad(elemType, gep);
 }
 
+// a string literal: a constant char array holding the chars and a NUL
+Value* CodeGen::generateStringLiteral(StringRef text) {
+    SmallVector<Constant*, 16> chars;
+    for (char c : text) {
+        chars.push_back(ConstantInt::get(Type::getInt8Ty(*context), c, true));
+    }
+    chars.push_back(ConstantInt::get(Type::getInt8Ty(*context), 0));
+    return getConstantArray(chars, text.size(), VarType::CHAR);
+}
+
+// the two strings' chars in a buffer of this site, with their lengths read
+// from the headers
 Value* CodeGen::generateStringConcat(Value* L, Value* R) {
-    Function* strlenFunc = module->getFunction("strlen");
-    Function* mallocFunc = module->getFunction("malloc");
-    Function* memcpyFunc = module->getFunction("memcpy");
-    
-    Value* lenL = builder->CreateCall(strlenFunc, {L});
-    Value* lenR = builder->CreateCall(strlenFunc, {R});
-    Value* totalLen = builder->CreateAdd(lenL, lenR);
-    totalLen = builder->CreateAdd(totalLen, ConstantInt::get(Type::getInt32Ty(*context), 1));
-    
-    Value* buffer = builder->CreateCall(mallocFunc, {totalLen});
-    builder->CreateCall(memcpyFunc, {buffer, L, lenL});
-    Value* dest = builder->CreateGEP(Type::getInt8Ty(*context), buffer, lenL);
-    builder->CreateCall(memcpyFunc, {dest, R, lenR});
-    
+    Type* i64 = Type::getInt64Ty(*context);
+    Value* lenL = loadArrayLength(L);
+    Value* lenR = loadArrayLength(R);
+    Value* length = builder->CreateAdd(lenL, lenR);
+    Value* buffer = allocateSiteBuffer(length, builder->CreateAdd(length, ConstantInt::get(i64, 1)));
+    builder->CreateMemCpy(buffer, MaybeAlign(ArrayAlign), L, MaybeAlign(1), lenL);
+    // R's NUL ends the result
+    Value* dest = builder->CreateInBoundsGEP(Type::getInt8Ty(*context), buffer, lenL);
+    builder->CreateMemCpy(dest, MaybeAlign(1), R, MaybeAlign(1), builder->CreateAdd(lenR, ConstantInt::get(i64, 1)));
     return buffer;
 }
 
@@ -197,58 +1200,208 @@ void CodeGen::generateIfElse(IfElseNode* node) {
     BasicBlock* elseBB = BasicBlock::Create(*context, "else");
     BasicBlock* mergeBB = BasicBlock::Create(*context, "ifcont");
     
-    Value* cond = generateValue(node->condition.get(), Type::getInt1Ty(*context));
+    Value* cond = generateValue(node->condition, Type::getInt1Ty(*context));
     builder->CreateCondBr(cond, thenBB, elseBB);
+    ssa.sealBlock(thenBB);
+    ssa.sealBlock(elseBB);
     
     builder->SetInsertPoint(thenBB);
-    generateStatement(node->thenBlock.get());
+    generateStatement(node->thenBlock);
     builder->CreateBr(mergeBB);
     
     func->getBasicBlockList().push_back(elseBB);
     builder->SetInsertPoint(elseBB);
     if (node->elseBlock) {
-        generateStatement(node->elseBlock.get());
+        generateStatement(node->elseBlock);
     }
     builder->CreateBr(mergeBB);
     
     func->getBasicBlockList().push_back(mergeBB);
     builder->SetInsertPoint(mergeBB);
+    ssa.sealBlock(mergeBB);
 }
 
 void CodeGen::generateForLoop(ForLoopNode* node) {
+    pushScope();
+    if (node->init) generateStatement(node->init);
+    generateLoopVersions(node, [&] { generateForLoopBlocks(node); });
+    // the loop variables stay live across iterations, so they end on exit
+    popScope();
+}
+
+void CodeGen::generateForLoopBlocks(ForLoopNode* node) {
     Function* func = builder->GetInsertBlock()->getParent();
     BasicBlock* loopStart = BasicBlock::Create(*context, "loop.start", func);
     BasicBlock* loopBody = BasicBlock::Create(*context, "loop.body");
     BasicBlock* loopEnd = BasicBlock::Create(*context, "loop.end");
     
-    if (node->init) generateStatement(node->init.get());
     builder->CreateBr(loopStart);
     
     builder->SetInsertPoint(loopStart);
     Value* cond = node->condition ? 
-        generateValue(node->condition.get(), Type::getInt1Ty(*context)) : 
+        generateValue(node->condition, Type::getInt1Ty(*context)) : 
         ConstantInt::getTrue(*context);
     builder->CreateCondBr(cond, loopBody, loopEnd);
     
     func->getBasicBlockList().push_back(loopBody);
     builder->SetInsertPoint(loopBody);
-    generateStatement(node->body.get());
-    if (node->update) generateStatement(node->update.get());
+    ssa.sealBlock(loopBody);
+    generateStatement(node->body);
+    if (node->update) generateStatement(node->update);
     builder->CreateBr(loopStart);
+    // the back edge is in place, so the header's phis can be completed
+    ssa.sealBlock(loopStart);
     
     func->getBasicBlockList().push_back(loopEnd);
     builder->SetInsertPoint(loopEnd);
+    ssa.sealBlock(loopEnd);
+}
+
+// Hoisted bounds checks. Accesses that a literal start and bound keep in
+// range are never checked. The others indexed by the induction variable are
+// tested once against the whole iteration range, and the loop is generated
+// twice: unchecked for when the test passes, checked for when it fails, so
+// a bad index still traps in the iteration that uses it.
+void CodeGen::generateLoopVersions(ASTNode* loop, function_ref<void()> generateLoop) {
+    Optional<LoopRange> range;
+    if (options.boundsChecks == BoundsChecks::Hoisted) range = analyzeLoopRange(loop);
+
+    SmallVector<ArrayAccessNode*, 4> proven;
+    SmallVector<InductionAccess, 4> hoisted;
+    if (range) {
+        for (const InductionAccess& entry : range->accesses) {
+            Optional<uint64_t> size = knownLength(entry.access->arrayName);
+            if (size && provenInBounds(*range, entry, *size)) proven.push_back(entry.access);
+            else hoisted.push_back(entry);
+        }
+    }
+    for (auto* access : proven) uncheckedAccesses.insert(access);
+
+    // at most two copies of a loop nest: versions are not nested
+    if (hoisted.empty() || versionedLoop) {
+        generateLoop();
+    } else {
+        Function* func = builder->GetInsertBlock()->getParent();
+        BasicBlock* fastBB = BasicBlock::Create(*context, "bounds.fast", func);
+        BasicBlock* slowBB = BasicBlock::Create(*context, "bounds.slow");
+        BasicBlock* joinBB = BasicBlock::Create(*context, "bounds.join");
+
+        Value* inRange = generateRangeCheck(*range, hoisted);
+        builder->CreateCondBr(inRange, fastBB, slowBB, MDBuilder(*context).createBranchWeights(LikelyWeight, 1));
+        ssa.sealBlock(fastBB);
+        ssa.sealBlock(slowBB);
+
+        versionedLoop = true;
+        builder->SetInsertPoint(fastBB);
+        for (const InductionAccess& entry : hoisted) uncheckedAccesses.insert(entry.access);
+        generateLoop();
+        for (const InductionAccess& entry : hoisted) uncheckedAccesses.erase(entry.access);
+        builder->CreateBr(joinBB);
+
+        func->getBasicBlockList().push_back(slowBB);
+        builder->SetInsertPoint(slowBB);
+        generateLoop();
+        builder->CreateBr(joinBB);
+        versionedLoop = false;
+
+        func->getBasicBlockList().push_back(joinBB);
+        builder->SetInsertPoint(joinBB);
+        ssa.sealBlock(joinBB);
+    }
+
+    for (auto* access : proven) uncheckedAccesses.erase(access);
+}
+
+// true when the loop does not run, or every access stays in bounds on every
+// iteration it does run; computed in 64 bits so the test itself cannot wrap
+Value* CodeGen::generateRangeCheck(const LoopRange& range, ArrayRef<InductionAccess> accesses) {
+    const CountedLoop& loop = range.loop;
+    Type* i64 = Type::getInt64Ty(*context);
+    auto constant = [&](int64_t value) { return ConstantInt::get(i64, value, true); };
+
+    Value* start = builder->CreateSExt(loadVariable(loop.iv), i64);
+    Value* bound = builder->CreateSExt(generateValue(loop.bound, Type::getInt32Ty(*context)), i64);
+    Value *runs, *lo, *hi;
+    switch (loop.cmp) {
+        case BinaryOp::LESS:
+            runs = builder->CreateICmpSLT(start, bound);
+            lo = start;
+            hi = builder->CreateSub(bound, constant(1));
+            break;
+        case BinaryOp::LESS_EQUAL:
+            runs = builder->CreateICmpSLE(start, bound);
+            lo = start;
+            hi = bound;
+            break;
+        case BinaryOp::GREATER:
+            runs = builder->CreateICmpSGT(start, bound);
+            lo = builder->CreateAdd(bound, constant(1));
+            hi = start;
+            break;
+        case BinaryOp::GREATER_EQUAL:
+            runs = builder->CreateICmpSGE(start, bound);
+            lo = bound;
+            hi = start;
+            break;
+        default:
+            llvm_unreachable("loop ranges only use ordered comparisons");
+    }
+
+    // the induction variable must not wrap on its way to the bound
+    Value* ok = loop.step > 0
+        ? builder->CreateICmpSLE(builder->CreateAdd(hi, constant(loop.step)), constant(INT32_MAX))
+        : builder->CreateICmpSGE(builder->CreateAdd(lo, constant(loop.step)), constant(INT32_MIN));
+    for (const InductionAccess& entry : accesses) {
+        // the loop does not reassign the array, so its length holds throughout
+        Optional<uint64_t> size = knownLength(entry.access->arrayName);
+        Value* length = size ? constant(*size) : loadArrayLength(loadVariable(entry.access->arrayName));
+        Value* first = builder->CreateAdd(lo, constant(entry.offset));
+        Value* last = builder->CreateAdd(hi, constant(entry.offset));
+        ok = builder->CreateAnd(ok, builder->CreateICmpSGE(first, constant(0)));
+        ok = builder->CreateAnd(ok, builder->CreateICmpSLT(last, length));
+    }
+    return builder->CreateOr(builder->CreateNot(runs), ok);
+}
+
+void CodeGen::generateBlock(BlockNode* node) {
+    pushScope();
+    for (auto* stmt : node->statements) {
+        generateStatement(stmt);
+    }
+    popScope();
 }
 
 void CodeGen::generatePrint(PrintNode* node) {
-    Value* value = generateValue(node->expr.get(), nullptr);
+    Value* value = generateValue(node->expr, nullptr);
+    if (node->expr->getType() == VarType::ARRAY) {
+        ArrayKind kind;
+        switch (node->expr->getElementType()) {
+            case VarType::FLOAT: kind = KindFloat; break;
+            case VarType::CHAR: kind = KindChar; break;
+            case VarType::BOOL: kind = KindBool; break;
+            default: kind = KindInt; break;
+        }
+        builder->CreateCall(getArrayRuntime("mas_array_print"),
+                            {builder->CreateBitCast(value, Type::getInt8PtrTy(*context)),
+                             ConstantInt::get(Type::getInt32Ty(*context), kind)});
+        return;
+    }
     Type* ty = value->getType();
     
     Constant* format = nullptr;
     if (ty->isIntegerTy(32)) {
         format = builder->CreateGlobalStringPtr("%d\n");
+    } else if (ty->isIntegerTy(8)) {
+        // varargs promote a char to int
+        format = builder->CreateGlobalStringPtr("%c\n");
+        value = builder->CreateSExt(value, Type::getInt32Ty(*context));
+    } else if (ty->isIntegerTy(1)) {
+        format = builder->CreateGlobalStringPtr("%s\n");
+        value = builder->CreateSelect(value, builder->CreateGlobalStringPtr("true"), builder->CreateGlobalStringPtr("false"));
     } else if (ty->isFloatTy()) {
+        // and a float to double
         format = builder->CreateGlobalStringPtr("%f\n");
+        value = builder->CreateFPExt(value, Type::getDoubleTy(*context));
     } else if (ty->isPointerTy()) {
         format = builder->CreateGlobalStringPtr("%s\n");
     }
@@ -256,167 +1409,227 @@ void CodeGen::generatePrint(PrintNode* node) {
     builder->CreateCall(printfFunc, {format, value});
 }
 
-void CodeGen::generateTryCatch(TryCatchNode* node) {
-    Function* func = builder->GetInsertBlock()->getParent();
-    BasicBlock* tryBB = BasicBlock::Create(*context, "try", func);
-    BasicBlock* catchBB = BasicBlock::Create(*context, "catch");
-    BasicBlock* contBB = BasicBlock::Create(*context, "try.cont");
-    
-    LandingPadInst* lp = builder->CreateLandingPad(
-        StructType::get(Type::getInt8PtrTy(*context), Type::getInt32Ty(*context)), 0);
-    lp->addClause(ConstantPointerNull::get(Type::getInt8PtrTy(*context)));
-    
-    builder->CreateBr(tryBB);
-    
-    builder->SetInsertPoint(tryBB);
-    generateStatement(node->tryBlock.get());
-    builder->CreateBr(contBB);
-    
-    func->getBasicBlockList().push_back(catchBB);
-    builder->SetInsertPoint(catchBB);
-    if (!node->errorVar.empty()) {
-        AllocaInst* alloca = builder->CreateAlloca(Type::getInt8PtrTy(*context), nullptr, node->errorVar);
-        builder->CreateStore(lp->getOperand(0), alloca);
-    }
-    generateStatement(node->catchBlock.get());
-    builder->CreateBr(contBB);
-    
-    func->getBasicBlockList().push_back(contBB);
-    builder->SetInsertPoint(contBB);
+Value* CodeGen::generateArray(ArrayNode* node, Type* expectedType) {
+    Value* arrayPtr = node->count ? generateRepeatArray(node) : generateArrayLiteral(node);
+    return expectedType ? builder->CreateBitCast(arrayPtr, expectedType) : arrayPtr;
 }
 
-void CodeGen::generateMatch(MatchNode* node) {
-    Value* expr = generateValue(node->expr.get(), nullptr);
-    Function* func = builder->GetInsertBlock()->getParent();
-    BasicBlock* endBB = BasicBlock::Create(*context, "match.end");
+Value* CodeGen::generateArrayLiteral(ArrayNode* node) {
+    VarType element = node->getElementType();
+    uint64_t size = node->elements.size();
+    Type* storage = storageType(element);
     
-    std::vector<BasicBlock*> caseBBs;
-    for (size_t i = 0; i < node->cases.size(); ++i) {
-        caseBBs.push_back(BasicBlock::Create(*context, "case." + std::to_string(i), func));
+    // what is stored: the elements, or for bools eight to a byte with the
+    // unused high bits of the last one clear
+    SmallVector<Value*, 16> units;
+    if (element == VarType::BOOL) {
+        for (size_t first = 0; first < size; first += 8) {
+            Value* byte = ConstantInt::get(storage, 0);
+            for (size_t i = first; i < std::min<size_t>(first + 8, size); ++i) {
+                Value* bit = builder->CreateZExt(generateValue(node->elements[i], Type::getInt1Ty(*context)), storage);
+                byte = builder->CreateOr(byte, builder->CreateShl(bit, i - first));
+            }
+            units.push_back(byte);
+        }
+    } else {
+        for (ASTNode* elem : node->elements) {
+            units.push_back(generateValue(elem, storage));
+        }
     }
     
-    for (size_t i = 0; i < node->cases.size(); ++i) {
-        builder->SetInsertPoint(caseBBs[i]);
-        if (node->cases[i]->value) {
-            Value* caseVal = generateValue(node->cases[i]->value.get(), expr->getType());
-            Value* cmp = builder->CreateICmpEQ(expr, caseVal);
-            BasicBlock* nextBB = (i < node->cases.size()-1) ? caseBBs[i+1] : endBB;
-            builder->CreateCondBr(cmp, caseBBs[i], nextBB);
-        } else {
-            generateStatement(node->cases[i]->body.get());
-            builder->CreateBr(endBB);
+    if (all_of(units, [](Value* unit) { return isa<Constant>(unit); })) {
+        SmallVector<Constant*, 16> constants;
+        for (Value* unit : units) {
+            constants.push_back(cast<Constant>(unit));
         }
+        return getConstantArray(constants, size, element);
     }
-    
-    func->getBasicBlockList().push_back(endBB);
-    builder->SetInsertPoint(endBB);
+    Value* arrayPtr = allocateArray(node, ConstantInt::get(Type::getInt64Ty(*context), size), size, element);
+    for (size_t i = 0; i < units.size(); ++i) {
+        builder->CreateStore(units[i], builder->CreateConstInBoundsGEP1_64(storage, arrayPtr, i));
+    }
+    return arrayPtr;
 }
 
+// [value; count]: a memset when every byte of the filled memory is the same,
+// otherwise splats of the value
+Value* CodeGen::generateRepeatArray(ArrayNode* node) {
+    VarType element = node->getElementType();
+    Type* elemType = elementType(element);
+    Value* value = generateValue(node->elements[0], elemType);
+    Optional<uint64_t> size = knownArraySize(node);
+    Value* length;
+    if (size) {
+        length = ConstantInt::get(Type::getInt64Ty(*context), *size);
+    } else {
+        Value* count = generateValue(node->count, Type::getInt32Ty(*context));
+        generateErrorCheck(builder->CreateICmpSGE(count, ConstantInt::get(count->getType(), 0)),
+                           "Array length is negative");
+        length = builder->CreateSExt(count, Type::getInt64Ty(*context));
+    }
+    Value* dst = allocateArray(node, length, size, element);
 
+    Value* byte = nullptr;
+    if (element == VarType::BOOL) {
+        // the padding bits of the last byte are set too; nothing reads them
+        byte = builder->CreateSExt(value, Type::getInt8Ty(*context));
+    } else if (auto* constant = dyn_cast<Constant>(value)) {
+        byte = splatByte(constant);
+    }
+    if (byte) {
+        builder->CreateMemSet(dst, byte, arrayBytes(length, element), MaybeAlign(ArrayAlign));
+    } else if (size && *size <= MaxInlineLanes) {
+        if (*size > 0) {
+            storeLanes(builder->CreateVectorSplat(*size, value), dst, nullptr);
+        }
+    } else {
+        generateArrayLoop(elemType, dst, length, [&](FixedVectorType* laneType, Value*) {
+            return builder->CreateVectorSplat(laneType->getNumElements(), value);
+        });
+    }
+    return dst;
+}
 
-// ... ادامه از قسمت قبلی
+// the byte a constant repeats, as for 0, -1 or a char; null if it has none
+Value* CodeGen::splatByte(Constant* value) {
+    APInt bits;
+    if (auto* integer = dyn_cast<ConstantInt>(value)) {
+        bits = integer->getValue();
+    } else if (auto* real = dyn_cast<ConstantFP>(value)) {
+        bits = real->getValueAPF().bitcastToAPInt();
+    } else {
+        return nullptr;
+    }
+    APInt byte = bits.trunc(8);
+    if (bits != APInt::getSplat(bits.getBitWidth(), byte)) {
+        return nullptr;
+    }
+    return ConstantInt::get(*context, byte);
+}
 
-Value* CodeGen::generateArray(ArrayNode* node, Type* expectedType) {
-    ArrayType* arrType = ArrayType::get(Type::getInt32Ty(*context), node->elements.size());
-    Value* arrayPtr = builder->CreateAlloca(arrType);
+Value* CodeGen::generateArrayAccess(ArrayAccessNode* node) {
+    Value* arrayPtr = loadVariable(node->arrayName);
+    Value* index = generateValue(node->index, Type::getInt32Ty(*context));
     
-    for (size_t i = 0; i < node->elements.size(); ++i) {
-        Value* idx[] = {
-            ConstantInt::get(Type::getInt32Ty(*context), 0),
-            ConstantInt::get(Type::getInt32Ty(*context), i)
-        };
-        Value* elemPtr = builder->CreateInBoundsGEP(arrType, arrayPtr, idx);
-        Value* val = generateValue(node->elements[i].get(), Type::getInt32Ty(*context));
-        builder->CreateStore(val, elemPtr);
+    // Runtime bounds checking
+    Optional<uint64_t> size = knownLength(node->arrayName);
+    if (needsBoundsCheck(node, size)) {
+        Value* length = size ? ConstantInt::get(Type::getInt64Ty(*context), *size) : loadArrayLength(arrayPtr);
+        generateBoundsCheck(index, length);
     }
     
-    return builder->CreateBitCast(arrayPtr, expectedType);
+    return generateArrayIndex(arrayPtr, index, node->getType());
 }
 
-Value* CodeGen::generateArrayAccess(ArrayAccessNode* node) {
-    Value* arrayPtr = symbols[node->arrayName];
-    Value* index = generateValue(node->index.get(), Type::getInt32Ty(*context));
+bool CodeGen::needsBoundsCheck(ArrayAccessNode* node, Optional<uint64_t> size) const {
+    switch (options.boundsChecks) {
+        case BoundsChecks::Off:
+            return false;
+        case BoundsChecks::Full:
+            return true;
+        case BoundsChecks::Hoisted:
+            break;
+    }
+    if (uncheckedAccesses.count(node)) return false;
+    auto* literal = dyn_cast<IntLiteral>(node->index);
+    return !literal || !size || literal->value < 0 || uint64_t(literal->value) >= *size;
+}
+
+void CodeGen::generateBoundsCheck(Value* index, Value* length) {
+    // unsigned, so a negative index fails the same compare
+    Value* wideIndex = builder->CreateSExt(index, length->getType());
+    generateErrorCheck(builder->CreateICmpULT(wideIndex, length), "Array index out of bounds!");
+}
+
+// continues when `ok` holds and throws `message` otherwise
+void CodeGen::generateErrorCheck(Value* ok, StringRef message) {
+    BasicBlock* validBB = BasicBlock::Create(*context, "check.ok", builder->GetInsertBlock()->getParent());
+    BasicBlock* errorBB = BasicBlock::Create(*context, "check.error");
     
-    // Runtime bounds checking
-    if (arraySizes.count(node->arrayName)) {
-        Value* size = ConstantInt::get(Type::getInt32Ty(*context), arraySizes[node->arrayName]);
-        Value* cond = builder->CreateICmpSGE(index, size);
-        
-        BasicBlock* errorBB = BasicBlock::Create(*context, "bounds_error", builder->GetInsertBlock()->getParent());
-        BasicBlock* validBB = BasicBlock::Create(*context, "valid_index");
-        
-        builder->CreateCondBr(cond, errorBB, validBB);
-        
-        builder->SetInsertPoint(errorBB);
-        Function* throwFunc = Function::Create(
-            FunctionType::get(Type::getVoidTy(*context), {Type::getInt8PtrTy(*context)}, false),
-            Function::ExternalLinkage, "throw_exception", module.get()
-        );
-        Value* msg = builder->CreateGlobalStringPtr("Array index out of bounds!");
-        builder->CreateCall(throwFunc, {msg});
-        builder->CreateUnreachable();
-        
-        builder->GetInsertBlock()->getParent()->getBasicBlockList().push_back(validBB);
-        builder->SetInsertPoint(validBB);
+    builder->CreateCondBr(ok, validBB, errorBB, MDBuilder(*context).createBranchWeights(LikelyWeight, 1));
+    ssa.sealBlock(validBB);
+    ssa.sealBlock(errorBB);
+    
+    builder->GetInsertBlock()->getParent()->getBasicBlockList().push_back(errorBB);
+    builder->SetInsertPoint(errorBB);
+    Constant*& text = errorMessages[message];
+    if (!text) {
+        text = builder->CreateGlobalStringPtr(message);
     }
+    builder->CreateCall(getThrowFunction(), {text});
+    builder->CreateUnreachable();
     
-    return generateArrayIndex(arrayPtr, index);
+    builder->SetInsertPoint(validBB);
+}
+
+// declared once; noreturn and cold, so the error paths stay out of the hot code
+Function* CodeGen::getThrowFunction() {
+    if (Function* existing = module->getFunction("throw_exception")) {
+        return existing;
+    }
+    Function* throwFunc = Function::Create(
+        FunctionType::get(Type::getVoidTy(*context), {Type::getInt8PtrTy(*context)}, false),
+        Function::ExternalLinkage, "throw_exception", module.get()
+    );
+    throwFunc->setDoesNotReturn();
+    throwFunc->addFnAttr(Attribute::Cold);
+    return throwFunc;
 }
 
 Value* CodeGen::generateUnaryOp(UnaryOpNode* node) {
-    Value* operand = generateValue(node->operand.get(), nullptr);
-    
+    if (node->operand->getType() == VarType::ARRAY) {
+        return generateArrayBuiltin(node);
+    }
+    Value* operand = generateValue(node->operand, nullptr);
+    bool isFloat = node->operand->getType() == VarType::FLOAT;
+
     switch(node->op) {
         case UnaryOp::MINUS:
-            if (operand->getType()->isFloatTy()) {
+            if (isFloat) {
                 return builder->CreateFNeg(operand);
             } else {
                 return builder->CreateNeg(operand);
             }
-        case UnaryOp::INCREMENT: {
-            Value* inc = ConstantInt::get(operand->getType(), 1);
-            Value* newVal = builder->CreateAdd(operand, inc);
-            if (auto varRef = dynamic_cast<VarRefNode*>(node->operand.get())) {
-                builder->CreateStore(newVal, symbols[varRef->name]);
+        case UnaryOp::INCREMENT:
+        case UnaryOp::DECREMENT: {
+            bool isInc = node->op == UnaryOp::INCREMENT;
+            Value* newVal;
+            if (isFloat) {
+                Value* one = ConstantFP::get(operand->getType(), 1.0);
+                newVal = isInc ? builder->CreateFAdd(operand, one) : builder->CreateFSub(operand, one);
+            } else {
+                Value* one = ConstantInt::get(operand->getType(), 1);
+                newVal = isInc ? builder->CreateAdd(operand, one) : builder->CreateSub(operand, one);
+            }
+            if (auto varRef = dyn_cast<VarRefNode>(node->operand)) {
+                storeVariable(varRef->name, newVal);
             }
             return operand; // Post-increment returns original value
         }
-        case UnaryOp::LENGTH: {
-            if (!arraySizes.count(node->operand->getName())) {
-                throw std::runtime_error("Length operator on non-array type");
+        case UnaryOp::NOT:
+            return builder->CreateNot(operand);
+        case UnaryOp::ABS:
+            if (isFloat) {
+                return builder->CreateUnaryIntrinsic(Intrinsic::fabs, operand);
+            } else {
+                return builder->CreateBinaryIntrinsic(Intrinsic::abs, operand, builder->getFalse());
             }
-            return ConstantInt::get(Type::getInt32Ty(*context), arraySizes[node->operand->getName()]);
-        }
+        case UnaryOp::LENGTH:
+            if (node->operand->getType() == VarType::STRING) {
+                // a string's header holds its length, like an array's
+                return builder->CreateTrunc(loadArrayLength(operand), Type::getInt32Ty(*context));
+            }
+            throw std::runtime_error("Length operator on non-array type");
         default:
             throw std::runtime_error("Unsupported unary operator");
     }
 }
 
-void CodeGen::generateCompoundAssign(CompoundAssignNode* node) {
-    Value* target = symbols[node->target];
-    Value* current = builder->CreateLoad(target->getType()->getPointerElementType(), target);
-    Value* rhs = generateValue(node->value.get(), current->getType());
-    
-    Value* result;
-    switch(node->op) {
-        case BinaryOp::ADD:
-            result = current->getType()->isFloatTy() ? 
-                builder->CreateFAdd(current, rhs) : 
-                builder->CreateAdd(current, rhs);
-            break;
-        case BinaryOp::SUBTRACT:
-            result = current->getType()->isFloatTy() ? 
-                builder->CreateFSub(current, rhs) : 
-                builder->CreateSub(current, rhs);
-            break;
-        default:
-            throw std::runtime_error("Unsupported compound assignment");
-    }
-    
-    builder->CreateStore(result, target);
+void CodeGen::generateWhileLoop(WhileLoopNode* node) {
+    generateLoopVersions(node, [&] { generateWhileLoopBlocks(node); });
 }
 
-void CodeGen::generateWhileLoop(WhileLoopNode* node) {
+void CodeGen::generateWhileLoopBlocks(WhileLoopNode* node) {
     Function* func = builder->GetInsertBlock()->getParent();
     BasicBlock* condBB = BasicBlock::Create(*context, "while.cond", func);
     BasicBlock* bodyBB = BasicBlock::Create(*context, "while.body");
@@ -426,141 +1639,23 @@ void CodeGen::generateWhileLoop(WhileLoopNode* node) {
     
     // Condition block
     builder->SetInsertPoint(condBB);
-    Value* cond = generateValue(node->condition.get(), Type::getInt1Ty(*context));
+    Value* cond = generateValue(node->condition, Type::getInt1Ty(*context));
     builder->CreateCondBr(cond, bodyBB, endBB);
     
     // Body block
     func->getBasicBlockList().push_back(bodyBB);
     builder->SetInsertPoint(bodyBB);
-    generateStatement(node->body.get());
+    ssa.sealBlock(bodyBB);
+    generateStatement(node->body);
     builder->CreateBr(condBB);  // Loop back
+    ssa.sealBlock(condBB);
     
     // End block
     func->getBasicBlockList().push_back(endBB);
     builder->SetInsertPoint(endBB);
+    ssa.sealBlock(endBB);
 }
 
-Value* CodeGen::generateTernaryExpr(TernaryExprNode* node) {
-    Value* cond = generateValue(node->condition.get(), Type::getInt1Ty(*context));
-    Function* func = builder->GetInsertBlock()->getParent();
-    
-    BasicBlock* trueBB = BasicBlock::Create(*context, "ternary.true", func);
-    BasicBlock* falseBB = BasicBlock::Create(*context, "ternary.false");
-    BasicBlock* mergeBB = BasicBlock::Create(*context, "ternary.merge");
-    
-    builder->CreateCondBr(cond, trueBB, falseBB);
-    
-    // True branch
-    builder->SetInsertPoint(trueBB);
-    Value* trueVal = generateValue(node->trueExpr.get(), nullptr);
-    builder->CreateBr(mergeBB);
-    
-    // False branch
-    func->getBasicBlockList().push_back(falseBB);
-    builder->SetInsertPoint(falseBB);
-    Value* falseVal = generateValue(node->falseExpr.get(), nullptr);
-    builder->CreateBr(mergeBB);
-    
-    // Merge
-    func->getBasicBlockList().push_back(mergeBB);
-    builder->SetInsertPoint(mergeBB);
-    PHINode* phi = builder->CreatePHI(trueVal->getType(), 2);
-    phi->addIncoming(trueVal, trueBB);
-    phi->addIncoming(falseVal, falseBB);
-    
-    return phi;
-}
-
-void CodeGen::generateTypeConversion(TypeConversionNode* node) {
-    Value* val = generateValue(node->expr.get(), nullptr);
-    Type* targetType = getLLVMType(node->targetType);
-    
-    if (val->getType() == targetType) return val;
-    
-    if (targetType->isFloatTy() && val->getType()->isIntegerTy()) {
-        return builder->CreateSIToFP(val, targetType);
-    }
-    if (targetType->isIntegerTy() && val->getType()->isFloatTy()) {
-        return builder->CreateFPToSI(val, targetType);
-    }
-    if (targetType->isPointerTy() && val->getType()->isIntegerTy()) {
-        return builder->CreateIntToPtr(val, targetType);
-    }
-    
-    throw std::runtime_error("Invalid type conversion");
-}
-
-Value* CodeGen::generateBuiltInCall(BuiltInCallNode* node) {
-    if (node->funcName == "pow") {
-        Value* base = generateValue(node->args[0].get(), Type::getDoubleTy(*context));
-        Value* exp = generateValue(node->args[1].get(), Type::getDoubleTy(*context));
-        return builder->CreateCall(
-            Intrinsic::getDeclaration(module.get(), Intrinsic::pow, {Type::getDoubleTy(*context)}),
-            {base, exp}
-        );
-    }
-    if (node->funcName == "abs") {
-        Value* val = generateValue(node->args[0].get(), nullptr);
-        if (val->getType()->isFloatTy()) {
-            return builder->CreateCall(
-                Intrinsic::getDeclaration(module.get(), Intrinsic::fabs, {val->getType()}),
-                {val}
-            );
-        } else {
-            Value* zero = ConstantInt::get(val->getType(), 0);
-            Value* neg = builder->CreateNeg(val);
-            return builder->CreateSelect(
-                builder->CreateICmpSGT(val, zero),
-                val,
-                neg
-            );
-        }
-    }
-    throw std::runtime_error("Unknown built-in function");
-}
-
-void CodeGen::generateMemoryManagement() {
-    // Register destructors for stack-allocated arrays
-    for (auto& [name, alloca] : symbols) {
-        if (alloca->getAllocatedType()->isPointerTy()) {
-            Function* freeFunc = Function::Create(
-                FunctionType::get(Type::getVoidTy(*context), {Type::getInt8PtrTy(*context)}, false),
-                Function::ExternalLinkage, "free", module.get()
-            );
-            
-            BasicBlock* currentBB = builder->GetInsertBlock();
-            BasicBlock* freeBB = BasicBlock::Create(*context, "free." + name, currentBB->getParent());
-            
-            builder->SetInsertPoint(freeBB);
-            Value* casted = builder->CreateBitCast(alloca, Type::getInt8PtrTy(*context));
-            builder->CreateCall(freeFunc, {casted});
-            builder->CreateBr(currentBB);
-            
-            currentBB->getParent()->getBasicBlockList().push_back(freeBB);
-        }
-    }
-}
-
-void CodeGen::optimizeIR() {
-    legacy::FunctionPassManager FPM(module.get());
-    FPM.add(createPromoteMemoryToRegisterPass());
-    FPM.add(createInstructionCombiningPass());
-    FPM.add(createReassociatePass());
-    FPM.add(createGVNPass());
-    FPM.add(createCFGSimplificationPass());
-    
-    FPM.doInitialization();
-    for (Function &F : *module) {
-        FPM.run(F);
-    }
-}
-
-
-
 void CodeGen::dump() const {
     module->print(llvm::outs(), nullptr);
 }
-
-extern "C" void throw_exception(const char* msg) {
-    throw std::runtime_error(msg);
-}
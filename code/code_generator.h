@@ -3,10 +3,20 @@
 
 #include <memory>
 #include <string>
-#include <unordered_map>
 #include <vector>
 #include "AST.h"
+#include "bounds.h"
+#include "identifier.h"
+#include "scope.h"
+#include "ssa_builder.h"
 
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/STLFunctionalExtras.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
@@ -14,29 +24,128 @@
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Value.h>
 
+struct CodeGenOptions {
+    // keep int, float and bool variables in SSA registers instead of stack
+    // slots, placing phis while the tree is walked
+    bool directSSA = false;
+    BoundsChecks boundsChecks = BoundsChecks::Hoisted;
+};
+
 class CodeGen {
 public:
-    void compile(ProgramNode *root, bool optimize, int unroll);
+    CodeGen();
+    void compile(ProgramNode *root, const IdentifierTable &idents, const CodeGenOptions &options = {});
     void dump() const;
 
+    // hand the finished module, and the context it lives in, to a backend
+    std::unique_ptr<llvm::Module> takeModule() { return std::move(module); }
+    std::unique_ptr<llvm::LLVMContext> takeContext() { return std::move(context); }
+
 private:
     std::unique_ptr<llvm::LLVMContext> context;
     std::unique_ptr<llvm::Module> module;
     std::unique_ptr<llvm::IRBuilder<>> builder;
+    // inserts before allocaPoint, so every stack slot lands in the entry block
+    std::unique_ptr<llvm::IRBuilder<>> allocaBuilder;
+    llvm::Instruction* allocaPoint = nullptr;
 
-    llvm::Function* currentFunc = nullptr;
-    std::unordered_map<std::string, llvm::AllocaInst*> symbols;
-    std::unordered_map<std::string, uint64_t> arraySizes;
+    llvm::Function* mainFunc = nullptr;
+    llvm::Function* printfFunc = nullptr;
+    const IdentifierTable* idents = nullptr;
+    // a stack slot, or in direct-SSA mode a variable of `ssa` (slot is null)
+    struct Variable {
+        llvm::AllocaInst* slot;
+        unsigned ssaVar;
+    };
 
-    void declareRuntimeFunctions();
+    // variables visible at the current point; arraySizes is keyed by id
+    ScopedTable<Variable> symbols;
+    CodeGenOptions options;
+    SSABuilder ssa;
+    // accesses the enclosing loops proved or tested in range
+    llvm::SmallPtrSet<ArrayAccessNode*, 16> uncheckedAccesses;
+    // inside either version of a loop; loops nested in it are not versioned again
+    bool versionedLoop = false;
+    llvm::StringMap<llvm::Constant*> errorMessages;
+    llvm::DenseMap<uint32_t, uint64_t> arraySizes;
+    // arrays declared more than once or assigned; their length is read at run time
+    llvm::DenseSet<uint32_t> redefinedArrays;
+    // slots declared in each open scope; their lifetime ends when it closes
+    std::vector<llvm::SmallVector<llvm::AllocaInst*, 4>> scopeSlots;
+    // array and string values a variable may hold past their site's next run,
+    // and the variables that may hold one; only these are reference counted
+    llvm::DenseSet<ASTNode*> escapingValues;
+    llvm::DenseSet<uint32_t> countedNames;
+    // counted slots declared in each open scope; released when it closes
+    std::vector<llvm::SmallVector<llvm::AllocaInst*, 2>> scopeCounted;
+
+    llvm::AllocaInst* lookupSymbol(Identifier id) const;
+    llvm::Value* loadVariable(Identifier id);
+    void storeVariable(Identifier id, llvm::Value* value);
+    llvm::AllocaInst* createSlot(llvm::Type* type, const llvm::Twine& name = "");
+    llvm::AllocaInst* createCountedSlot(llvm::Type* type, const llvm::Twine& name = "");
+    void storeCounted(llvm::AllocaInst* slot, llvm::Value* value);
+    void pushScope();
+    void popScope();
+
+    void generate(ProgramNode& ast);
     void generateStatement(ASTNode* node);
+    void generateVarDecl(VarDeclNode* node);
+    void generateAssign(AssignNode* node);
+    void generateIfElse(IfElseNode* node);
+    void generateForLoop(ForLoopNode* node);
+    void generateWhileLoop(WhileLoopNode* node);
+    void generatePrint(PrintNode* node);
+    void generateBlock(BlockNode* node);
+    void generateForLoopBlocks(ForLoopNode* node);
+    void generateWhileLoopBlocks(WhileLoopNode* node);
+    void generateLoopVersions(ASTNode* loop, llvm::function_ref<void()> generateLoop);
+    llvm::Value* generateRangeCheck(const LoopRange& range, llvm::ArrayRef<InductionAccess> accesses);
+    void generateBoundsCheck(llvm::Value* index, llvm::Value* length);
+    bool needsBoundsCheck(ArrayAccessNode* node, llvm::Optional<uint64_t> size) const;
+    void generateErrorCheck(llvm::Value* ok, llvm::StringRef message);
+    llvm::Function* getThrowFunction();
     llvm::Value* generateValue(ASTNode* node, llvm::Type* expectedType);
-    llvm::Value* generatePow(llvm::Value* base, llvm::Value* exp);
-
-    void printArray(const std::vector<llvm::Value*>& elements);
-    void printArrayVar(llvm::Value* arrayPtr, uint64_t size);
-    void generateTryCatch(TryCatchNode* node);
-    void generateMatch(MatchNode* node);
+    llvm::Value* generateBinaryOp(BinaryOpNode* node, llvm::Type* expectedType);
+    llvm::Value* generateComparison(BinaryOpNode* node);
+    llvm::Value* generatePow(PowNode* node);
+    llvm::Value* generateLogicalOp(BinaryOpNode* node);
+    llvm::Value* generateUnaryOp(UnaryOpNode* node);
+    llvm::Value* promoteToFloat(llvm::Value* val, ASTNode* operand);
+    void findRedefinedArrays(ASTNode* node);
+    void findEscapingValues(ASTNode* root);
+    llvm::Optional<uint64_t> knownLength(Identifier array) const;
+    llvm::Optional<uint64_t> knownArraySize(ASTNode* node) const;
+    llvm::Value* generateArray(ArrayNode* node, llvm::Type* expectedType);
+    llvm::Value* generateArrayAccess(ArrayAccessNode* node);
+    llvm::Value* generateArrayIndex(llvm::Value* arrayPtr, llvm::Value* index, VarType element);
+    llvm::Value* generateArrayOp(BinaryOpNode* node);
+    void collectArrayLeaves(ASTNode* node, llvm::Type* elemType, llvm::SmallVectorImpl<llvm::Value*>& leaves);
+    llvm::Value* combineLanes(ASTNode* node, llvm::ArrayRef<llvm::Value*> leaves, unsigned& next,
+                              llvm::FixedVectorType* laneType, llvm::Value* offset);
+    void generateArrayLoop(llvm::Type* elemType, llvm::Value* dst, llvm::Value* length,
+                           llvm::function_ref<llvm::Value*(llvm::FixedVectorType*, llvm::Value*)> lanesAt);
+    llvm::Value* loadLanes(llvm::Value* array, llvm::FixedVectorType* laneType, llvm::Value* offset);
+    void storeLanes(llvm::Value* lanes, llvm::Value* array, llvm::Value* offset);
+    llvm::Value* generateArrayBuiltin(UnaryOpNode* node);
+    llvm::Value* generateArraySearch(BinaryOpNode* node);
+    llvm::Function* getArrayRuntime(llvm::StringRef name);
+    llvm::Value* loadBits(llvm::Value* array, uint64_t count);
+    llvm::Type* elementType(VarType element);
+    llvm::PointerType* arrayType(VarType element);
+    llvm::Value* allocateArray(ASTNode* site, llvm::Value* length, llvm::Optional<uint64_t> knownLength, VarType element);
+    llvm::Value* allocateSiteBuffer(llvm::Value* length, llvm::Value* bytes);
+    llvm::Value* getConstantArray(llvm::ArrayRef<llvm::Constant*> units, uint64_t length, VarType element);
+    llvm::StructType* arrayFrame(VarType element, uint64_t units);
+    llvm::Type* storageType(VarType element);
+    uint64_t storageUnits(uint64_t length, VarType element);
+    llvm::Value* arrayBytes(llvm::Value* length, VarType element);
+    llvm::Value* generateArrayLiteral(ArrayNode* node);
+    llvm::Value* generateRepeatArray(ArrayNode* node);
+    llvm::Value* generateStringLiteral(llvm::StringRef text);
+    llvm::Value* generateStringConcat(llvm::Value* L, llvm::Value* R);
+    llvm::Value* splatByte(llvm::Constant* value);
+    llvm::Value* loadArrayLength(llvm::Value* array);
 };
 
 #endif
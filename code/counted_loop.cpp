@@ -0,0 +1,138 @@
+#include "counted_loop.h"
+#include "ast_walk.h"
+#include <utility>
+#include <llvm/ADT/SmallVector.h>
+
+using namespace llvm;
+
+namespace {
+bool isIntVar(ASTNode *node) {
+    return isa<VarRefNode>(node) && node->getType() == VarType::INT;
+}
+
+bool mentions(ASTNode *node, Identifier id) {
+    if (auto *ref = dyn_cast<VarRefNode>(node)) return ref->name == id;
+    if (auto *access = dyn_cast<ArrayAccessNode>(node))
+        if (access->arrayName == id) return true;
+    SmallVector<ASTNode *, 4> children;
+    getChildren(node, children);
+    for (auto *child : children)
+        if (mentions(child, id)) return true;
+    return false;
+}
+}
+
+bool fitsInt(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+Optional<int64_t> CountedLoop::tripCount() const {
+    auto *limit = dyn_cast<IntLiteral>(bound);
+    if (!start || !limit) return None;
+    int64_t a = *start, b = limit->value, n;
+    switch (cmp) {
+    case BinaryOp::LESS:          n = a < b ? (b - a + step - 1) / step : 0; break;
+    case BinaryOp::LESS_EQUAL:    n = a <= b ? (b - a) / step + 1 : 0; break;
+    case BinaryOp::GREATER:       n = a > b ? (a - b - step - 1) / -step : 0; break;
+    case BinaryOp::GREATER_EQUAL: n = a >= b ? (a - b) / -step + 1 : 0; break;
+    case BinaryOp::NOT_EQUAL:
+        if ((b - a) % step != 0 || (b - a) / step < 0) return None;
+        n = (b - a) / step;
+        break;
+    default:
+        return None;
+    }
+    // the original loop must not run the variable past INT_MAX/INT_MIN
+    if (!fitsInt(a + n * step)) return None;
+    return n;
+}
+
+bool matchUpdate(ASTNode *update, CountedLoop &loop) {
+    int64_t step = 0;
+    if (auto *unary = dyn_cast<UnaryOpNode>(update)) {
+        auto *ref = dyn_cast<VarRefNode>(unary->operand);
+        if (!ref) return false;
+        if (unary->op == UnaryOp::INCREMENT) step = 1;
+        else if (unary->op == UnaryOp::DECREMENT) step = -1;
+        else return false;
+        loop.iv = ref->name;
+    } else if (auto *assign = dyn_cast<AssignNode>(update)) {
+        loop.iv = assign->target;
+        ASTNode *value = assign->value;
+        BinaryOp op = assign->op;
+        if (op == BinaryOp::EQUAL) {
+            auto *binary = dyn_cast<BinaryOpNode>(value);
+            if (!binary) return false;
+            auto *ref = dyn_cast<VarRefNode>(binary->left);
+            value = binary->right;
+            if (binary->op == BinaryOp::ADD && !ref) {
+                ref = dyn_cast<VarRefNode>(binary->right);
+                value = binary->left;
+            }
+            if (!ref || ref->name != loop.iv) return false;
+            op = binary->op;
+        }
+        auto *literal = dyn_cast<IntLiteral>(value);
+        if (!literal) return false;
+        if (op == BinaryOp::ADD) step = literal->value;
+        else if (op == BinaryOp::SUBTRACT) step = -int64_t(literal->value);
+        else return false;
+    } else {
+        return false;
+    }
+    loop.step = step;
+    return step != 0;
+}
+
+bool matchCondition(ASTNode *condition, CountedLoop &loop) {
+    auto *compare = dyn_cast_or_null<BinaryOpNode>(condition);
+    if (!compare) return false;
+
+    BinaryOp cmp = compare->op;
+    ASTNode *var = compare->left;
+    ASTNode *bound = compare->right;
+    auto *ref = dyn_cast<VarRefNode>(var);
+    if (!ref || ref->name != loop.iv) {
+        std::swap(var, bound);
+        ref = dyn_cast<VarRefNode>(var);
+        switch (cmp) {
+        case BinaryOp::LESS:          cmp = BinaryOp::GREATER; break;
+        case BinaryOp::LESS_EQUAL:    cmp = BinaryOp::GREATER_EQUAL; break;
+        case BinaryOp::GREATER:       cmp = BinaryOp::LESS; break;
+        case BinaryOp::GREATER_EQUAL: cmp = BinaryOp::LESS_EQUAL; break;
+        default: break;
+        }
+    }
+    if (!ref || ref->name != loop.iv || !isIntVar(var)) return false;
+    if (bound->getType() != VarType::INT || mentions(bound, loop.iv)) return false;
+
+    switch (cmp) {
+    case BinaryOp::LESS: case BinaryOp::LESS_EQUAL:
+        if (loop.step < 0) return false;
+        break;
+    case BinaryOp::GREATER: case BinaryOp::GREATER_EQUAL:
+        if (loop.step > 0) return false;
+        break;
+    case BinaryOp::NOT_EQUAL:
+        break;
+    default:
+        return false;
+    }
+    loop.cmp = cmp;
+    loop.bound = bound;
+    return true;
+}
+
+Optional<int64_t> startValue(ASTNode *init, Identifier iv) {
+    if (!init) return None;
+    ASTNode *value = nullptr;
+    if (auto *decls = dyn_cast<MultiVarDeclNode>(init)) {
+        for (auto *decl : decls->declarations)
+            if (decl->name == iv && decl->type == VarType::INT) value = decl->value;
+    } else if (auto *assign = dyn_cast<AssignNode>(init)) {
+        if (assign->target == iv && assign->op == BinaryOp::EQUAL) value = assign->value;
+    }
+    if (auto *literal = dyn_cast_or_null<IntLiteral>(value)) return int64_t(literal->value);
+    return None;
+}
+
@@ -0,0 +1,34 @@
+#ifndef COUNTED_LOOP_H
+#define COUNTED_LOOP_H
+
+#include <cstdint>
+#include <llvm/ADT/Optional.h>
+#include "AST.h"
+
+// Recognizes loops that step one int variable by a constant until a
+// comparison fails. Shared by the unroller and the bounds-check analysis.
+
+bool fitsInt(int64_t value);
+
+// `iv cmp bound`, iv += step
+struct CountedLoop {
+    Identifier iv;
+    BinaryOp cmp;            // normalized so the induction variable is on the left
+    ASTNode *bound;          // an int expression that does not mention iv
+    int64_t step;
+    llvm::Optional<int64_t> start; // known when the loop is entered right after iv = literal
+
+    llvm::Optional<int64_t> tripCount() const;
+};
+
+// i++, i--, i += c, i -= c, i = i + c, i = i - c; sets iv and step
+bool matchUpdate(ASTNode *update, CountedLoop &loop);
+
+// iv < bound, bound > iv, ... for the iv and step already matched; the
+// comparison has to be the one that eventually stops the stepping
+bool matchCondition(ASTNode *condition, CountedLoop &loop);
+
+// int iv = c; / iv = c; right before the loop gives its start value
+llvm::Optional<int64_t> startValue(ASTNode *init, Identifier iv);
+
+#endif
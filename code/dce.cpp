@@ -0,0 +1,272 @@
+#include "dce.h"
+#include "ast_walk.h"
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+
+namespace {
+// variables a simple statement or expression reads and writes
+void collectAccesses(ASTNode *node, SmallVectorImpl<Identifier> &reads, SmallVectorImpl<Identifier> &writes) {
+    switch (node->getKind()) {
+    case ASTNode::NK_VarRef:
+        reads.push_back(cast<VarRefNode>(node)->name);
+        return;
+    case ASTNode::NK_VarDecl:
+        writes.push_back(cast<VarDeclNode>(node)->name);
+        break;
+    case ASTNode::NK_Assign: {
+        auto *assign = cast<AssignNode>(node);
+        writes.push_back(assign->target);
+        if (assign->op != BinaryOp::EQUAL) reads.push_back(assign->target);
+        break;
+    }
+    case ASTNode::NK_UnaryOp: {
+        auto *unary = cast<UnaryOpNode>(node);
+        if (unary->op == UnaryOp::INCREMENT || unary->op == UnaryOp::DECREMENT) {
+            if (auto *ref = dyn_cast<VarRefNode>(unary->operand)) {
+                reads.push_back(ref->name);
+                writes.push_back(ref->name);
+                return;
+            }
+        }
+        break;
+    }
+    case ASTNode::NK_ArrayAccess:
+        reads.push_back(cast<ArrayAccessNode>(node)->arrayName);
+        break;
+    default:
+        break;
+    }
+    SmallVector<ASTNode *, 4> children;
+    getChildren(node, children);
+    for (auto *child : children) collectAccesses(child, reads, writes);
+}
+
+class DeadCodeEliminator {
+    const IdentifierTable &idents;
+    bool verbose;
+    ASTContext &context;
+    // ids of variables whose value can reach an observable effect
+    DenseSet<uint32_t> liveVars;
+    // statements (and single declarations) found live by the last mark pass
+    SmallPtrSet<ASTNode *, 32> liveNodes;
+    bool grew = false;
+    unsigned removed = 0;
+
+public:
+    DeadCodeEliminator(ASTContext &ctx, const IdentifierTable &ids, bool v)
+        : idents(ids), verbose(v), context(ctx) {}
+
+    unsigned run(ProgramNode *program) {
+        // liveness only grows, so this settles after at most one pass per variable
+        do {
+            grew = false;
+            liveNodes.clear();
+            markList(program->statements);
+        } while (grew);
+
+        program->statements = sweepList(program->statements);
+        if (verbose && removed) errs() << "dce: removed " << removed << " statement(s)\n";
+        return removed;
+    }
+
+private:
+    // everything `node` touches becomes live; a live statement's other
+    // writes are kept, so their variables must stay declared
+    void use(ASTNode *node) {
+        SmallVector<Identifier, 8> reads, writes;
+        collectAccesses(node, reads, writes);
+        for (Identifier id : reads) grew |= liveVars.insert(id.getID()).second;
+        for (Identifier id : writes) grew |= liveVars.insert(id.getID()).second;
+    }
+
+    bool writesLive(ASTNode *node) {
+        SmallVector<Identifier, 8> reads, writes;
+        collectAccesses(node, reads, writes);
+        for (Identifier id : writes)
+            if (liveVars.count(id.getID())) return true;
+        return false;
+    }
+
+    bool markList(ArrayRef<ASTNode *> statements) {
+        bool any = false;
+        for (auto *stmt : statements) any |= mark(stmt);
+        return any;
+    }
+
+    // records whether `stmt` is live and propagates liveness out of it
+    bool mark(ASTNode *stmt) {
+        bool live = false;
+        switch (stmt->getKind()) {
+        case ASTNode::NK_Block:
+            live = markList(cast<BlockNode>(stmt)->statements);
+            break;
+        case ASTNode::NK_IfElse: {
+            auto *ifElse = cast<IfElseNode>(stmt);
+            live = mark(ifElse->thenBlock);
+            if (ifElse->elseBlock) live |= mark(ifElse->elseBlock);
+            // a condition can also trap or write a live variable (k++ < n)
+            live |= mayTrap(ifElse->condition) || writesLive(ifElse->condition);
+            if (live) use(ifElse->condition);
+            break;
+        }
+        case ASTNode::NK_ForLoop: {
+            auto *loop = cast<ForLoopNode>(stmt);
+            live = mark(loop->body);
+            if (loop->update) live |= mark(loop->update);
+            if (loop->condition) live |= mayTrap(loop->condition) || writesLive(loop->condition);
+            if (loop->init) live |= mark(loop->init);
+            if (live && loop->condition) use(loop->condition);
+            break;
+        }
+        case ASTNode::NK_WhileLoop: {
+            auto *loop = cast<WhileLoopNode>(stmt);
+            live = mark(loop->body) | mayTrap(loop->condition) | writesLive(loop->condition);
+            if (live) use(loop->condition);
+            break;
+        }
+        case ASTNode::NK_ForeachLoop: {
+            auto *loop = cast<ForeachLoopNode>(stmt);
+            live = mark(loop->body) | mayTrap(loop->collection) | writesLive(loop->collection);
+            if (live) use(loop->collection);
+            break;
+        }
+        case ASTNode::NK_TryCatch: {
+            auto *tryCatch = cast<TryCatchNode>(stmt);
+            live = mark(tryCatch->tryBlock);
+            live |= mark(tryCatch->catchBlock);
+            break;
+        }
+        case ASTNode::NK_Match:
+            // no pass understands match yet; keep it and all it reads
+            use(stmt);
+            live = true;
+            break;
+        case ASTNode::NK_MultiVarDecl:
+            for (auto *decl : cast<MultiVarDeclNode>(stmt)->declarations) {
+                if (liveVars.count(decl->name.getID()) || (decl->value && mayTrap(decl->value)) ||
+                    (decl->value && writesLive(decl->value))) {
+                    liveNodes.insert(decl);
+                    use(decl);
+                    live = true;
+                }
+            }
+            break;
+        case ASTNode::NK_Print:
+            use(stmt);
+            live = true;
+            break;
+        default:
+            live = mayTrap(stmt) || writesLive(stmt);
+            if (live) use(stmt);
+            break;
+        }
+        if (live) liveNodes.insert(stmt);
+        return live;
+    }
+
+    void report(ASTNode *stmt) {
+        ++removed;
+        if (!verbose) return;
+        errs() << "dce: removed ";
+        switch (stmt->getKind()) {
+        case ASTNode::NK_VarDecl:
+            errs() << "unused variable '" << idents.getName(cast<VarDeclNode>(stmt)->name) << "'";
+            break;
+        case ASTNode::NK_Assign:
+            errs() << "dead store to '" << idents.getName(cast<AssignNode>(stmt)->target) << "'";
+            break;
+        case ASTNode::NK_UnaryOp:
+            if (auto *ref = dyn_cast<VarRefNode>(cast<UnaryOpNode>(stmt)->operand)) {
+                errs() << "dead update of '" << idents.getName(ref->name) << "'";
+                break;
+            }
+            errs() << "expression statement without effect";
+            break;
+        case ASTNode::NK_ForLoop:     errs() << "for loop without observable effect"; break;
+        case ASTNode::NK_WhileLoop:   errs() << "while loop without observable effect"; break;
+        case ASTNode::NK_ForeachLoop: errs() << "foreach loop without observable effect"; break;
+        case ASTNode::NK_IfElse:      errs() << "if statement without observable effect"; break;
+        case ASTNode::NK_Block:       errs() << "block without observable effect"; break;
+        case ASTNode::NK_TryCatch:    errs() << "try/catch without observable effect"; break;
+        default:                      errs() << "expression statement without effect"; break;
+        }
+        errs() << "\n";
+    }
+
+    ArrayRef<ASTNode *> sweepList(ArrayRef<ASTNode *> statements) {
+        SmallVector<ASTNode *, 8> kept;
+        for (auto *stmt : statements)
+            if (ASTNode *swept = sweep(stmt)) kept.push_back(swept);
+        if (kept.size() == statements.size()) return statements;
+        return context.copyArray<ASTNode *>(kept);
+    }
+
+    // the statement with its dead parts removed, or null if all of it is dead
+    ASTNode *sweep(ASTNode *stmt) {
+        if (!stmt) return nullptr;
+        if (auto *decls = dyn_cast<MultiVarDeclNode>(stmt)) {
+            SmallVector<VarDeclNode *, 4> kept;
+            for (auto *decl : decls->declarations) {
+                if (liveNodes.count(decl)) kept.push_back(decl);
+                else report(decl);
+            }
+            if (kept.empty()) return nullptr;
+            if (kept.size() != decls->declarations.size())
+                decls->declarations = context.copyArray<VarDeclNode *>(kept);
+            return stmt;
+        }
+        if (!liveNodes.count(stmt)) {
+            report(stmt);
+            return nullptr;
+        }
+
+        switch (stmt->getKind()) {
+        case ASTNode::NK_Block:
+            sweepBlock(cast<BlockNode>(stmt));
+            break;
+        case ASTNode::NK_IfElse: {
+            auto *ifElse = cast<IfElseNode>(stmt);
+            sweepBlock(ifElse->thenBlock);
+            if (auto *elseBlock = dyn_cast_or_null<BlockNode>(ifElse->elseBlock))
+                sweepBlock(elseBlock);
+            else
+                ifElse->elseBlock = sweep(ifElse->elseBlock);
+            break;
+        }
+        case ASTNode::NK_ForLoop: {
+            auto *loop = cast<ForLoopNode>(stmt);
+            loop->init = sweep(loop->init);
+            loop->update = sweep(loop->update);
+            sweepBlock(loop->body);
+            break;
+        }
+        case ASTNode::NK_WhileLoop:
+            sweepBlock(cast<WhileLoopNode>(stmt)->body);
+            break;
+        case ASTNode::NK_ForeachLoop:
+            sweepBlock(cast<ForeachLoopNode>(stmt)->body);
+            break;
+        case ASTNode::NK_TryCatch:
+            sweepBlock(cast<TryCatchNode>(stmt)->tryBlock);
+            sweepBlock(cast<TryCatchNode>(stmt)->catchBlock);
+            break;
+        default:
+            break;
+        }
+        return stmt;
+    }
+
+    void sweepBlock(BlockNode *block) {
+        if (block) block->statements = sweepList(block->statements);
+    }
+};
+}
+
+unsigned eliminateDeadCode(ProgramNode *program, ASTContext &context, const IdentifierTable &idents,
+                           bool verbose) {
+    return DeadCodeEliminator(context, idents, verbose).run(program);
+}
@@ -0,0 +1,20 @@
+#ifndef DCE_H
+#define DCE_H
+
+#include "AST.h"
+#include "ASTContext.h"
+#include "identifier.h"
+
+// Removes declarations, assignments, expression statements and whole
+// if/loop statements whose results never reach a print. A statement is
+// live if it prints, may trap at run time (array access, int division by a
+// non-literal), or writes a live variable; a live statement makes every
+// variable it reads live, and a live statement inside a loop or if makes
+// its condition live. Same-named variables are treated as one, so
+// shadowing only ever keeps more. Loops without any live statement are
+// assumed to terminate and are removed. With `verbose`, every removal is
+// reported to errs(). Returns the number of statements removed.
+unsigned eliminateDeadCode(ProgramNode *program, ASTContext &context, const IdentifierTable &idents,
+                           bool verbose);
+
+#endif
@@ -0,0 +1,72 @@
+#include "emit.h"
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/ToolOutputFile.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+
+using namespace llvm;
+
+std::unique_ptr<TargetMachine> createHostMachine(Module &module) {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+
+    std::string triple = sys::getDefaultTargetTriple();
+    std::string error;
+    const Target *target = TargetRegistry::lookupTarget(triple, error);
+    if (!target) {
+        errs() << "Error: " << error << "\n";
+        return nullptr;
+    }
+
+    std::unique_ptr<TargetMachine> machine(target->createTargetMachine(
+        triple, sys::getHostCPUName(), "", TargetOptions(), Reloc::PIC_));
+    module.setTargetTriple(triple);
+    module.setDataLayout(machine->createDataLayout());
+    return machine;
+}
+
+bool emitModule(Module &module, EmitKind kind, StringRef outputFile) {
+    std::unique_ptr<TargetMachine> machine;
+    if (kind != EmitKind::LL) {
+        machine = createHostMachine(module);
+        if (!machine) return true;
+    }
+
+    sys::fs::OpenFlags flags = kind == EmitKind::LL || kind == EmitKind::Asm
+        ? sys::fs::OF_Text : sys::fs::OF_None;
+    std::error_code ec;
+    ToolOutputFile out(outputFile, ec, flags);
+    if (ec) {
+        errs() << "Error opening " << outputFile << ": " << ec.message() << "\n";
+        return true;
+    }
+
+    switch (kind) {
+    case EmitKind::LL:
+        module.print(out.os(), nullptr);
+        break;
+    case EmitKind::BC:
+        WriteBitcodeToFile(module, out.os());
+        break;
+    case EmitKind::Asm:
+    case EmitKind::Obj: {
+        legacy::PassManager passes;
+        CodeGenFileType fileType = kind == EmitKind::Asm ? CGFT_AssemblyFile : CGFT_ObjectFile;
+        if (machine->addPassesToEmitFile(passes, out.os(), nullptr, fileType)) {
+            errs() << "Error: the host target cannot emit this file type\n";
+            return true;
+        }
+        passes.run(module);
+        break;
+    }
+    }
+
+    out.keep();
+    return false;
+}
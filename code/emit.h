@@ -0,0 +1,21 @@
+#ifndef EMIT_H
+#define EMIT_H
+
+#include <memory>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+enum class EmitKind { LL, BC, Asm, Obj };
+
+// Writes the module to outputFile ("-" is stdout) as textual IR, bitcode,
+// or native assembly/object code for the host target. Returns true and
+// reports to errs() on failure.
+bool emitModule(llvm::Module &module, EmitKind kind, llvm::StringRef outputFile);
+
+// A TargetMachine for the host CPU; also stamps its triple and data layout
+// on the module. Returns null and reports to errs() if the host target is
+// not linked in.
+std::unique_ptr<llvm::TargetMachine> createHostMachine(llvm::Module &module);
+
+#endif
@@ -0,0 +1,465 @@
+#include "fold.h"
+#include "ast_walk.h"
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/Twine.h>
+
+using namespace llvm;
+
+namespace {
+// int arithmetic wraps like the i32 ops codegen emits
+int wrap(int64_t value) {
+    return int(uint32_t(uint64_t(value)));
+}
+
+bool isLiteral(const ASTNode *node) {
+    switch (node->getKind()) {
+    case ASTNode::NK_IntLiteral: case ASTNode::NK_FloatLiteral:
+    case ASTNode::NK_BoolLiteral: case ASTNode::NK_CharLiteral:
+    case ASTNode::NK_StrLiteral:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// value of an int or float literal, promoted the way codegen promotes it
+bool getFloat(const ASTNode *node, float &value) {
+    if (auto *lit = dyn_cast<IntLiteral>(node)) value = float(lit->value);
+    else if (auto *lit = dyn_cast<FloatLiteral>(node)) value = lit->value;
+    else return false;
+    return true;
+}
+
+bool isIntValue(const ASTNode *node, int value) {
+    auto *lit = dyn_cast<IntLiteral>(node);
+    return lit && lit->value == value;
+}
+
+bool isNumberValue(const ASTNode *node, float value) {
+    float v;
+    return getFloat(node, v) && v == value;
+}
+
+// an operand whose value the result ignores may still only be dropped if
+// evaluating it neither writes anything nor can fail a run-time check
+bool isDiscardable(ASTNode *node) {
+    return !hasSideEffects(node) && !mayTrap(node);
+}
+
+class ConstantFolder {
+    ASTContext &context;
+    // per identifier id: declarations and writes anywhere in the program
+    DenseMap<uint32_t, unsigned> declarations, writes;
+    // literal value of each variable that is declared once and never written
+    DenseMap<uint32_t, ASTNode *> constants;
+
+public:
+    explicit ConstantFolder(ASTContext &ctx) : context(ctx) {}
+
+    void run(ProgramNode *program) {
+        countWrites(program);
+        program->statements = foldList(program->statements);
+    }
+
+private:
+    template <typename T>
+    T *typed(T *node, VarType type) {
+        node->setType(type);
+        return node;
+    }
+
+    void countWrites(ASTNode *node) {
+        switch (node->getKind()) {
+        case ASTNode::NK_VarDecl:
+            ++declarations[cast<VarDeclNode>(node)->name.getID()];
+            break;
+        case ASTNode::NK_Assign:
+            ++writes[cast<AssignNode>(node)->target.getID()];
+            break;
+        case ASTNode::NK_UnaryOp: {
+            auto *unary = cast<UnaryOpNode>(node);
+            if (auto *ref = dyn_cast<VarRefNode>(unary->operand))
+                if (unary->op == UnaryOp::INCREMENT || unary->op == UnaryOp::DECREMENT)
+                    ++writes[ref->name.getID()];
+            break;
+        }
+        case ASTNode::NK_ForeachLoop:
+            ++declarations[cast<ForeachLoopNode>(node)->varName.getID()];
+            break;
+        case ASTNode::NK_TryCatch:
+            ++declarations[cast<TryCatchNode>(node)->errorVar.getID()];
+            break;
+        default:
+            break;
+        }
+        SmallVector<ASTNode *, 4> children;
+        getChildren(node, children);
+        for (auto *child : children) countWrites(child);
+    }
+
+    // the declared type's literal for `value`, or null if it has none
+    ASTNode *constantFor(VarDeclNode *decl) {
+        ASTNode *value = decl->value;
+        if (!value || !isLiteral(value)) return nullptr;
+        uint32_t id = decl->name.getID();
+        if (declarations.lookup(id) != 1 || writes.lookup(id) != 0) return nullptr;
+
+        if (decl->type == VarType::FLOAT) {
+            float v;
+            if (!getFloat(value, v)) return nullptr;
+            return typed(context.create<FloatLiteral>(v), VarType::FLOAT);
+        }
+        return value->getType() == decl->type ? value : nullptr;
+    }
+
+    ASTNode *cloneLiteral(ASTNode *literal) {
+        ASTNode *copy = nullptr;
+        switch (literal->getKind()) {
+        case ASTNode::NK_IntLiteral:   copy = context.create<IntLiteral>(cast<IntLiteral>(literal)->value); break;
+        case ASTNode::NK_FloatLiteral: copy = context.create<FloatLiteral>(cast<FloatLiteral>(literal)->value); break;
+        case ASTNode::NK_BoolLiteral:  copy = context.create<BoolLiteral>(cast<BoolLiteral>(literal)->value); break;
+        case ASTNode::NK_CharLiteral:  copy = context.create<CharLiteral>(cast<CharLiteral>(literal)->value); break;
+        case ASTNode::NK_StrLiteral:   copy = context.create<StrLiteral>(cast<StrLiteral>(literal)->value); break;
+        default: llvm_unreachable("not a literal");
+        }
+        copy->setType(literal->getType());
+        return copy;
+    }
+
+    ArrayRef<ASTNode *> foldList(ArrayRef<ASTNode *> nodes) {
+        SmallVector<ASTNode *, 8> folded;
+        bool changed = false;
+        for (auto *node : nodes) {
+            folded.push_back(fold(node));
+            changed |= folded.back() != node;
+        }
+        return changed ? context.copyArray<ASTNode *>(folded) : nodes;
+    }
+
+    BlockNode *foldBlock(BlockNode *block) {
+        if (block) block->statements = foldList(block->statements);
+        return block;
+    }
+
+    // folds children in place and returns the node's replacement
+    ASTNode *fold(ASTNode *node) {
+        if (!node) return nullptr;
+        switch (node->getKind()) {
+        case ASTNode::NK_MultiVarDecl:
+            for (auto *decl : cast<MultiVarDeclNode>(node)->declarations) {
+                decl->value = fold(decl->value);
+                if (ASTNode *value = constantFor(decl))
+                    constants[decl->name.getID()] = value;
+            }
+            return node;
+        case ASTNode::NK_Assign: {
+            auto *assign = cast<AssignNode>(node);
+            assign->value = fold(assign->value);
+            return node;
+        }
+        case ASTNode::NK_VarRef: {
+            ASTNode *value = constants.lookup(cast<VarRefNode>(node)->name.getID());
+            return value ? cloneLiteral(value) : node;
+        }
+        case ASTNode::NK_BinaryOp: {
+            auto *binary = cast<BinaryOpNode>(node);
+            binary->left = fold(binary->left);
+            binary->right = fold(binary->right);
+            return foldBinary(binary);
+        }
+        case ASTNode::NK_UnaryOp: {
+            auto *unary = cast<UnaryOpNode>(node);
+            // ++/-- name their variable; it is never a constant
+            if (unary->op == UnaryOp::INCREMENT || unary->op == UnaryOp::DECREMENT) return node;
+            unary->operand = fold(unary->operand);
+            return foldUnary(unary);
+        }
+        case ASTNode::NK_Block:
+            return foldBlock(cast<BlockNode>(node));
+        case ASTNode::NK_IfElse: {
+            auto *ifElse = cast<IfElseNode>(node);
+            ifElse->condition = fold(ifElse->condition);
+            foldBlock(ifElse->thenBlock);
+            ifElse->elseBlock = fold(ifElse->elseBlock);
+            return node;
+        }
+        case ASTNode::NK_ForLoop: {
+            auto *loop = cast<ForLoopNode>(node);
+            loop->init = fold(loop->init);
+            loop->condition = fold(loop->condition);
+            loop->update = fold(loop->update);
+            foldBlock(loop->body);
+            return node;
+        }
+        case ASTNode::NK_WhileLoop: {
+            auto *loop = cast<WhileLoopNode>(node);
+            loop->condition = fold(loop->condition);
+            foldBlock(loop->body);
+            return node;
+        }
+        case ASTNode::NK_ForeachLoop: {
+            auto *loop = cast<ForeachLoopNode>(node);
+            loop->collection = fold(loop->collection);
+            foldBlock(loop->body);
+            return node;
+        }
+        case ASTNode::NK_Print: {
+            auto *print = cast<PrintNode>(node);
+            print->expr = fold(print->expr);
+            return node;
+        }
+        case ASTNode::NK_Array: {
+            auto *array = cast<ArrayNode>(node);
+            array->elements = foldList(array->elements);
+            if (array->count) array->count = fold(array->count);
+            return node;
+        }
+        case ASTNode::NK_ArrayAccess: {
+            auto *access = cast<ArrayAccessNode>(node);
+            access->index = fold(access->index);
+            return node;
+        }
+        case ASTNode::NK_Concat: {
+            auto *concat = cast<ConcatNode>(node);
+            concat->left = fold(concat->left);
+            concat->right = fold(concat->right);
+            return foldConcat(concat);
+        }
+        case ASTNode::NK_Pow: {
+            auto *pow = cast<PowNode>(node);
+            pow->base = fold(pow->base);
+            pow->exponent = fold(pow->exponent);
+            return foldPow(pow);
+        }
+        case ASTNode::NK_TryCatch: {
+            auto *tryCatch = cast<TryCatchNode>(node);
+            foldBlock(tryCatch->tryBlock);
+            foldBlock(tryCatch->catchBlock);
+            return node;
+        }
+        case ASTNode::NK_Match: {
+            auto *match = cast<MatchNode>(node);
+            match->expr = fold(match->expr);
+            match->cases = foldList(match->cases);
+            return node;
+        }
+        default:
+            return node;
+        }
+    }
+
+    ASTNode *intLiteral(int value) {
+        return typed(context.create<IntLiteral>(value), VarType::INT);
+    }
+    ASTNode *floatLiteral(float value) {
+        return typed(context.create<FloatLiteral>(value), VarType::FLOAT);
+    }
+    ASTNode *boolLiteral(bool value) {
+        return typed(context.create<BoolLiteral>(value), VarType::BOOL);
+    }
+
+    // `operand` may stand in for `node` only if no implicit int->float
+    // conversion is lost
+    static bool sameType(ASTNode *operand, ASTNode *node) {
+        return operand->getType() == node->getType();
+    }
+
+    ASTNode *foldBinary(BinaryOpNode *node) {
+        ASTNode *left = node->left, *right = node->right;
+        VarType type = node->getType();
+
+        if (type == VarType::INT) {
+            auto *l = dyn_cast<IntLiteral>(left);
+            auto *r = dyn_cast<IntLiteral>(right);
+            if (l && r) {
+                int64_t a = l->value, b = r->value;
+                switch (node->op) {
+                case BinaryOp::ADD:      return intLiteral(wrap(a + b));
+                case BinaryOp::SUBTRACT: return intLiteral(wrap(a - b));
+                case BinaryOp::MULTIPLY: return intLiteral(wrap(a * b));
+                case BinaryOp::DIVIDE:
+                    if (b == 0 || (a == INT32_MIN && b == -1)) break;
+                    return intLiteral(int(a / b));
+                case BinaryOp::MOD:
+                    if (b == 0 || (a == INT32_MIN && b == -1)) break;
+                    return intLiteral(int(a % b));
+                default: break;
+                }
+            }
+            switch (node->op) {
+            case BinaryOp::ADD:
+                if (isIntValue(right, 0) && sameType(left, node)) return left;
+                if (isIntValue(left, 0) && sameType(right, node)) return right;
+                break;
+            case BinaryOp::SUBTRACT:
+                if (isIntValue(right, 0) && sameType(left, node)) return left;
+                break;
+            case BinaryOp::MULTIPLY:
+                if (isIntValue(right, 1) && sameType(left, node)) return left;
+                if (isIntValue(left, 1) && sameType(right, node)) return right;
+                if ((isIntValue(right, 0) && isDiscardable(left)) ||
+                    (isIntValue(left, 0) && isDiscardable(right)))
+                    return intLiteral(0);
+                break;
+            case BinaryOp::DIVIDE:
+                if (isIntValue(right, 1) && sameType(left, node)) return left;
+                break;
+            case BinaryOp::MOD:
+                if (isIntValue(right, 1) && isDiscardable(left)) return intLiteral(0);
+                break;
+            default:
+                break;
+            }
+            return node;
+        }
+
+        if (type == VarType::FLOAT) {
+            float a, b;
+            if (getFloat(left, a) && getFloat(right, b)) {
+                switch (node->op) {
+                case BinaryOp::ADD:      return floatLiteral(a + b);
+                case BinaryOp::SUBTRACT: return floatLiteral(a - b);
+                case BinaryOp::MULTIPLY: return floatLiteral(a * b);
+                case BinaryOp::DIVIDE:   return floatLiteral(a / b);
+                default: break;
+                }
+            }
+            // x*1 and x/1 are exact in IEEE arithmetic; x+0 is not (-0.0 + 0 = +0.0)
+            switch (node->op) {
+            case BinaryOp::MULTIPLY:
+                if (isNumberValue(right, 1) && sameType(left, node)) return left;
+                if (isNumberValue(left, 1) && sameType(right, node)) return right;
+                break;
+            case BinaryOp::DIVIDE:
+                if (isNumberValue(right, 1) && sameType(left, node)) return left;
+                break;
+            default:
+                break;
+            }
+            return node;
+        }
+
+        if (type == VarType::BOOL)
+            return foldBoolean(node);
+        return node;
+    }
+
+    ASTNode *foldBoolean(BinaryOpNode *node) {
+        ASTNode *left = node->left, *right = node->right;
+        auto *lb = dyn_cast<BoolLiteral>(left);
+        auto *rb = dyn_cast<BoolLiteral>(right);
+
+        switch (node->op) {
+        case BinaryOp::AND:
+            if (lb) return lb->value ? right : left;
+            if (rb && rb->value) return left;
+            if (rb && isDiscardable(left)) return boolLiteral(false);
+            return node;
+        case BinaryOp::OR:
+            if (lb) return lb->value ? left : right;
+            if (rb && !rb->value) return left;
+            if (rb && isDiscardable(left)) return boolLiteral(true);
+            return node;
+        default:
+            break;
+        }
+
+        int order; // sign of left <=> right
+        auto *li = dyn_cast<IntLiteral>(left);
+        auto *ri = dyn_cast<IntLiteral>(right);
+        auto *lc = dyn_cast<CharLiteral>(left);
+        auto *rc = dyn_cast<CharLiteral>(right);
+        float a, b;
+        if (li && ri) {
+            order = (li->value > ri->value) - (li->value < ri->value);
+        } else if (lc && rc) {
+            order = (lc->value > rc->value) - (lc->value < rc->value);
+        } else if (lb && rb) {
+            order = int(lb->value) - int(rb->value);
+        } else if (getFloat(left, a) && getFloat(right, b)) {
+            // an unordered (NaN) compare is false for everything but !=
+            if (std::isnan(a) || std::isnan(b)) return boolLiteral(node->op == BinaryOp::NOT_EQUAL);
+            order = (a > b) - (a < b);
+        } else {
+            return node;
+        }
+
+        switch (node->op) {
+        case BinaryOp::EQUAL:         return boolLiteral(order == 0);
+        case BinaryOp::NOT_EQUAL:     return boolLiteral(order != 0);
+        case BinaryOp::LESS:          return lb ? node : boolLiteral(order < 0);
+        case BinaryOp::LESS_EQUAL:    return lb ? node : boolLiteral(order <= 0);
+        case BinaryOp::GREATER:       return lb ? node : boolLiteral(order > 0);
+        case BinaryOp::GREATER_EQUAL: return lb ? node : boolLiteral(order >= 0);
+        default:                      return node;
+        }
+    }
+
+    ASTNode *foldUnary(UnaryOpNode *node) {
+        ASTNode *operand = node->operand;
+        switch (node->op) {
+        case UnaryOp::MINUS:
+            if (auto *lit = dyn_cast<IntLiteral>(operand)) return intLiteral(wrap(-int64_t(lit->value)));
+            if (auto *lit = dyn_cast<FloatLiteral>(operand)) return floatLiteral(-lit->value);
+            break;
+        case UnaryOp::NOT:
+            if (auto *lit = dyn_cast<BoolLiteral>(operand)) return boolLiteral(!lit->value);
+            break;
+        case UnaryOp::ABS:
+            if (auto *lit = dyn_cast<IntLiteral>(operand))
+                if (lit->value != INT32_MIN) return intLiteral(lit->value < 0 ? -lit->value : lit->value);
+            if (auto *lit = dyn_cast<FloatLiteral>(operand)) return floatLiteral(std::fabs(lit->value));
+            break;
+        default:
+            break;
+        }
+        return node;
+    }
+
+    ASTNode *foldPow(PowNode *node) {
+        ASTNode *base = node->base, *exponent = node->exponent;
+        VarType type = node->getType();
+
+        if (type == VarType::INT) {
+            auto *b = dyn_cast<IntLiteral>(base);
+            auto *e = dyn_cast<IntLiteral>(exponent);
+            if (b && e && e->value >= 0) {
+                // square-and-multiply, wrapping like repeated i32 multiplies
+                uint32_t result = 1, square = uint32_t(b->value);
+                for (uint32_t n = uint32_t(e->value); n; n >>= 1) {
+                    if (n & 1) result *= square;
+                    square *= square;
+                }
+                return intLiteral(int(result));
+            }
+            if (isIntValue(exponent, 0) && isDiscardable(base)) return intLiteral(1);
+            if (isIntValue(exponent, 1) && sameType(base, node)) return base;
+            return node;
+        }
+
+        if (type == VarType::FLOAT) {
+            float b, e;
+            if (getFloat(base, b) && getFloat(exponent, e)) return floatLiteral(std::pow(b, e));
+            if (isNumberValue(exponent, 0) && isDiscardable(base)) return floatLiteral(1);
+            if (isNumberValue(exponent, 1) && sameType(base, node)) return base;
+        }
+        return node;
+    }
+
+    ASTNode *foldConcat(ConcatNode *node) {
+        auto *l = dyn_cast<StrLiteral>(node->left);
+        auto *r = dyn_cast<StrLiteral>(node->right);
+        if (!l || !r || node->getType() != VarType::STRING) return node;
+        std::string joined = (Twine(l->value) + r->value).str();
+        return typed(context.create<StrLiteral>(context.copyString(joined)), VarType::STRING);
+    }
+};
+}
+
+void foldConstants(ProgramNode *program, ASTContext &context) {
+    ConstantFolder(context).run(program);
+}
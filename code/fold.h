@@ -0,0 +1,16 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "AST.h"
+#include "ASTContext.h"
+
+// Folds literal arithmetic, comparisons, logic, pow, abs and concat,
+// simplifies identities (x*1, x+0, x-0, x/1, pow(x,0), pow(x,1), x%1), and
+// propagates variables that are declared once with a literal initializer
+// and never written again. Runs after semantic analysis: only nodes with a
+// valid type are touched, and folds follow the same int wraparound and
+// float precision as the generated code. Division by zero and INT_MIN / -1
+// are left to run time.
+void foldConstants(ProgramNode *program, ASTContext &context);
+
+#endif
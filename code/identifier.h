@@ -0,0 +1,47 @@
+#ifndef IDENTIFIER_H
+#define IDENTIFIER_H
+
+#include <cstdint>
+#include <vector>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Allocator.h>
+
+// An interned name: a dense 32-bit index into the IdentifierTable that
+// produced it. Equal spellings always get the same id, so semantic and
+// codegen key their tables on the id instead of hashing the string.
+class Identifier {
+    uint32_t id = Invalid;
+
+public:
+    static constexpr uint32_t Invalid = ~0u;
+
+    Identifier() = default;
+    explicit Identifier(uint32_t id) : id(id) {}
+
+    uint32_t getID() const { return id; }
+    bool isValid() const { return id != Invalid; }
+
+    bool operator==(Identifier other) const { return id == other.id; }
+    bool operator!=(Identifier other) const { return id != other.id; }
+};
+
+// Filled by the lexer, once per distinct name
+class IdentifierTable {
+    llvm::StringMap<uint32_t, llvm::BumpPtrAllocator> ids;
+    std::vector<llvm::StringRef> names; // spellings owned by ids
+
+public:
+    Identifier get(llvm::StringRef name) {
+        auto inserted = ids.try_emplace(name, static_cast<uint32_t>(names.size()));
+        if (inserted.second) names.push_back(inserted.first->getKey());
+        return Identifier(inserted.first->getValue());
+    }
+
+    llvm::StringRef getName(Identifier id) const { return names[id.getID()]; }
+
+    // ids are always below size(), so it can size dense per-name tables
+    size_t size() const { return names.size(); }
+};
+
+#endif
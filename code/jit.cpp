@@ -0,0 +1,84 @@
+#include "jit.h"
+#include "runtime.h"
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+
+namespace {
+std::unique_ptr<JITProgram> reportError(Error err) {
+    logAllUnhandledErrors(std::move(err), errs(), "JIT error: ");
+    return nullptr;
+}
+}
+
+std::unique_ptr<JITProgram> JITProgram::create(std::unique_ptr<LLVMContext> context,
+                                               std::unique_ptr<Module> module) {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+
+    auto jit = orc::LLJITBuilder().create();
+    if (!jit) return reportError(jit.takeError());
+
+    orc::JITDylib &lib = (*jit)->getMainJITDylib();
+    const DataLayout &layout = (*jit)->getDataLayout();
+
+    // libc (printf, malloc, ...) comes from the process itself
+    auto process = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(layout.getGlobalPrefix());
+    if (!process) return reportError(process.takeError());
+    lib.addGenerator(std::move(*process));
+
+    // the MAS runtime is bound by address, so it needs no dynamic export
+    orc::MangleAndInterner mangle((*jit)->getExecutionSession(), layout);
+    orc::SymbolMap runtime;
+    auto bind = [&](StringRef name, auto *fn) {
+        runtime[mangle(name)] = JITEvaluatedSymbol(pointerToJITTargetAddress(fn), JITSymbolFlags::Exported);
+    };
+    bind("print", &print);
+    bind("printBool", &printBool);
+    bind("mas_write", &mas_write);
+    bind("mas_read", &mas_read);
+    bind("mas_ipow", &mas_ipow);
+    bind("throw_exception", &throw_exception);
+    bind("mas_array_alloc", &mas_array_alloc);
+    bind("mas_array_retain", &mas_array_retain);
+    bind("mas_array_release", &mas_array_release);
+    bind("mas_array_print", &mas_array_print);
+    bind("mas_array_op", &mas_array_op);
+    bind("mas_array_scalar_op", &mas_array_scalar_op);
+    bind("mas_array_min", &mas_array_min);
+    bind("mas_array_max", &mas_array_max);
+    bind("mas_array_sum", &mas_array_sum);
+    bind("mas_array_abs", &mas_array_abs);
+    bind("mas_array_index", &mas_array_index);
+    bind("mas_farray_min", &mas_farray_min);
+    bind("mas_farray_max", &mas_farray_max);
+    bind("mas_farray_sum", &mas_farray_sum);
+    bind("mas_farray_abs", &mas_farray_abs);
+    bind("mas_farray_index", &mas_farray_index);
+    bind("mas_carray_min", &mas_carray_min);
+    bind("mas_carray_max", &mas_carray_max);
+    bind("mas_carray_index", &mas_carray_index);
+    bind("mas_barray_count", &mas_barray_count);
+    bind("mas_barray_index", &mas_barray_index);
+    if (Error err = lib.define(orc::absoluteSymbols(std::move(runtime))))
+        return reportError(std::move(err));
+
+    module->setDataLayout(layout);
+    if (Error err = (*jit)->addIRModule(orc::ThreadSafeModule(std::move(module), std::move(context))))
+        return reportError(std::move(err));
+
+    auto mainSym = (*jit)->lookup("main");
+    if (!mainSym) return reportError(mainSym.takeError());
+
+    std::unique_ptr<JITProgram> program(new JITProgram());
+    program->jit = std::move(*jit);
+    program->mainFn = jitTargetAddressToFunction<int (*)()>(mainSym->getAddress());
+    return program;
+}
+
+int runJIT(std::unique_ptr<LLVMContext> context, std::unique_ptr<Module> module) {
+    std::unique_ptr<JITProgram> program = JITProgram::create(std::move(context), std::move(module));
+    return program ? program->run() : -1;
+}
@@ -0,0 +1,28 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <memory>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+// A module compiled in-process with ORC LLJIT, with the MAS runtime bound
+// from this executable. main can be run any number of times.
+class JITProgram {
+public:
+    // Returns null and reports to errs() if the module cannot be compiled.
+    static std::unique_ptr<JITProgram> create(std::unique_ptr<llvm::LLVMContext> context,
+                                              std::unique_ptr<llvm::Module> module);
+
+    int run() { return mainFn(); }
+
+private:
+    std::unique_ptr<llvm::orc::LLJIT> jit;
+    int (*mainFn)() = nullptr;
+};
+
+// Compiles the module and runs main once. Returns the program's exit code,
+// or -1 if the module could not be JIT-compiled.
+int runJIT(std::unique_ptr<llvm::LLVMContext> context, std::unique_ptr<llvm::Module> module);
+
+#endif
@@ -1,102 +1,158 @@
 #include "lexer.h"
-#include <cctype>
+#include "char_class.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include "llvm/Support/ErrorHandling.h"
 
-Lexer::Lexer(llvm::StringRef buffer) {
+// Keywords bucketed by length and then first character, so an identifier
+// costs one or two switches and at most one compare instead of a chain
+// of ~29 string compares.
+Token::TokenKind keywordKind(llvm::StringRef text) {
+    switch (text.size()) {
+    case 2:
+        switch (text[0]) {
+        case 'i':
+            if (text == "if") return Token::KW_if;
+            if (text == "in") return Token::KW_in;
+            break;
+        case 'o': if (text == "or") return Token::or_op; break;
+        }
+        break;
+    case 3:
+        switch (text[0]) {
+        case 'i': if (text == "int") return Token::KW_int; break;
+        case 'f': if (text == "for") return Token::KW_for; break;
+        case 't': if (text == "try") return Token::KW_try; break;
+        case 'p': if (text == "pow") return Token::KW_pow; break;
+        case 'a':
+            if (text == "abs") return Token::KW_abs;
+            if (text == "and") return Token::and_op;
+            break;
+        case 'm':
+            if (text == "min") return Token::KW_min;
+            if (text == "max") return Token::KW_max;
+            break;
+        case 'n': if (text == "not") return Token::not_op; break;
+        case 's': if (text == "sum") return Token::KW_sum; break;
+        }
+        break;
+    case 4:
+        switch (text[0]) {
+        case 'b': if (text == "bool") return Token::KW_bool; break;
+        case 'c': if (text == "char") return Token::KW_char; break;
+        case 'e': if (text == "else") return Token::KW_else; break;
+        case 't': if (text == "true") return Token::KW_true; break;
+        }
+        break;
+    case 5:
+        switch (text[0]) {
+        case 'f':
+            if (text == "float") return Token::KW_float;
+            if (text == "false") return Token::KW_false;
+            break;
+        case 'a': if (text == "array") return Token::KW_array; break;
+        case 'w': if (text == "while") return Token::KW_while; break;
+        case 'p': if (text == "print") return Token::KW_print; break;
+        case 'c': if (text == "catch") return Token::KW_catch; break;
+        case 'e': if (text == "error") return Token::KW_error; break;
+        case 'm': if (text == "match") return Token::KW_match; break;
+        case 'i': if (text == "index") return Token::KW_index; break;
+        }
+        break;
+    case 6:
+        switch (text[0]) {
+        case 's': if (text == "string") return Token::KW_string; break;
+        case 'c': if (text == "concat") return Token::KW_concat; break;
+        case 'l': if (text == "length") return Token::KW_length; break;
+        }
+        break;
+    case 7:
+        if (text == "foreach") return Token::KW_foreach;
+        break;
+    }
+    return Token::identifier;
+}
+
+Lexer::Lexer(llvm::StringRef buffer, IdentifierTable &idents) : idents(idents) {
     bufferStart = buffer.begin();
+    bufferEnd = buffer.end();
     bufferPtr = bufferStart;
+    tokenStart = bufferStart;
 }
 
 void Lexer::skipWhitespace() {
-    while (isspace(*bufferPtr)) {
-        if (*bufferPtr == '\n') bufferPtr++;
-        else bufferPtr++;
-    }
+    bufferPtr = charclass::skipSpace(bufferPtr, bufferEnd);
+}
+
+// returns false when not looking at "/*"
+bool Lexer::skipComment() {
+    if (bufferEnd - bufferPtr < 2 || bufferPtr[0] != '/' || bufferPtr[1] != '*')
+        return false;
+    const char *close = charclass::findCommentEnd(bufferPtr + 2, bufferEnd);
+    bufferPtr = close == bufferEnd ? bufferEnd : close + 2;
+    return true;
 }
 
-void Lexer::skipComment() {
-    if (*bufferPtr == '/' && *(bufferPtr + 1) == '*') {
-        bufferPtr += 2;
-        while (!(*bufferPtr == '*' && *(bufferPtr + 1) == '/')) bufferPtr++;
-        bufferPtr += 2;
+std::pair<unsigned, unsigned> Lexer::getLineColumn(uint32_t offset) const {
+    const char *pos = bufferStart + offset;
+    const char *lineStart = bufferStart;
+    unsigned line = 1;
+    for (const char *p = bufferStart;
+         (p = static_cast<const char *>(std::memchr(p, '\n', pos - p))); ++p) {
+        ++line;
+        lineStart = p + 1;
     }
+    return {line, unsigned(pos - lineStart) + 1};
 }
 
 Token Lexer::nextToken() {
-    skipWhitespace();
-    skipComment();
+    do {
+        skipWhitespace();
+    } while (skipComment());
 
-    if (bufferPtr >= bufferStart + buffer.size()) 
+    tokenStart = bufferPtr;
+    if (bufferPtr >= bufferEnd) 
         return {Token::eof, llvm::StringRef(), 0, 0};
 
     const char *tokStart = bufferPtr;
     
     // KWords & Identifiers
-    if (isalpha(*bufferPtr)) {
-        while (isalnum(*bufferPtr) || *bufferPtr == '_') bufferPtr++;
+    if (charclass::isAlpha(*bufferPtr)) {
+        bufferPtr = charclass::skipIdentBody(bufferPtr + 1, bufferEnd);
         llvm::StringRef text(tokStart, bufferPtr - tokStart);
         
-        Token::TokenKind kind = Token::identifier;
-        if (text == "int") kind = Token::KW_int;
-        else if (text == "bool") kind = Token::KW_bool;
-        else if (text == "float") kind = Token::KW_float;
-        else if (text == "char") kind = Token::KW_char;
-        else if (text == "string") kind = Token::KW_string;
-        else if (text == "array") kind = Token::KW_array;
-        else if (text == "if") kind = Token::KW_if;
-        else if (text == "else") kind = Token::KW_else;
-        else if (text == "while") kind = Token::KW_while;
-        else if (text == "for") kind = Token::KW_for;
-        else if (text == "foreach") kind = Token::KW_foreach;
-        else if (text == "in") kind = Token::KW_in;
-        else if (text == "print") kind = Token::KW_print;
-        else if (text == "true") kind = Token::KW_true;
-        else if (text == "false") kind = Token::KW_false;
-        else if (text == "try") kind = Token::KW_try;
-        else if (text == "catch") kind = Token::KW_catch;
-        else if (text == "error") kind = Token::KW_error;
-        else if (text == "match") kind = Token::KW_match;
-        else if (text == "concat") kind = Token::KW_concat;
-        else if (text == "pow") kind = Token::KW_pow;
-        else if (text == "abs") kind = Token::KW_abs;
-        else if (text == "length") kind = Token::KW_length;
-        else if (text == "min") kind = Token::KW_min;
-        else if (text == "max") kind = Token::KW_max;
-        else if (text == "and")   kind = Token::and_op;
-        else if (text == "or")    kind = Token::or_op;
-        else if (text == "not")   kind = Token::not_op;
-        else if (text == "index") kind = Token::KW_index;
-        
-        return {kind, text, 0, 0};
+        Token::TokenKind kind = keywordKind(text);
+        Token tok = {kind, text, 0, 0};
+        if (kind == Token::identifier) tok.ident = idents.get(text);
+        return tok;
     }
     
     // numbers
-    if (isdigit(*bufferPtr) || *bufferPtr == '.') {
-        bool hasDot = false;
-    if (*bufferPtr == '.') {
-        hasDot = true;
-        bufferPtr++;
-    }
-    while (isdigit(*bufferPtr) || (!hasDot && *bufferPtr == '.')) {
-        if (*bufferPtr == '.') hasDot = true;
-        bufferPtr++;
+    if (charclass::isDigit(*bufferPtr) || *bufferPtr == '.') {
+        bufferPtr = charclass::skipDigits(bufferPtr, bufferEnd);
+        bool hasDot = bufferPtr < bufferEnd && *bufferPtr == '.';
+        if (hasDot) bufferPtr = charclass::skipDigits(bufferPtr + 1, bufferEnd);
+        return {hasDot ? Token::float_literal : Token::number, 
+                llvm::StringRef(tokStart, bufferPtr - tokStart), 0, 0};
     }
-    return {hasDot ? Token::float_literal : Token::number, 
-            llvm::StringRef(tokStart, bufferPtr - tokStart), 0, 0};}
 
     // strings
     if (*bufferPtr == '"') {
         bufferPtr++;
         const char *start = bufferPtr;
-        while (*bufferPtr != '"' && *bufferPtr != '\0') bufferPtr++;
-        return {Token::string_literal, llvm::StringRef(start, bufferPtr - start), 0, 0};
+        while (bufferPtr < bufferEnd && *bufferPtr != '"') bufferPtr++;
+        llvm::StringRef text(start, bufferPtr - start);
+        if (bufferPtr < bufferEnd) bufferPtr++; // Skip closing "
+        return {Token::string_literal, text, 0, 0};
     }
     
     // charachters
     if (*bufferPtr == '\'') {
         bufferPtr++;
-        char c = *bufferPtr;
+        llvm::StringRef text(bufferPtr, 1);
         bufferPtr += 2; // Skip closing '
-        return {Token::char_literal, llvm::StringRef(&c, 1), 0, 0};
+        return {Token::char_literal, text, 0, 0};
     }
     
     // operators & symbols
@@ -192,3 +248,53 @@ Token Lexer::nextToken() {
     
     return {Token::eof, llvm::StringRef(), 0, 0};
 }
+
+TokenStream::TokenStream(llvm::StringRef buffer, IdentifierTable &idents) : buffer(buffer) {
+    if (buffer.size() > UINT32_MAX)
+        llvm::report_fatal_error("input too large for the token stream");
+
+    // rough guess of one token per 4 bytes avoids most regrowth
+    size_t guess = buffer.size() / 4 + 1;
+    kinds.reserve(guess);
+    offsets.reserve(guess);
+    lengths.reserve(guess);
+    values.reserve(guess);
+
+    Lexer lexer(buffer, idents);
+    for (;;) {
+        Token tok = lexer.nextToken();
+        uint32_t offset = lexer.getTokenOffset();
+        if (tok.is(Token::string_literal) || tok.is(Token::char_literal))
+            offset += 1; // text starts after the opening quote
+
+        LiteralValue value;
+        value.intValue = 0;
+        const char *first = tok.text.begin(), *last = tok.text.end();
+        if (tok.is(Token::number))
+            std::from_chars(first, last, value.intValue);
+        else if (tok.is(Token::float_literal))
+            std::from_chars(first, last, value.floatValue);
+        else if (tok.is(Token::identifier))
+            value.identID = tok.ident.getID();
+
+        kinds.push_back(static_cast<uint8_t>(tok.kind));
+        offsets.push_back(offset);
+        lengths.push_back(tok.text.size());
+        values.push_back(value);
+        if (tok.is(Token::eof)) break;
+    }
+}
+
+std::pair<unsigned, unsigned> TokenStream::getLineColumn(size_t i) const {
+    if (lineStarts.empty()) {
+        lineStarts.push_back(0);
+        const char *begin = buffer.begin(), *end = buffer.end();
+        for (const char *p = begin;
+             (p = static_cast<const char *>(std::memchr(p, '\n', end - p))); ++p)
+            lineStarts.push_back(p - begin + 1);
+    }
+    uint32_t offset = offsets[i];
+    auto it = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset);
+    unsigned line = it - lineStarts.begin();
+    return {line, offset - *(it - 1) + 1};
+}
@@ -2,7 +2,11 @@
 #define LEXER_H
 
 #include "llvm/ADT/StringRef.h"
+#include "identifier.h"
+#include <cstdint>
 #include <string>
+#include <utility>
+#include <vector>
 
 class Lexer;
 
@@ -42,7 +46,7 @@ public:
         greater_equal,
         and_op,
         or_op,
-        not_op
+        not_op,
         plus_plus,
         minus_minus,
 
@@ -73,6 +77,7 @@ public:
         KW_min,
         KW_max,
         KW_index,
+        KW_sum,
 
         comment_start,
         comment_end,
@@ -87,6 +92,7 @@ public:
     llvm::StringRef text;
     int line;
     int column;
+    Identifier ident; // interned name of an identifier token
 
     bool is(TokenKind k) const { return kind == k; }
     bool isOneOf(TokenKind k1, TokenKind k2) const { return is(k1) || is(k2); }
@@ -95,18 +101,65 @@ public:
     }
 };
 
+// keyword kind of an identifier-shaped word, or Token::identifier
+Token::TokenKind keywordKind(llvm::StringRef text);
+
 class Lexer {
     const char *bufferStart;
+    const char *bufferEnd;
     const char *bufferPtr;
+    const char *tokenStart;
+    IdentifierTable &idents;
 
 public:
-    Lexer(llvm::StringRef buffer);
+    Lexer(llvm::StringRef buffer, IdentifierTable &idents);
     Token nextToken();
 
+    // offset of the last token returned by nextToken()
+    uint32_t getTokenOffset() const { return tokenStart - bufferStart; }
+    // 1-based line and column of a buffer offset; scans from the start,
+    // so it is meant for diagnostics only
+    std::pair<unsigned, unsigned> getLineColumn(uint32_t offset) const;
+
 private:
     void skipWhitespace();
-    void skipComment();
+    bool skipComment();
     Token formToken(Token::TokenKind kind, const char *tokEnd);
 };
 
+// Whole input lexed up front, stored as a struct of arrays: 9 bytes per
+// token plus the pre-decoded literal value. Line and column are only
+// computed when a diagnostic asks for them.
+class TokenStream {
+    union LiteralValue {
+        int32_t intValue;
+        float floatValue;
+        uint32_t identID;
+    };
+
+    llvm::StringRef buffer;
+    std::vector<uint8_t> kinds;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::vector<LiteralValue> values;
+    mutable std::vector<uint32_t> lineStarts; // built on first use
+
+public:
+    TokenStream(llvm::StringRef buffer, IdentifierTable &idents);
+
+    size_t size() const { return kinds.size(); }
+    Token::TokenKind getKind(size_t i) const { return static_cast<Token::TokenKind>(kinds[i]); }
+    llvm::StringRef getText(size_t i) const { return buffer.substr(offsets[i], lengths[i]); }
+    int32_t getIntValue(size_t i) const { return values[i].intValue; }
+    float getFloatValue(size_t i) const { return values[i].floatValue; }
+    Token getToken(size_t i) const {
+        Token tok = {getKind(i), getText(i), 0, 0};
+        if (tok.is(Token::identifier)) tok.ident = Identifier(values[i].identID);
+        return tok;
+    }
+
+    // 1-based line and column of token i
+    std::pair<unsigned, unsigned> getLineColumn(size_t i) const;
+};
+
 #endif
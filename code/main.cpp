@@ -2,12 +2,22 @@
 #include "lexer.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
 #include <iostream>
 #include "AST.h"
+#include "ASTContext.h"
+#include "autotune.h"
 #include <string>
 #include "code_generator.h"
+#include "dce.h"
+#include "emit.h"
+#include "fold.h"
+#include "jit.h"
+#include "optimizer.h"
 #include "parser.h"
+#include "passes.h"
 #include "semantic.h"
 
 using namespace std;
@@ -18,57 +28,202 @@ static llvm::cl::opt<std::string> Input(llvm::cl::Positional,
 										llvm::cl::init(""));
 
 static llvm::cl::opt<std::string> FileName("f",
-										   llvm::cl::desc("<Specify the file name>"),
+										   llvm::cl::desc("<Specify the file name, or - for stdin>"),
 										   llvm::cl::value_desc("filename"),
 										   llvm::cl::init(""));
 
+static llvm::cl::opt<bool> PreLex("prelex",
+								  llvm::cl::desc("Lex the whole input up front into a compact token array"),
+								  llvm::cl::init(false));
+
+static llvm::cl::opt<bool> Run("run",
+							   llvm::cl::desc("JIT-compile the program and run it in-process; exits with its exit code"),
+							   llvm::cl::init(false));
+
+static llvm::cl::opt<EmitKind> Emit("emit",
+									llvm::cl::desc("Kind of output to write"),
+									llvm::cl::values(clEnumValN(EmitKind::LL, "ll", "Textual LLVM IR (default)"),
+													 clEnumValN(EmitKind::BC, "bc", "LLVM bitcode"),
+													 clEnumValN(EmitKind::Asm, "asm", "Native assembly"),
+													 clEnumValN(EmitKind::Obj, "obj", "Native object file")),
+									llvm::cl::init(EmitKind::LL));
+
+static llvm::cl::opt<std::string> OutputFile("o",
+											 llvm::cl::desc("Output file, or - for stdout"),
+											 llvm::cl::value_desc("filename"),
+											 llvm::cl::init("-"));
+
+static llvm::cl::opt<OptLevel> OptimizationLevel(llvm::cl::desc("Optimization level:"),
+												  llvm::cl::values(clEnumValN(OptLevel::O0, "O0", "No optimization"),
+																   clEnumValN(OptLevel::O1, "O1", "Optimize quickly"),
+																   clEnumValN(OptLevel::O2, "O2", "Default optimizations, with vectorization"),
+																   clEnumValN(OptLevel::O3, "O3", "Aggressive optimizations"),
+																   clEnumValN(OptLevel::Os, "Os", "Optimize for size")),
+												  llvm::cl::init(OptLevel::O2));
+
+static llvm::cl::opt<bool> NoOpt("no-opt",
+								 llvm::cl::desc("Skip the optimization pipeline entirely"),
+								 llvm::cl::init(false));
+
+static llvm::cl::opt<std::string> Passes("passes",
+										 llvm::cl::desc("Custom pass pipeline replacing the -O level, e.g. function(mem2reg,instcombine)"),
+										 llvm::cl::value_desc("pipeline"),
+										 llvm::cl::init(""));
+
+static llvm::cl::opt<bool> DirectSSA("direct-ssa",
+									  llvm::cl::desc("Build SSA values and phis during code generation instead of stack slots for scalars"),
+									  llvm::cl::init(false));
+
+static llvm::cl::opt<BoundsChecks> BoundsCheckMode("bounds-checks",
+												   llvm::cl::desc("How array indices are checked at run time"),
+												   llvm::cl::values(clEnumValN(BoundsChecks::Full, "full", "Check every access"),
+																	clEnumValN(BoundsChecks::Hoisted, "hoisted", "Skip proven accesses and check loop accesses once before the loop"),
+																	clEnumValN(BoundsChecks::Off, "off", "No checks")),
+												   llvm::cl::init(BoundsChecks::Hoisted));
+
+static llvm::cl::opt<bool> Verbose("verbose",
+									llvm::cl::desc("Report what the AST optimizations removed"),
+									llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned> Unroll("unroll",
+									  llvm::cl::desc("Unroll factor for counted for/while loops; 0 or 1 disables unrolling"),
+									  llvm::cl::value_desc("k"),
+									  llvm::cl::init(2));
+
+static llvm::cl::opt<unsigned> VectorWidth("vector-width",
+										   llvm::cl::desc("Force the loop vectorization factor; 0 leaves it to the cost model, 1 disables it"),
+										   llvm::cl::value_desc("n"),
+										   llvm::cl::init(0));
+
+static llvm::cl::opt<bool> Autotune("autotune",
+									llvm::cl::desc("Time the program over unroll factors, -O levels and vector widths, and save the fastest next to the source"),
+									llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned> TuneRuns("tune-runs",
+										llvm::cl::desc("Runs per variant when autotuning"),
+										llvm::cl::init(3));
+
+// lex, parse, check, fold, prune, unroll and lower the program, then optimize it per config
+static std::unique_ptr<llvm::Module> buildModule(llvm::StringRef source, const TuneConfig &config,
+												 std::unique_ptr<llvm::LLVMContext> &context)
+{
+	// owns the whole tree; released in one go once the module is built
+	ASTContext Context;
+	ProgramNode *Tree;
+	try
+	{
+		if (PreLex)
+		{
+			TokenStream tokens(source, Context.getIdentifiers());
+			Parser Parser(tokens, Context);
+			Tree = Parser.parseProgram();
+		}
+		else
+		{
+			Lexer lexer(source, Context.getIdentifiers());
+			Parser Parser(lexer, Context);
+			Tree = Parser.parseProgram();
+		}
+	}
+	catch (const std::runtime_error &error)
+	{
+		llvm::errs() << error.what() << "\n";
+		return nullptr;
+	}
+
+	Semantic semantic;
+	if (semantic.semantic(Tree, Context.getIdentifiers()))
+	{
+		llvm::errs() << "Semantic errors occurred...\n";
+		return nullptr;
+	}
+
+	// folding first lets the unroller see constant trip counts
+	foldConstants(Tree, Context);
+	// propagated constants leave dead declarations behind; drop them before unrolling copies them
+	eliminateDeadCode(Tree, Context, Context.getIdentifiers(), Verbose);
+	unrollLoops(Tree, Context, config.unroll);
+
+	CodeGen CodeGenerator;
+	CodeGenOptions options;
+	options.directSSA = DirectSSA;
+	options.boundsChecks = BoundsCheckMode;
+	CodeGenerator.compile(Tree, Context.getIdentifiers(), options);
+	std::unique_ptr<llvm::Module> module = CodeGenerator.takeModule();
+	context = CodeGenerator.takeContext();
+
+	if (!NoOpt && optimizeModule(*module, config.level, Passes, config.unroll > 1, config.vectorWidth))
+		return nullptr;
+	return module;
+}
+
 int main(int argc, const char **argv)
 {
 	// parse command line with builtin llvm function
 	llvm::InitLLVM X(argc, argv);
 	llvm::cl::ParseCommandLineOptions(argc, argv, "MAS-Lang Compiler\n");
 
-	string contentString;
+	// the buffer is mmap-backed for regular files and stays alive for the
+	// whole compilation, so the lexer reads straight out of it
+	std::unique_ptr<llvm::MemoryBuffer> content;
 	llvm::StringRef contentRef;
 
-	if (!FileName.empty()) // if filename is specified
+	if (!FileName.empty()) // if filename is specified ("-" reads stdin)
 	{
-		std::string fileName = FileName;
-
-		// Use llvm::MemoryBuffer::getFile with the fileName
 		llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> fileOrErr =
-			llvm::MemoryBuffer::getFile(fileName);
+			llvm::MemoryBuffer::getFileOrSTDIN(FileName);
 
 		if (auto error = fileOrErr.getError())
 		{
 			llvm::errs() << "Error opening file: " << error.message() << "\n";
 			return 1;
 		}
-		// Use the file content from the MemoryBuffer
-		contentString = (*fileOrErr)->getBuffer().str();
+		content = std::move(*fileOrErr);
+		contentRef = content->getBuffer();
 	}
 	else // if input is given directly
 	{
-		contentString = Input;
+		contentRef = Input;
 	}
 
-	contentRef = contentString;
-	Token nextToken;
-	Lexer lexer(contentRef);
-	Parser Parser(lexer);
-	std::unique_ptr<ProgramNode> TreePtr = Parser.parseProgram();
-	ProgramNode *Tree = TreePtr.get();
+	// a tuned configuration is keyed by the exact source text
+	uint64_t sourceHash = llvm::xxHash64(contentRef);
+	std::string tuneFile = FileName.empty() || FileName == "-" ? "" : FileName + ".tune";
 
-	Semantic semantic;
-	if (semantic.semantic(Tree))
+	TuneConfig config;
+	config.unroll = Unroll;
+	config.level = OptimizationLevel;
+	config.vectorWidth = VectorWidth;
+
+	auto build = [&](const TuneConfig &variant, std::unique_ptr<llvm::LLVMContext> &context) {
+		return buildModule(contentRef, variant, context);
+	};
+
+	if (Autotune)
 	{
-		llvm::errs() << "Semantic errors occurred...\n";
-		return 1;
+		llvm::Optional<TuneResult> best = autotune(build, TuneRuns);
+		if (!best)
+			return 1;
+		if (tuneFile.empty())
+			llvm::errs() << "autotune: input is not a file, nothing saved\n";
+		else if (saveTuneConfig(tuneFile, sourceHash, *best))
+			return 1;
+		return 0;
 	}
 
-	CodeGen CodeGenerator;
-	bool optimize = true;
-	int k = 2;
-	CodeGenerator.compile(Tree, optimize, k);
-	return 0;
+	// explicit flags win over a saved configuration
+	bool explicitConfig = Unroll.getNumOccurrences() || OptimizationLevel.getNumOccurrences() ||
+						  VectorWidth.getNumOccurrences();
+	if (!explicitConfig && !tuneFile.empty())
+		loadTuneConfig(tuneFile, sourceHash, config);
+
+	std::unique_ptr<llvm::LLVMContext> context;
+	std::unique_ptr<llvm::Module> module = build(config, context);
+	if (!module)
+		return 1;
+
+	if (Run)
+		return runJIT(std::move(context), std::move(module));
+
+	return emitModule(*module, Emit, OutputFile) ? 1 : 0;
 }
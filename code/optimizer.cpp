@@ -1,142 +1,339 @@
 #include "optimizer.h"
+#include "ast_walk.h"
+#include "counted_loop.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallVector.h>
 
-Expression *updateExpression(Expression *expression, llvm::StringRef iterator, int increase)
-{
-    if (expression->isVariable() && expression->getValue() == iterator)
-    {
-        return new BinaryOp(BinaryOp::Plus, new Expression(iterator), new Expression(increase));
-    }
-    if (expression->isBinaryOp())
-    {
-        BinaryOp *binaryOp = (BinaryOp *)expression;
-        Expression *left = updateExpression(binaryOp->getLeft(), iterator, increase);
-        Expression *right = updateExpression(binaryOp->getRight(), iterator, increase);
-        return new BinaryOp(binaryOp->getOperator(), left, right);
+using namespace llvm;
+
+namespace {
+// an unrolled body never grows past this many AST nodes
+constexpr int64_t MaxUnrolledCost = 256;
+
+// the guard and trip count only handle a literal or variable bound
+bool isSimpleBound(ASTNode *bound) {
+    return isa<IntLiteral>(bound) || isa<VarRefNode>(bound);
+}
+
+class LoopUnroller {
+    ASTContext &context;
+    unsigned factor;
+
+public:
+    LoopUnroller(ASTContext &ctx, unsigned k) : context(ctx), factor(k) {}
+
+    void run(ProgramNode *program) {
+        program->statements = unrollList(program->statements);
     }
-    if (expression->isBooleanOp())
-    {
-        BooleanOp *booleanOp = (BooleanOp *)expression;
-        Expression *left = updateExpression(booleanOp->getLeft(), iterator, increase);
-        Expression *right = updateExpression(booleanOp->getRight(), iterator, increase);
-        return new BooleanOp(booleanOp->getOperator(), left, right);
+
+private:
+    template <typename T>
+    T *typed(T *node, VarType type) {
+        node->setType(type);
+        return node;
     }
-    return expression;
-}
 
-Statement *updateStatement(Statement *statement, llvm::StringRef iterator, int increase)
-{
-    AssignStatement *assignment = (AssignStatement *)statement;
-    Expression *right = assignment->getRValue();
-    Expression *newRight = updateExpression(right, iterator, increase);
-    return new AssignStatement(assignment->getLValue(), newRight);
-}
+    IntLiteral *intLiteral(int64_t value) {
+        return typed(context.create<IntLiteral>(int(value)), VarType::INT);
+    }
 
-llvm::SmallVector<Statement *> completeUnroll(ForStatement *forStatement, int k){
-    llvm::SmallVector<Statement *> unrolledStatements;
-    llvm::SmallVector<Statement *> body = forStatement->getStatements();
-
-    // Get for variables and constants
-    int initialIterator = forStatement->getInitialAssign()->getRValue()->getNumber();
-    BooleanOp *condition_boolean_op = (BooleanOp *)forStatement->getCondition();
-    int conditionValue = condition_boolean_op->getRight()->getNumber();
-    int conditionValue_arash = conditionValue;
-    if(condition_boolean_op->getOperator() == BooleanOp::LessEqual){
-        conditionValue++;
+    BlockNode *makeBlock(ArrayRef<ASTNode *> statements) {
+        auto *block = context.create<BlockNode>();
+        block->statements = context.copyArray<ASTNode *>(statements);
+        return block;
     }
-    int updateValue = ((BinaryOp *)forStatement->getUpdateAssign()->getRValue())->getRight()->getNumber();
-    if(k>0){
-        llvm::SmallVector<Statement *> newForBody;
-        for(Statement *statement : body){
-            
-            for(int i = 0; i < k; i++){
-                AssignStatement* assignStatement = (AssignStatement *)statement;
-                Statement *newStatement = updateStatement(statement, forStatement->getInitialAssign()->getLValue()->getValue(), i * updateValue);
-                newForBody.push_back(newStatement);
-            }
-        }
-        AssignStatement * newForUpdate = new AssignStatement(forStatement->getUpdateAssign()->getLValue(), new BinaryOp(BinaryOp::Plus, forStatement->getUpdateAssign()->getLValue(), new Expression(k * updateValue)));
-        Expression* newCondition = new BooleanOp(condition_boolean_op->getOperator(), forStatement->getInitialAssign()->getLValue(), new Expression(conditionValue_arash - updateValue));
-        ForStatement* newForStatement = new ForStatement(newCondition, newForBody, forStatement->getInitialAssign(), newForUpdate, Statement::StatementType::For, true);
-        unrolledStatements.push_back(newForStatement);
-        if(conditionValue % (k * updateValue) != 0){
-             body.push_back(forStatement->getUpdateAssign());
-             WhileStatement* afterForStatement = new WhileStatement(forStatement->getCondition(), body, Statement::StatementType::While, true);  
-             unrolledStatements.push_back(afterForStatement);
-         }
-        return unrolledStatements;
+
+    ArrayRef<ASTNode *> unrollList(ArrayRef<ASTNode *> statements) {
+        SmallVector<ASTNode *, 8> result;
+        bool changed = false;
+        ASTNode *prev = nullptr;
+        for (auto *stmt : statements) {
+            unrollNested(stmt);
+            ASTNode *replacement = nullptr;
+            if (auto *loop = dyn_cast<ForLoopNode>(stmt))
+                replacement = unrollFor(loop, prev);
+            else if (auto *loop = dyn_cast<WhileLoopNode>(stmt))
+                replacement = unrollWhile(loop, prev);
+            changed |= replacement != nullptr;
+            result.push_back(replacement ? replacement : stmt);
+            prev = stmt;
+        }
+        return changed ? context.copyArray<ASTNode *>(result) : statements;
     }
-    for (int i = initialIterator; i < conditionValue; i += updateValue){
-        for (Statement *statement : body)
-        {
-            Statement *newStatement = updateStatement(statement, forStatement->getInitialAssign()->getLValue()->getValue(), i);
-            unrolledStatements.push_back(newStatement);
+
+    // inner loops first, so an outer loop is costed on its unrolled body
+    void unrollNested(ASTNode *stmt) {
+        switch (stmt->getKind()) {
+        case ASTNode::NK_Block: {
+            auto *block = cast<BlockNode>(stmt);
+            block->statements = unrollList(block->statements);
+            break;
+        }
+        case ASTNode::NK_IfElse: {
+            auto *ifElse = cast<IfElseNode>(stmt);
+            unrollNested(ifElse->thenBlock);
+            if (ifElse->elseBlock) unrollNested(ifElse->elseBlock);
+            break;
+        }
+        case ASTNode::NK_ForLoop:
+            unrollNested(cast<ForLoopNode>(stmt)->body);
+            break;
+        case ASTNode::NK_WhileLoop:
+            unrollNested(cast<WhileLoopNode>(stmt)->body);
+            break;
+        case ASTNode::NK_ForeachLoop:
+            unrollNested(cast<ForeachLoopNode>(stmt)->body);
+            break;
+        case ASTNode::NK_TryCatch:
+            unrollNested(cast<TryCatchNode>(stmt)->tryBlock);
+            unrollNested(cast<TryCatchNode>(stmt)->catchBlock);
+            break;
+        default:
+            break;
         }
     }
 
-    return unrolledStatements;
-}
+    ASTNode *unrollFor(ForLoopNode *node, ASTNode *prev) {
+        CountedLoop loop;
+        if (!node->update || !matchUpdate(node->update, loop)) return nullptr;
+        if (!matchCondition(node->condition, loop) || !isSimpleBound(loop.bound)) return nullptr;
+        if (mayWrite(node->body, loop.iv)) return nullptr;
+        if (auto *bound = dyn_cast<VarRefNode>(loop.bound))
+            if (mayWrite(node->body, bound->name)) return nullptr;
+        loop.start = startValue(node->init ? node->init : prev, loop.iv);
 
+        ASTNode *iteration[] = {node->body, node->update};
+        auto *remainder = context.create<ForLoopNode>(nullptr, node->condition, node->update, node->body);
+        return unroll(loop, node->init, iteration, remainder);
+    }
 
-llvm::SmallVector<Statement *> completeUnroll(WhileStatement *whileStatement, int k)
-{
-    llvm::SmallVector<Statement *> unrolledStatements;
-    llvm::SmallVector<Statement *> body = whileStatement->getStatements();
-    llvm::SmallVector<Statement *> newBody;
+    ASTNode *unrollWhile(WhileLoopNode *node, ASTNode *prev) {
+        ArrayRef<ASTNode *> body = node->body->statements;
+        CountedLoop loop;
+        if (body.empty() || !matchUpdate(body.back(), loop)) return nullptr;
+        if (!matchCondition(node->condition, loop) || !isSimpleBound(loop.bound)) return nullptr;
+        for (auto *stmt : body.drop_back())
+            if (mayWrite(stmt, loop.iv)) return nullptr;
+        if (auto *bound = dyn_cast<VarRefNode>(loop.bound))
+            if (mayWrite(node->body, bound->name)) return nullptr;
+        loop.start = startValue(prev, loop.iv);
 
-    BooleanOp *condition_boolean_op = (BooleanOp *)whileStatement->getCondition();
-    int conditionValue = condition_boolean_op->getRight()->getNumber();
-    int conditionValue_arash = conditionValue;
-    if(condition_boolean_op->getOperator() == BooleanOp::LessEqual){
-        conditionValue++;
+        ASTNode *iteration[] = {node->body};
+        return unroll(loop, nullptr, iteration, node);
     }
-    llvm::StringRef iteratorVar = condition_boolean_op->getLeft()->getValue();
-    int initialIterator = 0;
-    int updateValue = 0;
-    // find initial value of iterator from the body
-    AssignStatement* updateValueStatement;
-    for(Statement *statement : body){
-        AssignStatement* assignStatement = (AssignStatement *)statement;
-        if(assignStatement->getLValue()->getValue() == iteratorVar){
-            updateValueStatement = assignStatement;
-            updateValue = ((BinaryOp *)assignStatement->getRValue())->getRight()->getNumber();
-            continue;
-        }
-        newBody.push_back(statement);
+
+    // one iteration is `iteration`, in order; `remainder` is the original
+    // loop minus its init, run after the unrolled one when the count is unknown
+    ASTNode *unroll(const CountedLoop &loop, ASTNode *init, ArrayRef<ASTNode *> iteration,
+                    ASTNode *remainder) {
+        int64_t cost = 0;
+        for (auto *stmt : iteration) cost += countNodes(stmt);
+
+        SmallVector<ASTNode *, 16> result;
+        if (init) result.push_back(init);
+
+        Optional<int64_t> trips = loop.tripCount();
+        if (trips && *trips * cost <= MaxUnrolledCost) {
+            appendCopies(result, iteration, *trips);
+            return makeBlock(result);
+        }
+
+        int64_t k = std::min<int64_t>(factor, MaxUnrolledCost / cost);
+        if (k < 2) return nullptr;
+        ASTNode *guard = makeGuard(loop, k);
+        if (!guard) return nullptr;
+
+        SmallVector<ASTNode *, 16> body;
+        appendCopies(body, iteration, k);
+        result.push_back(context.create<WhileLoopNode>(guard, makeBlock(body)));
+        if (trips)
+            appendCopies(result, iteration, *trips % k);
+        else
+            result.push_back(remainder);
+        return makeBlock(result);
     }
 
+    void appendCopies(SmallVectorImpl<ASTNode *> &out, ArrayRef<ASTNode *> iteration, int64_t count) {
+        for (int64_t i = 0; i < count; ++i)
+            for (auto *stmt : iteration) out.push_back(clone(stmt));
+    }
 
-    if(k > 0){
-        llvm::SmallVector<Statement *> newForBody;
-        for(Statement *statement : newBody){
-            for(int i = 0; i < k; i++){
-                AssignStatement* assignStatement = (AssignStatement *)statement;
-                Statement *newStatement = updateStatement(statement, iteratorVar, i * updateValue);
-                newForBody.push_back(newStatement);
-            }
-        }
-        AssignStatement * newForUpdate = new AssignStatement(condition_boolean_op->getLeft(), new BinaryOp(BinaryOp::Plus, condition_boolean_op->getLeft(), new Expression(k * updateValue)));
-        Expression* newCondition = new BooleanOp(condition_boolean_op->getOperator(), condition_boolean_op->getLeft(), new Expression(conditionValue_arash - updateValue));
-        AssignStatement* newInitialAssign = new AssignStatement(condition_boolean_op->getLeft(), new Expression(0));
-        ForStatement* newForStatement = new ForStatement(newCondition, newForBody, newInitialAssign, newForUpdate, Statement::StatementType::For, true);
-        unrolledStatements.push_back(newForStatement);
-        if(conditionValue % (k * updateValue) != 0){
-             newBody.push_back(updateValueStatement);
-             WhileStatement* afterForStatement = new WhileStatement(whileStatement->getCondition(), newBody, Statement::StatementType::While, true);  
-             unrolledStatements.push_back(afterForStatement);
-         }
-        return unrolledStatements;
+    // true while at least k more iterations remain: iv cmp bound - (k-1)*step.
+    // A variable bound is first checked to leave room for the offset, so
+    // the subtraction cannot wrap in i32; near the limits the remainder
+    // loop runs every iteration instead.
+    ASTNode *makeGuard(const CountedLoop &loop, int64_t k) {
+        int64_t offset = (k - 1) * loop.step;
+        BinaryOp cmp = loop.cmp;
+        if (cmp == BinaryOp::NOT_EQUAL)
+            cmp = loop.step > 0 ? BinaryOp::LESS : BinaryOp::GREATER;
+
+        ASTNode *limit;
+        ASTNode *room = nullptr;
+        if (auto *literal = dyn_cast<IntLiteral>(loop.bound)) {
+            int64_t value = literal->value - offset;
+            if (!fitsInt(value)) return nullptr;
+            limit = intLiteral(value);
+        } else {
+            if (!fitsInt(offset)) return nullptr;
+            BinaryOp op = offset > 0 ? BinaryOp::SUBTRACT : BinaryOp::ADD;
+            limit = typed(context.create<BinaryOpNode>(op, clone(loop.bound), intLiteral(std::abs(offset))),
+                          VarType::INT);
+            // bound >= INT32_MIN + offset, or bound <= INT32_MAX + offset
+            room = offset > 0
+                ? context.create<BinaryOpNode>(BinaryOp::GREATER_EQUAL, clone(loop.bound),
+                                               intLiteral(INT32_MIN + offset))
+                : context.create<BinaryOpNode>(BinaryOp::LESS_EQUAL, clone(loop.bound),
+                                               intLiteral(INT32_MAX + offset));
+            typed(room, VarType::BOOL);
+        }
+        auto *iv = typed(context.create<VarRefNode>(loop.iv), VarType::INT);
+        ASTNode *guard = typed(context.create<BinaryOpNode>(cmp, iv, limit), VarType::BOOL);
+        if (room)
+            guard = typed(context.create<BinaryOpNode>(BinaryOp::AND, room, guard), VarType::BOOL);
+        return guard;
+    }
+
+    ArrayRef<ASTNode *> cloneList(ArrayRef<ASTNode *> nodes) {
+        SmallVector<ASTNode *, 8> copies;
+        for (auto *node : nodes) copies.push_back(clone(node));
+        return context.copyArray<ASTNode *>(copies);
+    }
+
+    BlockNode *cloneBlock(BlockNode *block) {
+        if (!block) return nullptr;
+        auto *copy = context.create<BlockNode>();
+        copy->statements = cloneList(block->statements);
+        return copy;
     }
-    for (int i = initialIterator; i < conditionValue; i += updateValue){
-        for (Statement *statement : newBody)
-        {
-            Statement *newStatement = updateStatement(statement, iteratorVar, i);
-            unrolledStatements.push_back(newStatement);
+
+    // deep copy into the arena, keeping the types semantic analysis assigned
+    ASTNode *clone(ASTNode *node) {
+        if (!node) return nullptr;
+        ASTNode *copy = nullptr;
+        switch (node->getKind()) {
+        case ASTNode::NK_Program: {
+            auto *program = context.create<ProgramNode>();
+            program->statements = cloneList(cast<ProgramNode>(node)->statements);
+            copy = program;
+            break;
+        }
+        case ASTNode::NK_VarDecl: {
+            auto *decl = cast<VarDeclNode>(node);
+            copy = context.create<VarDeclNode>(decl->type, decl->name, clone(decl->value));
+            break;
+        }
+        case ASTNode::NK_MultiVarDecl: {
+            SmallVector<VarDeclNode *, 4> decls;
+            for (auto *decl : cast<MultiVarDeclNode>(node)->declarations)
+                decls.push_back(cast<VarDeclNode>(clone(decl)));
+            copy = context.create<MultiVarDeclNode>(context.copyArray<VarDeclNode *>(decls));
+            break;
+        }
+        case ASTNode::NK_Assign: {
+            auto *assign = cast<AssignNode>(node);
+            copy = context.create<AssignNode>(assign->target, assign->op, clone(assign->value));
+            break;
+        }
+        case ASTNode::NK_VarRef:
+            copy = context.create<VarRefNode>(cast<VarRefNode>(node)->name);
+            break;
+        case ASTNode::NK_IntLiteral:
+            copy = context.create<IntLiteral>(cast<IntLiteral>(node)->value);
+            break;
+        case ASTNode::NK_FloatLiteral:
+            copy = context.create<FloatLiteral>(cast<FloatLiteral>(node)->value);
+            break;
+        case ASTNode::NK_BoolLiteral:
+            copy = context.create<BoolLiteral>(cast<BoolLiteral>(node)->value);
+            break;
+        case ASTNode::NK_CharLiteral:
+            copy = context.create<CharLiteral>(cast<CharLiteral>(node)->value);
+            break;
+        case ASTNode::NK_StrLiteral:
+            copy = context.create<StrLiteral>(cast<StrLiteral>(node)->value);
+            break;
+        case ASTNode::NK_BinaryOp: {
+            auto *binary = cast<BinaryOpNode>(node);
+            copy = context.create<BinaryOpNode>(binary->op, clone(binary->left), clone(binary->right));
+            break;
+        }
+        case ASTNode::NK_UnaryOp: {
+            auto *unary = cast<UnaryOpNode>(node);
+            copy = context.create<UnaryOpNode>(unary->op, clone(unary->operand));
+            break;
         }
+        case ASTNode::NK_Block:
+            copy = cloneBlock(cast<BlockNode>(node));
+            break;
+        case ASTNode::NK_IfElse: {
+            auto *ifElse = cast<IfElseNode>(node);
+            copy = context.create<IfElseNode>(clone(ifElse->condition), cloneBlock(ifElse->thenBlock),
+                                              clone(ifElse->elseBlock));
+            break;
+        }
+        case ASTNode::NK_ForLoop: {
+            auto *loop = cast<ForLoopNode>(node);
+            copy = context.create<ForLoopNode>(clone(loop->init), clone(loop->condition),
+                                               clone(loop->update), cloneBlock(loop->body));
+            break;
+        }
+        case ASTNode::NK_WhileLoop: {
+            auto *loop = cast<WhileLoopNode>(node);
+            copy = context.create<WhileLoopNode>(clone(loop->condition), cloneBlock(loop->body));
+            break;
+        }
+        case ASTNode::NK_ForeachLoop: {
+            auto *loop = cast<ForeachLoopNode>(node);
+            copy = context.create<ForeachLoopNode>(loop->varName, clone(loop->collection),
+                                                   cloneBlock(loop->body));
+            break;
+        }
+        case ASTNode::NK_Print:
+            copy = context.create<PrintNode>(clone(cast<PrintNode>(node)->expr));
+            break;
+        case ASTNode::NK_Array:
+            copy = context.create<ArrayNode>(cloneList(cast<ArrayNode>(node)->elements),
+                                             clone(cast<ArrayNode>(node)->count));
+            break;
+        case ASTNode::NK_ArrayAccess: {
+            auto *access = cast<ArrayAccessNode>(node);
+            copy = context.create<ArrayAccessNode>(access->arrayName, clone(access->index));
+            break;
+        }
+        case ASTNode::NK_Concat: {
+            auto *concat = cast<ConcatNode>(node);
+            copy = context.create<ConcatNode>(clone(concat->left), clone(concat->right));
+            break;
+        }
+        case ASTNode::NK_Pow: {
+            auto *pow = cast<PowNode>(node);
+            copy = context.create<PowNode>(clone(pow->base), clone(pow->exponent));
+            break;
+        }
+        case ASTNode::NK_TryCatch: {
+            auto *tryCatch = cast<TryCatchNode>(node);
+            copy = context.create<TryCatchNode>(cloneBlock(tryCatch->tryBlock),
+                                                cloneBlock(tryCatch->catchBlock), tryCatch->errorVar);
+            break;
+        }
+        case ASTNode::NK_Match: {
+            auto *match = cast<MatchNode>(node);
+            copy = context.create<MatchNode>(clone(match->expr), cloneList(match->cases));
+            break;
+        }
+        }
+        copy->setType(node->getType());
+        copy->setElementType(node->getElementType());
+        return copy;
     }
-    return unrolledStatements;
+};
 }
 
-// for(i 0 ta 10){
-// x = x + 1;
-
-// }
+void unrollLoops(ProgramNode *program, ASTContext &context, unsigned factor) {
+    if (factor < 2) return;
+    LoopUnroller(context, factor).run(program);
+}
@@ -1,13 +1,21 @@
 #ifndef OPTIMIZER_H
 #define OPTIMIZER_H
 
-#include "llvm/Support/CommandLine.h"
 #include "AST.h"
+#include "ASTContext.h"
 
-Expression *updateExpression(Expression *expression, llvm::StringRef iterator, int increase);
-Statement *updateStatement(Statement *statement, llvm::StringRef iterator, int increase);
-llvm::SmallVector<Statement*> completeUnroll(ForStatement *forStatement, int k);
-llvm::SmallVector<Statement*> completeUnroll(WhileStatement *whileStatement, int k);
+// Unrolls counted loops in place, innermost first. A loop is counted when
+// it steps one int variable by a constant and compares it against a literal
+// or a variable the body never writes:
+//
+//   for (int i = 0; i < n; i += 2) { ... }
+//   while (i <= 10) { ...; i++; }          // update is the last statement
+//
+// A loop with a known trip count whose fully unrolled body stays small is
+// flattened. Otherwise the body is repeated `factor` times (capped by its
+// size) under a guard that k iterations remain, followed by the original
+// loop, or by straight-line copies when the trip count is known. Runs after
+// semantic analysis; new nodes are allocated in `context` and carry types.
+void unrollLoops(ProgramNode *program, ASTContext &context, unsigned factor);
 
-
-#endif
\ No newline at end of file
+#endif
@@ -1,25 +1,49 @@
 #include "parser.h"
 #include <stdexcept>
 #include <iostream>
-#include <memory>
+#include <string>
+#include <llvm/ADT/SmallVector.h>
 
-Parser::Parser(Lexer &lexer) : lexer(lexer) {
+Parser::Parser(Lexer &lexer, ASTContext &context) : lexer(&lexer), context(context) {
     advance();
     advance();
 }
 
-void Parser::advance() {
+Parser::Parser(const TokenStream &tokens, ASTContext &context) : tokens(&tokens), context(context) {
+    peekTok = tokens.getToken(0);
+    advance();
+}
+
+bool Parser::advance() {
     currentTok = peekTok;
-    peekTok = lexer.nextToken();
+    if (tokens) {
+        currentIndex = peekIndex;
+        // the stream ends in eof; stay there once reached
+        if (peekIndex + 1 < tokens->size()) ++peekIndex;
+        peekTok = tokens->getToken(peekIndex);
+    } else {
+        currentOffset = peekOffset;
+        peekTok = lexer->nextToken();
+        peekOffset = lexer->getTokenOffset();
+    }
+    return true;
+}
+
+// line:column of the current token
+std::string Parser::location() const {
+    auto [line, column] = tokens ? tokens->getLineColumn(currentIndex)
+                                 : lexer->getLineColumn(currentOffset);
+    return std::to_string(line) + ":" + std::to_string(column);
+}
+
+std::runtime_error Parser::syntaxError(const std::string &message) const {
+    return std::runtime_error("Syntax Error: " + message + " at " + location());
 }
 
 void Parser::expect(Token::TokenKind kind) {
     if (!currentTok.is(kind)) {
-        throw std::runtime_error("Syntax Error: Expected " + 
-                                tokenToString(kind) + 
-                                " but found " + 
-                                tokenToString(currentTok.kind) +
-                                " at line " + std::to_string(currentTok.line));
+        throw syntaxError("Expected " + tokenToString(kind) +
+                          " but found " + tokenToString(currentTok.kind));
     }
 }
 
@@ -28,15 +52,17 @@ void Parser::consume(Token::TokenKind kind) {
     advance();
 }
 
-std::unique_ptr<ProgramNode> Parser::parseProgram() {
-    auto program = std::make_unique<ProgramNode>();
+ProgramNode *Parser::parseProgram() {
+    auto *program = context.create<ProgramNode>();
+    llvm::SmallVector<ASTNode *, 32> statements;
     while (!currentTok.is(Token::eof)) {
-        program->statements.push_back(parseStatement());
+        statements.push_back(parseStatement());
     }
+    program->statements = context.copyArray<ASTNode *>(statements);
     return program;
 }
 
-std::unique_ptr<ASTNode> Parser::parseStatement() {
+ASTNode *Parser::parseStatement() {
     switch (currentTok.kind) {
         case Token::KW_int:
         case Token::KW_bool:
@@ -67,287 +93,320 @@ std::unique_ptr<ASTNode> Parser::parseStatement() {
 }
 
 // Variable Declaration
-std::unique_ptr<ASTNode> Parser::parseVarDecl() {
+ASTNode *Parser::parseVarDecl(bool consumeSemi) {
     VarType type = tokenToVarType(currentTok.kind);
     advance();
     
-    std::vector<VarDecl> declarations;
+    llvm::SmallVector<VarDeclNode *, 4> declarations;
     do {
-        std::string name = currentTok.text.str();
+        Identifier name = currentTok.ident;
         consume(Token::identifier);
         
-        std::unique_ptr<ASTNode> value = nullptr;
+        ASTNode *value = nullptr;
         if (currentTok.is(Token::equal)) {
             advance();
             value = parseExpression();
         }
         
-        declarations.emplace_back(type, name, std::move(value));
+        declarations.push_back(context.create<VarDeclNode>(type, name, value));
         
     } while (currentTok.is(Token::comma) && advance());
     
-    consume(Token::semi_colon);
-    return std::make_unique<MultiVarDeclNode>(std::move(declarations));
+    if (consumeSemi) consume(Token::semi_colon);
+    return context.create<MultiVarDeclNode>(context.copyArray<VarDeclNode *>(declarations));
+}
+
+ASTNode *Parser::parseVarDeclOrExpr() {
+    if (currentTok.isOneOf(Token::KW_int, Token::KW_bool, Token::KW_float,
+                           Token::KW_char, Token::KW_string, Token::KW_array)) {
+        return parseVarDecl(false);
+    }
+    return parseExpression();
 }
 
 // If Statement
-std::unique_ptr<ASTNode> Parser::parseIfStatement() {
+ASTNode *Parser::parseIfStatement() {
     consume(Token::KW_if);
     consume(Token::l_paren);
-    auto condition = parseExpression();
+    auto *condition = parseExpression();
     consume(Token::r_paren);
     
-    auto thenBlock = parseBlock();
+    auto *thenBlock = parseBlock();
     
-    std::unique_ptr<ASTNode> elseBlock = nullptr;
+    ASTNode *elseBlock = nullptr;
     if (currentTok.is(Token::KW_else)) {
         advance();
         elseBlock = currentTok.is(Token::KW_if) ? parseIfStatement() : parseBlock();
     }
     
-    return std::make_unique<IfElseNode>(
-        std::move(condition),
-        std::move(thenBlock),
-        std::move(elseBlock)
-    );
+    return context.create<IfElseNode>(condition, thenBlock, elseBlock);
 }
 
 // For Loop
-std::unique_ptr<ASTNode> Parser::parseForLoop() {
+ASTNode *Parser::parseForLoop() {
     consume(Token::KW_for);
     consume(Token::l_paren);
     
     // Initialization
-    std::unique_ptr<ASTNode> init = nullptr;
+    ASTNode *init = nullptr;
     if (!currentTok.is(Token::semi_colon)) {
         init = parseVarDeclOrExpr();
     }
     consume(Token::semi_colon);
     
     // Condition
-    std::unique_ptr<ASTNode> cond = nullptr;
+    ASTNode *cond = nullptr;
     if (!currentTok.is(Token::semi_colon)) {
         cond = parseExpression();
     }
     consume(Token::semi_colon);
     
     // Update
-    std::unique_ptr<ASTNode> update = nullptr;
+    ASTNode *update = nullptr;
     if (!currentTok.is(Token::r_paren)) {
         update = parseExpression();
     }
     consume(Token::r_paren);
     
-    auto body = parseBlock();
+    auto *body = parseBlock();
     
-    return std::make_unique<ForLoopNode>(
-        std::move(init),
-        std::move(cond),
-        std::move(update),
-        std::move(body)
-    );
+    return context.create<ForLoopNode>(init, cond, update, body);
 }
 
 // While Loop
-std::unique_ptr<ASTNode> Parser::parseWhileLoop() {
+ASTNode *Parser::parseWhileLoop() {
     consume(Token::KW_while);
     consume(Token::l_paren);
-    auto condition = parseExpression();
+    auto *condition = parseExpression();
     consume(Token::r_paren);
     
-    auto body = parseBlock();
+    auto *body = parseBlock();
     
-    return std::make_unique<WhileLoopNode>(
-        std::move(condition),
-        std::move(body)
-    );
+    return context.create<WhileLoopNode>(condition, body);
 }
 
 // Print Statement
-std::unique_ptr<ASTNode> Parser::parsePrintStatement() {
+ASTNode *Parser::parsePrintStatement() {
     consume(Token::KW_print);
     consume(Token::l_paren);
-    auto expr = parseExpression();
+    auto *expr = parseExpression();
     consume(Token::r_paren);
     consume(Token::semi_colon);
-    return std::make_unique<PrintNode>(std::move(expr));
+    return context.create<PrintNode>(expr);
+}
+
+ASTNode *Parser::parseExpressionStatement() {
+    auto *expr = parseExpression();
+    consume(Token::semi_colon);
+    return expr;
 }
 
 // Block Statement
-std::unique_ptr<ASTNode> Parser::parseBlock() {
+BlockNode *Parser::parseBlock() {
     consume(Token::l_brace);
-    auto block = std::make_unique<BlockNode>();
+    auto *block = context.create<BlockNode>();
+    llvm::SmallVector<ASTNode *, 8> statements;
     
     while (!currentTok.is(Token::r_brace) && !currentTok.is(Token::eof)) {
-        block->statements.push_back(parseStatement());
+        statements.push_back(parseStatement());
     }
     
     consume(Token::r_brace);
+    block->statements = context.copyArray<ASTNode *>(statements);
     return block;
 }
 
 // Expression Parsing
-std::unique_ptr<ASTNode> Parser::parseExpression() {
+ASTNode *Parser::parseExpression() {
     return parseAssignment();
 }
 
-std::unique_ptr<ASTNode> Parser::parseAssignment() {
-    auto left = parseLogicalOr();
+ASTNode *Parser::parseAssignment() {
+    auto *left = parseLogicalOr();
     
     if (currentTok.isOneOf(Token::equal, Token::plus_equal, Token::minus_equal, 
                           Token::star_equal, Token::slash_equal, Token::mod_equal)) {
-        Token op = currentTok;
+        BinaryOp op;
+        switch (currentTok.kind) {
+            case Token::equal: op = BinaryOp::EQUAL; break;
+            case Token::plus_equal: op = BinaryOp::ADD; break;
+            case Token::minus_equal: op = BinaryOp::SUBTRACT; break;
+            case Token::star_equal: op = BinaryOp::MULTIPLY; break;
+            case Token::slash_equal: op = BinaryOp::DIVIDE; break;
+            default: op = BinaryOp::MOD; break;
+        }
+        auto *target = llvm::dyn_cast<VarRefNode>(left);
+        if (!target) throw syntaxError("Invalid assignment target");
         advance();
-        auto right = parseAssignment();
-        return std::make_unique<AssignmentNode>(std::move(left), op, std::move(right));
+        auto *right = parseAssignment();
+        return context.create<AssignNode>(target->name, op, right);
     }
     
     return left;
 }
 
-std::unique_ptr<ASTNode> Parser::parseLogicalOr() {
-    auto left = parseLogicalAnd();
+ASTNode *Parser::parseLogicalOr() {
+    auto *left = parseLogicalAnd();
     while (currentTok.is(Token::or_op)) {
         advance();
-        auto right = parseLogicalAnd();
-        left = std::make_unique<BinaryOpNode>(BinaryOp::LogicalOr, std::move(left), std::move(right));
+        auto *right = parseLogicalAnd();
+        left = context.create<BinaryOpNode>(BinaryOp::OR, left, right);
     }
     return left;
 }
 
-std::unique_ptr<ASTNode> Parser::parseLogicalAnd() {
-    auto left = parseEquality();
+ASTNode *Parser::parseLogicalAnd() {
+    auto *left = parseEquality();
     while (currentTok.is(Token::and_op)) {
         advance();
-        auto right = parseEquality();
-        left = std::make_unique<BinaryOpNode>(BinaryOp::LogicalAnd, std::move(left), std::move(right));
+        auto *right = parseEquality();
+        left = context.create<BinaryOpNode>(BinaryOp::AND, left, right);
     }
     return left;
 }
 
-std::unique_ptr<ASTNode> Parser::parseEquality() {
-    auto left = parseComparison();
+ASTNode *Parser::parseEquality() {
+    auto *left = parseComparison();
     while (currentTok.isOneOf(Token::equal_equal, Token::not_equal)) {
-        BinaryOp op = currentTok.is(Token::equal_equal) ? BinaryOp::Equal : BinaryOp::NotEqual;
+        BinaryOp op = currentTok.is(Token::equal_equal) ? BinaryOp::EQUAL : BinaryOp::NOT_EQUAL;
         advance();
-        auto right = parseComparison();
-        left = std::make_unique<BinaryOpNode>(op, std::move(left), std::move(right));
+        auto *right = parseComparison();
+        left = context.create<BinaryOpNode>(op, left, right);
     }
     return left;
 }
 
-std::unique_ptr<ASTNode> Parser::parseComparison() {
-    auto left = parseAddSub();
+ASTNode *Parser::parseComparison() {
+    auto *left = parseAddSub();
     while (currentTok.isOneOf(Token::less, Token::less_equal, Token::greater, Token::greater_equal)) {
         BinaryOp op;
         switch (currentTok.kind) {
-            case Token::less: op = BinaryOp::Less; break;
-            case Token::less_equal: op = BinaryOp::LessEqual; break;
-            case Token::greater: op = BinaryOp::Greater; break;
-            case Token::greater_equal: op = BinaryOp::GreaterEqual; break;
-            default: throw std::runtime_error("Invalid comparison operator");
+            case Token::less: op = BinaryOp::LESS; break;
+            case Token::less_equal: op = BinaryOp::LESS_EQUAL; break;
+            case Token::greater: op = BinaryOp::GREATER; break;
+            case Token::greater_equal: op = BinaryOp::GREATER_EQUAL; break;
+            default: throw syntaxError("Invalid comparison operator");
         }
         advance();
-        auto right = parseAddSub();
-        left = std::make_unique<BinaryOpNode>(op, std::move(left), std::move(right));
+        auto *right = parseAddSub();
+        left = context.create<BinaryOpNode>(op, left, right);
     }
     return left;
 }
 
-std::unique_ptr<ASTNode> Parser::parseAddSub() {
-    auto left = parseMulDiv();
+ASTNode *Parser::parseAddSub() {
+    auto *left = parseMulDiv();
     while (currentTok.isOneOf(Token::plus, Token::minus)) {
-        BinaryOp op = currentTok.is(Token::plus) ? BinaryOp::Add : BinaryOp::Subtract;
+        BinaryOp op = currentTok.is(Token::plus) ? BinaryOp::ADD : BinaryOp::SUBTRACT;
         advance();
-        auto right = parseMulDiv();
-        left = std::make_unique<BinaryOpNode>(op, std::move(left), std::move(right));
+        auto *right = parseMulDiv();
+        left = context.create<BinaryOpNode>(op, left, right);
     }
     return left;
 }
 
-std::unique_ptr<ASTNode> Parser::parseMulDiv() {
-    auto left = parseUnary();
+ASTNode *Parser::parseMulDiv() {
+    auto *left = parseUnary();
     while (currentTok.isOneOf(Token::star, Token::slash, Token::mod)) {
         BinaryOp op;
         switch (currentTok.kind) {
-            case Token::star: op = BinaryOp::Multiply; break;
-            case Token::slash: op = BinaryOp::Divide; break;
-            case Token::mod: op = BinaryOp::Modulus; break;
-            default: throw std::runtime_error("Invalid multiplicative operator");
+            case Token::star: op = BinaryOp::MULTIPLY; break;
+            case Token::slash: op = BinaryOp::DIVIDE; break;
+            case Token::mod: op = BinaryOp::MOD; break;
+            default: throw syntaxError("Invalid multiplicative operator");
         }
         advance();
-        auto right = parseUnary();
-        left = std::make_unique<BinaryOpNode>(op, std::move(left), std::move(right));
+        auto *right = parseUnary();
+        left = context.create<BinaryOpNode>(op, left, right);
     }
     return left;
 }
 
-std::unique_ptr<ASTNode> Parser::parseUnary() {
+ASTNode *Parser::parseUnary() {
     if (currentTok.isOneOf(Token::plus, Token::minus, Token::not_op)) {
-        UnaryOp op;
-        switch (currentTok.kind) {
-            case Token::plus: op = UnaryOp::Plus; break;
-            case Token::minus: op = UnaryOp::Minus; break;
-            case Token::not_op: op = UnaryOp::LogicalNot; break;
-            default: throw std::runtime_error("Invalid unary operator");
-        }
+        Token::TokenKind kind = currentTok.kind;
         advance();
-        auto operand = parseUnary();
-        return std::make_unique<UnaryOpNode>(op, std::move(operand));
+        auto *operand = parseUnary();
+        if (kind == Token::plus) return operand;
+        return context.create<UnaryOpNode>(
+            kind == Token::minus ? UnaryOp::MINUS : UnaryOp::NOT, operand);
     }
     return parsePrimary();
 }
 
-std::unique_ptr<ASTNode> Parser::parsePrimary() {
+ASTNode *Parser::parsePrimary() {
     switch (currentTok.kind) {
-        case Token::number:
+        case Token::number: {
+            int value = 0;
+            if (tokens) value = tokens->getIntValue(currentIndex);
+            else currentTok.text.getAsInteger(10, value);
+            advance();
+            return context.create<IntLiteral>(value);
+        }
+
         case Token::float_literal: {
-            auto value = currentTok.text.str();
+            float value = tokens ? tokens->getFloatValue(currentIndex)
+                                 : std::stof(currentTok.text.str());
             advance();
-            return std::make_unique<LiteralNode>(value);
+            return context.create<FloatLiteral>(value);
         }
         
         case Token::string_literal: {
-            auto value = currentTok.text.str();
+            llvm::StringRef value = context.copyString(currentTok.text);
             advance();
-            return std::make_unique<StringLiteralNode>(value);
+            return context.create<StrLiteral>(value);
         }
-        
+
+        case Token::char_literal: {
+            char value = currentTok.text.empty() ? '\0' : currentTok.text[0];
+            advance();
+            return context.create<CharLiteral>(value);
+        }
+
         case Token::KW_true:
         case Token::KW_false: {
             bool value = currentTok.is(Token::KW_true);
             advance();
-            return std::make_unique<BooleanLiteralNode>(value);
+            return context.create<BoolLiteral>(value);
         }
         
         case Token::identifier: {
-            std::string name = currentTok.text.str();
+            Identifier name = currentTok.ident;
             advance();
 
             if (currentTok.is(Token::plus_plus) || currentTok.is(Token::minus_minus)) {
                 Token opTok = currentTok;
                 advance();  // consume ++ or --
-                return std::make_unique<UnaryOpNode>(
+                return context.create<UnaryOpNode>(
                     opTok.is(Token::plus_plus)
                         ? UnaryOp::INCREMENT
                         : UnaryOp::DECREMENT,
-                    std::make_unique<VariableNode>(name)
+                    context.create<VarRefNode>(name)
                 );
             }
 
-            // Function call or array access
-            if (currentTok.is(Token::l_paren)) {
-                return parseFunctionCall(name);
-            } else if (currentTok.is(Token::l_bracket)) {
+            // array access
+            if (currentTok.is(Token::l_bracket)) {
                 return parseArrayAccess(name);
             }
             
-            return std::make_unique<VariableNode>(name);
+            return context.create<VarRefNode>(name);
         }
+
+        // builtins
+        case Token::KW_concat:
+        case Token::KW_pow:
+        case Token::KW_abs:
+        case Token::KW_length:
+        case Token::KW_min:
+        case Token::KW_max:
+        case Token::KW_index:
+        case Token::KW_sum:
+            return parseFunctionCall(currentTok.kind);
         
         case Token::l_paren: {
             advance();
-            auto expr = parseExpression();
+            auto *expr = parseExpression();
             consume(Token::r_paren);
             return expr;
         }
@@ -356,55 +415,79 @@ std::unique_ptr<ASTNode> Parser::parsePrimary() {
             return parseArrayLiteral();
             
         default:
-            throw std::runtime_error("Unexpected primary expression");
+            throw syntaxError("Unexpected primary expression");
     }
 }
 
-std::unique_ptr<ASTNode> Parser::parseArrayLiteral() {
+ASTNode *Parser::parseArrayLiteral() {
     consume(Token::l_bracket);
-    std::vector<std::unique_ptr<ASTNode>> elements;
+    llvm::SmallVector<ASTNode *, 16> elements;
     
     if (!currentTok.is(Token::r_bracket)) {
-        do {
+        elements.push_back(parseExpression());
+        // [value; count]
+        if (currentTok.is(Token::semi_colon)) {
+            advance();
+            auto *count = parseExpression();
+            consume(Token::r_bracket);
+            return context.create<ArrayNode>(context.copyArray<ASTNode *>(elements), count);
+        }
+        while (currentTok.is(Token::comma) && advance()) {
             elements.push_back(parseExpression());
-        } while (currentTok.is(Token::comma) && advance());
+        }
     }
     
     consume(Token::r_bracket);
-    return std::make_unique<ArrayLiteralNode>(std::move(elements));
+    return context.create<ArrayNode>(context.copyArray<ASTNode *>(elements));
 }
 
-std::unique_ptr<ASTNode> Parser::parseArrayAccess(const std::string& name) {
+ASTNode *Parser::parseArrayAccess(Identifier name) {
     consume(Token::l_bracket);
-    auto index = parseExpression();
+    auto *index = parseExpression();
     consume(Token::r_bracket);
-    return std::make_unique<ArrayAccessNode>(name, std::move(index));
+    return context.create<ArrayAccessNode>(name, index);
 }
 
-std::unique_ptr<ASTNode> Parser::parseFunctionCall(const std::string& name) {
+ASTNode *Parser::parseFunctionCall(Token::TokenKind builtin) {
+    advance();
     consume(Token::l_paren);
-    std::vector<std::unique_ptr<ASTNode>> args;
+    llvm::SmallVector<ASTNode *, 2> args;
     
     if (!currentTok.is(Token::r_paren)) {
         do {
             args.push_back(parseExpression());
         } while (currentTok.is(Token::comma) && advance());
     }
-    
+
+    // checked before the ')' is consumed, so the error points at it
+    size_t arity = builtin == Token::KW_concat || builtin == Token::KW_pow ||
+                   builtin == Token::KW_index ? 2 : 1;
+    if (args.size() != arity)
+        throw syntaxError("Wrong number of arguments for builtin");
     consume(Token::r_paren);
-    return std::make_unique<FunctionCallNode>(name, std::move(args));
+
+    switch (builtin) {
+        case Token::KW_concat: return context.create<ConcatNode>(args[0], args[1]);
+        case Token::KW_pow: return context.create<PowNode>(args[0], args[1]);
+        case Token::KW_index: return context.create<BinaryOpNode>(BinaryOp::INDEX, args[0], args[1]);
+        case Token::KW_abs: return context.create<UnaryOpNode>(UnaryOp::ABS, args[0]);
+        case Token::KW_length: return context.create<UnaryOpNode>(UnaryOp::LENGTH, args[0]);
+        case Token::KW_min: return context.create<UnaryOpNode>(UnaryOp::MIN, args[0]);
+        case Token::KW_sum: return context.create<UnaryOpNode>(UnaryOp::SUM, args[0]);
+        default: return context.create<UnaryOpNode>(UnaryOp::MAX, args[0]);
+    }
 }
 
 // Helper Functions
-VarType Parser::tokenToVarType(Token::TokenKind kind) {
+VarType Parser::tokenToVarType(Token::TokenKind kind) const {
     switch (kind) {
-        case Token::KW_int: return VarType::Int;
-        case Token::KW_bool: return VarType::Bool;
-        case Token::KW_float: return VarType::Float;
-        case Token::KW_char: return VarType::Char;
-        case Token::KW_string: return VarType::String;
-        case Token::KW_array: return VarType::Array;
-        default: throw std::runtime_error("Invalid variable type");
+        case Token::KW_int: return VarType::INT;
+        case Token::KW_bool: return VarType::BOOL;
+        case Token::KW_float: return VarType::FLOAT;
+        case Token::KW_char: return VarType::CHAR;
+        case Token::KW_string: return VarType::STRING;
+        case Token::KW_array: return VarType::ARRAY;
+        default: throw syntaxError("Invalid variable type");
     }
 }
 
@@ -80,46 +80,65 @@
 #define PARSER_H
 
 #include "lexer.h"
-#include "ast.h"
-#include <memory>
-#include <vector>
+#include "AST.h"
+#include "ASTContext.h"
+#include <stdexcept>
+#include <string>
 
 class Parser {
-    Lexer &lexer;
+    // exactly one of these is the token source
+    Lexer *lexer = nullptr;
+    const TokenStream *tokens = nullptr;
+    ASTContext &context;
     Token currentTok;
     Token peekTok;
+    size_t currentIndex = 0; // positions in tokens
+    size_t peekIndex = 0;
+    uint32_t currentOffset = 0; // buffer offsets from lexer
+    uint32_t peekOffset = 0;
 
-    void advance();
+    bool advance();
     void expect(Token::TokenKind kind);
     void consume(Token::TokenKind kind);
+    std::string location() const;
+    std::runtime_error syntaxError(const std::string &message) const;
 
 public:
-    Parser(Lexer &lexer);
-    std::unique_ptr<ProgramNode> parseProgram();
+    Parser(Lexer &lexer, ASTContext &context);
+    Parser(const TokenStream &tokens, ASTContext &context);
+    ProgramNode *parseProgram();
 
     // Statement Parsers
-    std::unique_ptr<ASTNode> parseStatement();
-    std::unique_ptr<ASTNode> parseVarDecl();
-    std::unique_ptr<ASTNode> parseIfStatement();
-    std::unique_ptr<ASTNode> parseForLoop();
-    std::unique_ptr<ASTNode> parseWhileLoop();
-    std::unique_ptr<ASTNode> parsePrintStatement();
-    std::unique_ptr<ASTNode> parseBlock();
+    ASTNode *parseStatement();
+    ASTNode *parseVarDecl(bool consumeSemi = true);
+    ASTNode *parseVarDeclOrExpr();
+    ASTNode *parseIfStatement();
+    ASTNode *parseForLoop();
+    ASTNode *parseWhileLoop();
+    ASTNode *parsePrintStatement();
+    ASTNode *parseExpressionStatement();
+    BlockNode *parseBlock();
     
     // Expression Parsers
-    std::unique_ptr<ASTNode> parseExpression();
-    std::unique_ptr<ASTNode> parseLogicalOr();
-    std::unique_ptr<ASTNode> parseLogicalAnd();
-    std::unique_ptr<ASTNode> parseEquality();
-    std::unique_ptr<ASTNode> parseComparison();
-    std::unique_ptr<ASTNode> parseTerm();
-    std::unique_ptr<ASTNode> parseFactor();
-    std::unique_ptr<ASTNode> parseUnary();
-    std::unique_ptr<ASTNode> parsePrimary();
+    ASTNode *parseExpression();
+    ASTNode *parseAssignment();
+    ASTNode *parseLogicalOr();
+    ASTNode *parseLogicalAnd();
+    ASTNode *parseEquality();
+    ASTNode *parseComparison();
+    ASTNode *parseAddSub();
+    ASTNode *parseMulDiv();
+    ASTNode *parseUnary();
+    ASTNode *parsePrimary();
     
     // Special
-    std::unique_ptr<ASTNode> parseArrayLiteral();
-    std::unique_ptr<ASTNode> parseFunctionCall();
+    ASTNode *parseArrayLiteral();
+    ASTNode *parseArrayAccess(Identifier name);
+    ASTNode *parseFunctionCall(Token::TokenKind builtin);
+
+    // Helpers
+    VarType tokenToVarType(Token::TokenKind kind) const;
+    static std::string tokenToString(Token::TokenKind kind);
 };
 
 #endif
@@ -0,0 +1,131 @@
+#include "passes.h"
+#include "emit.h"
+#include <llvm/Analysis/CGSCCPassManager.h>
+#include <llvm/Analysis/LoopAnalysisManager.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/DiagnosticInfo.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+
+namespace {
+OptimizationLevel toPassBuilderLevel(OptLevel level) {
+    switch (level) {
+    case OptLevel::O0: return OptimizationLevel::O0;
+    case OptLevel::O1: return OptimizationLevel::O1;
+    case OptLevel::O2: return OptimizationLevel::O2;
+    case OptLevel::O3: return OptimizationLevel::O3;
+    case OptLevel::Os: return OptimizationLevel::Os;
+    }
+    llvm_unreachable("unknown optimization level");
+}
+
+// a call the vectorizer cannot widen, such as print or an array
+// allocation in the runtime
+bool hasOpaqueCall(const Loop *loop) {
+    for (BasicBlock *block : loop->blocks())
+        for (Instruction &inst : *block)
+            if (isa<CallBase>(inst) && !isa<IntrinsicInst>(inst)) return true;
+    return false;
+}
+
+// attach llvm.loop.vectorize.width to every innermost loop without opaque
+// calls; the vectorizer honours it over its own cost model. Loops with
+// such calls could never be vectorized and would only draw a warning.
+void forceVectorWidth(Module &module, unsigned width) {
+    LLVMContext &context = module.getContext();
+    auto hint = [&](StringRef name, Constant *value) {
+        Metadata *ops[] = {MDString::get(context, name), ConstantAsMetadata::get(value)};
+        return MDNode::get(context, ops);
+    };
+    for (Function &fn : module) {
+        if (fn.isDeclaration()) continue;
+        DominatorTree dominators(fn);
+        LoopInfo loops(dominators);
+        for (Loop *loop : loops.getLoopsInPreorder()) {
+            if (!loop->isInnermost() || hasOpaqueCall(loop)) continue;
+            Metadata *ops[] = {nullptr,
+                               hint("llvm.loop.vectorize.enable", ConstantInt::getBool(context, width > 1)),
+                               hint("llvm.loop.vectorize.width", ConstantInt::get(Type::getInt32Ty(context), width))};
+            MDNode *id = MDNode::getDistinct(context, ops);
+            id->replaceOperandWith(0, id);
+            loop->setLoopID(id);
+        }
+    }
+}
+
+// A forced width makes the vectorizer report every loop it still cannot
+// vectorize, as a remark and as a "failed to perform the requested
+// transformation" warning. The width is a tuning knob, not a demand, so
+// those are dropped while the pipeline runs; everything else goes to the
+// handler that was installed before.
+class VectorHintDiagnostics : public DiagnosticHandler {
+    std::unique_ptr<DiagnosticHandler> previous;
+
+public:
+    explicit VectorHintDiagnostics(LLVMContext &context) : previous(context.getDiagnosticHandler()) {}
+
+    bool handleDiagnostics(const DiagnosticInfo &info) override {
+        switch (info.getKind()) {
+        case DK_OptimizationFailure:
+        case DK_OptimizationRemarkMissed:
+        case DK_OptimizationRemarkAnalysis:
+            return true;
+        default:
+            return previous && previous->handleDiagnostics(info);
+        }
+    }
+
+    // puts the previous handler back; this one is destroyed by the swap
+    static void restore(LLVMContext &context) {
+        std::unique_ptr<DiagnosticHandler> self = context.getDiagnosticHandler();
+        context.setDiagnosticHandler(
+            std::move(static_cast<VectorHintDiagnostics &>(*self).previous));
+    }
+};
+}
+
+bool optimizeModule(Module &module, OptLevel level, StringRef passes, bool unrollLoops,
+                    unsigned vectorWidth) {
+    std::unique_ptr<TargetMachine> machine = createHostMachine(module);
+    if (!machine) return true;
+    if (vectorWidth) forceVectorWidth(module, vectorWidth);
+
+    PipelineTuningOptions tuning;
+    tuning.LoopUnrolling = unrollLoops;
+    tuning.LoopVectorization = level == OptLevel::O2 || level == OptLevel::O3;
+    tuning.SLPVectorization = level == OptLevel::O2 || level == OptLevel::O3;
+
+    PassBuilder builder(machine.get(), tuning);
+    LoopAnalysisManager loopAM;
+    FunctionAnalysisManager functionAM;
+    CGSCCAnalysisManager cgsccAM;
+    ModuleAnalysisManager moduleAM;
+    builder.registerModuleAnalyses(moduleAM);
+    builder.registerCGSCCAnalyses(cgsccAM);
+    builder.registerFunctionAnalyses(functionAM);
+    builder.registerLoopAnalyses(loopAM);
+    builder.crossRegisterProxies(loopAM, functionAM, cgsccAM, moduleAM);
+
+    ModulePassManager pipeline;
+    if (!passes.empty()) {
+        if (Error err = builder.parsePassPipeline(pipeline, passes)) {
+            logAllUnhandledErrors(std::move(err), errs(), "Error in --passes: ");
+            return true;
+        }
+    } else if (level == OptLevel::O0) {
+        pipeline = builder.buildO0DefaultPipeline(OptimizationLevel::O0);
+    } else {
+        pipeline = builder.buildPerModuleDefaultPipeline(toPassBuilderLevel(level));
+    }
+
+    LLVMContext &context = module.getContext();
+    if (vectorWidth) context.setDiagnosticHandler(std::make_unique<VectorHintDiagnostics>(context));
+    pipeline.run(module, moduleAM);
+    if (vectorWidth) VectorHintDiagnostics::restore(context);
+    return false;
+}
@@ -0,0 +1,19 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Module.h>
+
+enum class OptLevel { O0, O1, O2, O3, Os };
+
+// Runs the new-PassManager pipeline over the module, tuned for the host
+// target so the loop and SLP vectorizers see real vector widths. A
+// non-empty `passes` is a textual pipeline ("function(mem2reg,instcombine)")
+// that replaces the default one for `level`. unrollLoops toggles LLVM's
+// own loop unroller. A non-zero vectorWidth pins the vectorization factor
+// of every loop instead of leaving it to the cost model (1 disables loop
+// vectorization). Returns true and reports to errs() on failure.
+bool optimizeModule(llvm::Module &module, OptLevel level, llvm::StringRef passes, bool unrollLoops,
+                    unsigned vectorWidth = 0);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <cstdint>
+
+// Support routines that compiled MAS programs call. They are defined in
+// project_lib.c, rtMAS.c and rtArray.c and linked into the compiler too, so
+// the JIT can bind them in-process.
+extern "C" {
+void print(int v);
+void printBool(int v);
+void mas_write(int v);
+int mas_read(char *s);
+// integer pow; negative exponents truncate toward zero
+int mas_ipow(int base, int exponent);
+// prints msg to stderr and exits with status 1
+void throw_exception(const char *msg);
+// an array of n elements in `bytes` bytes, 64-byte aligned, with its
+// reference count, length and capacity in the 24 bytes before it; reuse is
+// kept when nothing else holds it and it has room
+void *mas_array_alloc(void *reuse, int64_t n, int64_t bytes);
+// one more or one fewer holder of an array or string; the last frees it
+void mas_array_retain(void *a);
+void mas_array_release(void *a);
+// kind is 0 for ints, 1 floats, 2 chars, 3 bools
+void mas_array_print(const void *a, int kind);
+// element-wise array arithmetic; op is 0 add, 1 subtract, 2 multiply, 3 divide
+void mas_array_op(int op, int *dst, const int *lhs, const int *rhs, int64_t n);
+void mas_array_scalar_op(int op, int *dst, const int *array, int scalar, int scalarFirst, int64_t n);
+// reductions; min and max of an empty array are INT_MAX and INT_MIN
+int mas_array_min(const int *a, int64_t n);
+int mas_array_max(const int *a, int64_t n);
+int mas_array_sum(const int *a, int64_t n);
+void mas_array_abs(int *dst, const int *a, int64_t n);
+// the first i with a[i] == value, or -1
+int mas_array_index(const int *a, int value, int64_t n);
+// float, char and bit-packed bool arrays
+float mas_farray_min(const float *a, int64_t n);
+float mas_farray_max(const float *a, int64_t n);
+float mas_farray_sum(const float *a, int64_t n);
+void mas_farray_abs(float *dst, const float *a, int64_t n);
+int mas_farray_index(const float *a, float value, int64_t n);
+signed char mas_carray_min(const signed char *a, int64_t n);
+signed char mas_carray_max(const signed char *a, int64_t n);
+int mas_carray_index(const char *a, int value, int64_t n);
+int mas_barray_count(const uint8_t *bits, int64_t n);
+int mas_barray_index(const uint8_t *bits, int value, int64_t n);
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include <cstdint>
+#include <vector>
+#include "identifier.h"
+
+// Lexically scoped name -> T table. Bindings live in one flat stack with a
+// marker per open scope; each binding remembers the one it shadows, so
+// lookup is a single index and leaving a scope just unwinds its own
+// bindings. Memory is bounded by what is live at the current nesting
+// depth, not by the size of the program.
+template <typename T>
+class ScopedTable {
+    static constexpr uint32_t NoBinding = ~0u;
+
+    struct Binding {
+        uint32_t id;
+        uint32_t shadowed; // previous binding of the same name
+        T value;
+    };
+
+    std::vector<Binding> bindings;
+    std::vector<uint32_t> scopeStarts;
+    std::vector<uint32_t> innermost; // per identifier id
+
+public:
+    explicit ScopedTable(size_t numIdents = 0) : innermost(numIdents, NoBinding) {
+        pushScope();
+    }
+
+    void reset(size_t numIdents) {
+        bindings.clear();
+        scopeStarts.clear();
+        innermost.assign(numIdents, NoBinding);
+        pushScope();
+    }
+
+    void pushScope() { scopeStarts.push_back(bindings.size()); }
+
+    void popScope() {
+        uint32_t start = scopeStarts.back();
+        scopeStarts.pop_back();
+        while (bindings.size() > start) {
+            const Binding &b = bindings.back();
+            innermost[b.id] = b.shadowed;
+            bindings.pop_back();
+        }
+    }
+
+    void bind(Identifier name, T value) {
+        uint32_t id = name.getID();
+        bindings.push_back({id, innermost[id], value});
+        innermost[id] = bindings.size() - 1;
+    }
+
+    // innermost visible binding, or nullptr
+    T *lookup(Identifier name) {
+        uint32_t idx = innermost[name.getID()];
+        return idx == NoBinding ? nullptr : &bindings[idx].value;
+    }
+    const T *lookup(Identifier name) const {
+        uint32_t idx = innermost[name.getID()];
+        return idx == NoBinding ? nullptr : &bindings[idx].value;
+    }
+
+    bool isDeclaredInCurrentScope(Identifier name) const {
+        uint32_t idx = innermost[name.getID()];
+        return idx != NoBinding && idx >= scopeStarts.back();
+    }
+};
+
+#endif
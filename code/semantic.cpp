@@ -1,6 +1,6 @@
 #include "semantic.h"
 #include "AST.h"
-#include "llvm/ADT/StringMap.h"
+#include "scope.h"
 #include "llvm/Support/raw_ostream.h"
 
 
@@ -18,11 +18,28 @@ namespace {
     }
 
     class DeclCheck : public ASTVisitor {
-        llvm::StringMap<VarType> VarTypes;
+        const IdentifierTable &Idents;
+        // declared type of every name visible at the current point, and the
+        // element type of the arrays among them
+        struct Declared {
+            VarType type;
+            VarType element;
+        };
+        ScopedTable<Declared> VarTypes;
         bool HasError = false;
 
+        bool isDeclared(Identifier id) const { return VarTypes.lookup(id) != nullptr; }
+        VarType lookup(Identifier id) const {
+            const Declared *d = VarTypes.lookup(id);
+            return d ? d->type : VarType();
+        }
+        VarType lookupElement(Identifier id) const {
+            const Declared *d = VarTypes.lookup(id);
+            return d ? d->element : VarType::ERROR;
+        }
+
         enum ErrorKind { AlreadyDefined, NotDefined, DivideByZero, TypeMismatch, InvalidOperation };
-        void report(ErrorKind kind, const std::string &msg) {
+        void report(ErrorKind kind, llvm::StringRef msg) {
             switch (kind) {
             case AlreadyDefined:   llvm::errs() << "Error: variable '" << msg << "' already defined\n"; break;
             case NotDefined:       llvm::errs() << "Error: variable '" << msg << "' not defined\n"; break;
@@ -32,108 +49,153 @@ namespace {
             }
             HasError = true;
         }
+        void report(ErrorKind kind, Identifier id) { report(kind, Idents.getName(id)); }
 
 
+        // Visits node once, bottom-up, and returns the type it cached on it
         VarType typeOf(ASTNode *node) {
             if (!node) return VarType::ERROR;
-            // Literals
-            if (auto *i = dynamic_cast<LiteralNode<int>*>(node))    return VarType::INT;
-            if (auto *f = dynamic_cast<LiteralNode<float>*>(node))  return VarType::FLOAT;
-            if (auto *b = dynamic_cast<LiteralNode<bool>*>(node))   return VarType::BOOL;
-            if (auto *c = dynamic_cast<LiteralNode<char>*>(node))   return VarType::CHAR;
-            if (auto *s = dynamic_cast<LiteralNode<std::string>*>(node)) return VarType::STRING;
-            // Variable reference
-            if (auto *v = dynamic_cast<VarRefNode*>(node)) {
-                if (!VarTypes.count(v->name)) {
-                    report(NotDefined, v->name);
-                    return VarType::ERROR;
-                }
-                return VarTypes.lookup(v->name);
+            node->accept(*this);
+            return node->getType();
+        }
+
+        static bool isNumeric(VarType t) { return t == VarType::INT || t == VarType::FLOAT; }
+        static bool isElementType(VarType t) { return isNumeric(t) || t == VarType::BOOL || t == VarType::CHAR; }
+
+        static bool isElementWise(BinaryOp op) {
+            switch (op) {
+            case BinaryOp::ADD: case BinaryOp::SUBTRACT:
+            case BinaryOp::MULTIPLY: case BinaryOp::DIVIDE:
+            case BinaryOp::ARRAY_ADD: case BinaryOp::ARRAY_SUBTRACT:
+            case BinaryOp::ARRAY_MULTIPLY: case BinaryOp::ARRAY_DIVIDE:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // +, -, * and / with an array operand become their ARRAY_ forms
+        static BinaryOp arrayForm(BinaryOp op) {
+            switch (op) {
+            case BinaryOp::ADD: return BinaryOp::ARRAY_ADD;
+            case BinaryOp::SUBTRACT: return BinaryOp::ARRAY_SUBTRACT;
+            case BinaryOp::MULTIPLY: return BinaryOp::ARRAY_MULTIPLY;
+            case BinaryOp::DIVIDE: return BinaryOp::ARRAY_DIVIDE;
+            default: return op;
             }
-            // Binary operations
-            if (auto *bin = dynamic_cast<BinaryOpNode*>(node)) {
-                VarType lt = typeOf(bin->left.get());
-                VarType rt = typeOf(bin->right.get());
-                switch (bin->op) {
-                case BinaryOp::ADD: case BinaryOp::SUBTRACT:
-                case BinaryOp::MULTIPLY: case BinaryOp::DIVIDE: case BinaryOp::MOD:
-                case BinaryOp::POW: {
-                    // numeric or array-scalar or scalar-array
-                    if ((lt==VarType::INT||lt==VarType::FLOAT) && (rt==VarType::INT||rt==VarType::FLOAT))
-                        return (lt==VarType::FLOAT||rt==VarType::FLOAT?VarType::FLOAT:VarType::INT);
-                    if (lt==VarType::ARRAY && (rt==VarType::INT||rt==VarType::FLOAT)) return VarType::ARRAY;
-                    if ((lt==VarType::INT||lt==VarType::FLOAT) && rt==VarType::ARRAY) return VarType::ARRAY;
+        }
+
+        VarType binaryType(BinaryOp op, VarType lt, VarType rt) {
+            switch (op) {
+            case BinaryOp::ADD: case BinaryOp::SUBTRACT:
+            case BinaryOp::MULTIPLY: case BinaryOp::DIVIDE: case BinaryOp::MOD:
+            case BinaryOp::POW:
+            case BinaryOp::ARRAY_ADD: case BinaryOp::ARRAY_SUBTRACT:
+            case BinaryOp::ARRAY_MULTIPLY: case BinaryOp::ARRAY_DIVIDE: {
+                // numeric or array-scalar or scalar-array
+                if (isNumeric(lt) && isNumeric(rt))
+                    return (lt==VarType::FLOAT||rt==VarType::FLOAT?VarType::FLOAT:VarType::INT);
+                // % and pow have no array form
+                if (op==BinaryOp::MOD || op==BinaryOp::POW) {
                     report(InvalidOperation, varTypeName(lt) + std::string(" op ") + varTypeName(rt));
                     return VarType::ERROR;
                 }
-                case BinaryOp::AND: case BinaryOp::OR:
-                    if (lt==VarType::BOOL && rt==VarType::BOOL) return VarType::BOOL;
-                    report(InvalidOperation, "logical"); return VarType::ERROR;
-                case BinaryOp::EQUAL: case BinaryOp::NOT_EQUAL:
-                case BinaryOp::LESS: case BinaryOp::LESS_EQUAL:
-                case BinaryOp::GREATER: case BinaryOp::GREATER_EQUAL:
-                    // comparisons produce bool
-                    if ((lt==VarType::INT||lt==VarType::FLOAT) && (rt==VarType::INT||rt==VarType::FLOAT)) return VarType::BOOL;
-                    if (lt==rt) return VarType::BOOL;
-                    report(TypeMismatch, "compare"); return VarType::ERROR;
-                case BinaryOp::CONCAT:
-                    if (lt==VarType::STRING && rt==VarType::STRING) return VarType::STRING;
-                    report(InvalidOperation, "concat"); return VarType::ERROR;
-                case BinaryOp::INDEX:
-                    if (lt==VarType::ARRAY && rt==VarType::INT) return VarType::ARRAY; // element type infer omitted
-                    report(InvalidOperation, "index"); return VarType::ERROR;
-                default:
-                    return VarType::ERROR;
-                }
+                if (lt==VarType::ARRAY && isNumeric(rt)) return VarType::ARRAY;
+                if (isNumeric(lt) && rt==VarType::ARRAY) return VarType::ARRAY;
+                // element-wise over two arrays of the same length
+                if (lt==VarType::ARRAY && rt==VarType::ARRAY && isElementWise(op)) return VarType::ARRAY;
+                report(InvalidOperation, varTypeName(lt) + std::string(" op ") + varTypeName(rt));
+                return VarType::ERROR;
             }
-            // Unary operations
-            if (auto *un = dynamic_cast<UnaryOpNode*>(node)) {
-                VarType ot = typeOf(un->operand.get());
-                switch (un->op) {
-                case UnaryOp::INCREMENT: case UnaryOp::DECREMENT:
-                    if (ot==VarType::INT||ot==VarType::FLOAT) return ot;
-                    break;
-                case UnaryOp::ABS:
-                    if (ot==VarType::INT||ot==VarType::FLOAT) return ot;
-                    break;
-                case UnaryOp::LENGTH:
-                    if (ot==VarType::ARRAY||ot==VarType::STRING) return VarType::INT;
-                    break;
-                case UnaryOp::MIN: case UnaryOp::MAX:
-                    if (ot==VarType::ARRAY) return VarType::ARRAY;
-                    break;
-                default: break;
-                }
-                report(InvalidOperation, varTypeName(ot));
+            case BinaryOp::AND: case BinaryOp::OR:
+                if (lt==VarType::BOOL && rt==VarType::BOOL) return VarType::BOOL;
+                report(InvalidOperation, "logical"); return VarType::ERROR;
+            case BinaryOp::EQUAL: case BinaryOp::NOT_EQUAL:
+            case BinaryOp::LESS: case BinaryOp::LESS_EQUAL:
+            case BinaryOp::GREATER: case BinaryOp::GREATER_EQUAL:
+                // comparisons produce bool
+                if (isNumeric(lt) && isNumeric(rt)) return VarType::BOOL;
+                // arrays have no comparison; strings compare by their chars
+                if (lt==rt && lt!=VarType::ARRAY) return VarType::BOOL;
+                report(TypeMismatch, "compare"); return VarType::ERROR;
+            case BinaryOp::CONCAT:
+                if (lt==VarType::STRING && rt==VarType::STRING) return VarType::STRING;
+                report(InvalidOperation, "concat"); return VarType::ERROR;
+            case BinaryOp::INDEX:
+                // index(arr, value): position of the first match, or -1
+                if (lt==VarType::ARRAY) return VarType::INT;
+                report(InvalidOperation, "index"); return VarType::ERROR;
+            default:
                 return VarType::ERROR;
             }
-            // Arrays
-            if (auto *arr = dynamic_cast<ArrayNode*>(node)) {
-                if (arr->elements.empty()) return VarType::ARRAY;
-                VarType et = typeOf(arr->elements[0].get());
-                for (auto &e : arr->elements) {
-                    VarType t2 = typeOf(e.get());
-                    if (t2 != et) report(TypeMismatch, "array elements");
-                }
-                return VarType::ARRAY;
+        }
+
+        // arithmetic keeps the element type of its array operands, which
+        // have to agree; a scalar operand is converted to it
+        VarType arrayElementType(ASTNode *left, ASTNode *right) {
+            VarType le = left->getType() == VarType::ARRAY ? left->getElementType() : VarType::NEUTRAL;
+            VarType re = right->getType() == VarType::ARRAY ? right->getElementType() : VarType::NEUTRAL;
+            if (le != VarType::NEUTRAL && re != VarType::NEUTRAL && le != re) {
+                report(TypeMismatch, "array elements");
+                return VarType::ERROR;
             }
-            // Array access
-            if (auto *acc = dynamic_cast<ArrayAccessNode*>(node)) {
-                VarType at = typeOf(acc->index.get());
-                VarType arrt = VarTypes.lookup(acc->arrayName);
-                if (arrt != VarType::ARRAY) report(TypeMismatch, acc->arrayName);
-                if (at != VarType::INT) report(TypeMismatch, "index type");
-                return VarType::ARRAY;
+            VarType et = le != VarType::NEUTRAL ? le : re;
+            if (!isNumeric(et)) {
+                report(InvalidOperation, varTypeName(et) + std::string(" array arithmetic"));
+                return VarType::ERROR;
+            }
+            return et;
+        }
+
+        // builtins over an array: min and max of numbers and chars, sums of
+        // numbers, the count of true elements in a bool array
+        VarType arrayBuiltinType(UnaryOp op, VarType et) {
+            switch (op) {
+            case UnaryOp::LENGTH:
+                return VarType::INT;
+            case UnaryOp::ABS:
+                if (isNumeric(et)) return VarType::ARRAY;
+                break;
+            case UnaryOp::MIN: case UnaryOp::MAX:
+                if (isNumeric(et) || et==VarType::CHAR) return et;
+                break;
+            case UnaryOp::SUM:
+                if (isNumeric(et)) return et;
+                if (et==VarType::BOOL) return VarType::INT;
+                break;
+            default: break;
             }
-            // Print
-            if (auto *p = dynamic_cast<PrintNode*>(node)) {
-                return typeOf(p->expr.get());
+            report(InvalidOperation, varTypeName(et) + std::string(" array"));
+            return VarType::ERROR;
+        }
+
+        VarType unaryType(UnaryOp op, VarType ot) {
+            switch (op) {
+            case UnaryOp::INCREMENT: case UnaryOp::DECREMENT:
+                if (isNumeric(ot)) return ot;
+                break;
+            case UnaryOp::ABS:
+                if (isNumeric(ot)) return ot;
+                break;
+            case UnaryOp::MINUS:
+                if (isNumeric(ot)) return ot;
+                break;
+            case UnaryOp::NOT:
+                if (ot==VarType::BOOL) return ot;
+                break;
+            case UnaryOp::LENGTH:
+                if (ot==VarType::STRING) return VarType::INT;
+                break;
+            default: break;
             }
-            // Default: error
+            report(InvalidOperation, varTypeName(ot));
             return VarType::ERROR;
         }
 
     public:
+        DeclCheck(const IdentifierTable &Idents)
+            : Idents(Idents), VarTypes(Idents.size()) {}
+
         bool hasError() const { return HasError; }
 
         // Program and Block
@@ -141,27 +203,42 @@ namespace {
             for (auto &s : node.statements) s->accept(*this);
         }
         void visit(BlockNode &node) override {
+            VarTypes.pushScope();
             for (auto &s : node.statements) s->accept(*this);
+            VarTypes.popScope();
         }
 
         // Variable declarations
         void visit(MultiVarDeclNode &node) override {
             for (auto &decl : node.declarations) {
-                const std::string &name = decl->name;
-                if (VarTypes.count(name)) report(AlreadyDefined, name);
+                Identifier name = decl->name;
+                // inner blocks may shadow, the same scope may not redeclare
+                // an array without an initializer holds ints
+                VarType element = decl->type == VarType::ARRAY ? VarType::INT : VarType::NEUTRAL;
+                if (VarTypes.isDeclaredInCurrentScope(name)) report(AlreadyDefined, name);
                 else {
-                    VarTypes[name] = decl->type;
-                    if (decl->value) decl->value->accept(*this);
+                    // the initializer cannot see the name it initializes
+                    if (decl->value) {
+                        decl->value->accept(*this);
+                        VarType vt = decl->value->getType();
+                        if (vt == VarType::ARRAY) element = decl->value->getElementType();
+                        // the same rule as assignment: only an int widens, to float
+                        if (vt != VarType::ERROR && vt != decl->type &&
+                            !(decl->type==VarType::FLOAT && vt==VarType::INT))
+                            report(TypeMismatch, name);
+                    }
+                    VarTypes.bind(name, {decl->type, element});
                 }
+                decl->setType(decl->type);
+                decl->setElementType(element);
             }
         }
 
         // Assignments
         void visit(AssignNode &node) override {
-            if (!VarTypes.count(node.target)) report(NotDefined, node.target);
-            node.value->accept(*this);
-            VarType vt = VarTypes.lookup(node.target);
-            VarType rt = typeOf(node.value.get());
+            if (!isDeclared(node.target)) report(NotDefined, node.target);
+            VarType rt = typeOf(node.value);
+            VarType vt = lookup(node.target);
             // Allowed ops per type
             bool ok = false;
             switch (vt) {
@@ -175,88 +252,143 @@ namespace {
             if (!ok) report(InvalidOperation, varTypeName(vt));
             if (rt != vt && !(vt==VarType::FLOAT && rt==VarType::INT))
                 report(TypeMismatch, node.target);
+            // an array variable keeps the element type it was declared with
+            if (vt == VarType::ARRAY && rt == VarType::ARRAY &&
+                node.value->getElementType() != lookupElement(node.target))
+                report(TypeMismatch, node.target);
+            node.setType(vt);
+            node.setElementType(lookupElement(node.target));
         }
 
+        // Literals
+        void visit(IntLiteral &node) override   { node.setType(VarType::INT); }
+        void visit(FloatLiteral &node) override { node.setType(VarType::FLOAT); }
+        void visit(BoolLiteral &node) override  { node.setType(VarType::BOOL); }
+        void visit(CharLiteral &node) override  { node.setType(VarType::CHAR); }
+        void visit(StrLiteral &node) override   { node.setType(VarType::STRING); }
+
         // Variable reference
         void visit(VarRefNode &node) override {
-            if (!VarTypes.count(node.name)) report(NotDefined, node.name);
+            if (!isDeclared(node.name)) {
+                report(NotDefined, node.name);
+                node.setType(VarType::ERROR);
+                return;
+            }
+            node.setType(lookup(node.name));
+            node.setElementType(lookupElement(node.name));
         }
 
         // Binary ops
         void visit(BinaryOpNode &node) override {
-            node.left->accept(*this);
-            node.right->accept(*this);
-            if (node.op == BinaryOp::DIVIDE) {
-                if (auto *lit = dynamic_cast<LiteralNode<int>*>(node.right.get())) {
+            VarType lt = typeOf(node.left);
+            VarType rt = typeOf(node.right);
+            if (node.op == BinaryOp::DIVIDE || node.op == BinaryOp::ARRAY_DIVIDE) {
+                if (auto *lit = llvm::dyn_cast<IntLiteral>(node.right)) {
                     if (lit->value == 0) report(DivideByZero, "");
                 }
             }
-            typeOf(&node);
+            node.setType(binaryType(node.op, lt, rt));
+            if (node.getType() == VarType::ARRAY) {
+                node.op = arrayForm(node.op);
+                VarType et = arrayElementType(node.left, node.right);
+                node.setElementType(et);
+                if (et == VarType::ERROR) node.setType(VarType::ERROR);
+            }
+            if (node.op == BinaryOp::INDEX && lt == VarType::ARRAY) {
+                // the value is compared with the elements; ints also search float arrays
+                VarType et = node.left->getElementType();
+                if (rt != et && !(et==VarType::FLOAT && rt==VarType::INT))
+                    report(TypeMismatch, "index value");
+            }
         }
 
         // Unary ops
         void visit(UnaryOpNode &node) override {
-            node.operand->accept(*this);
-            typeOf(&node);
+            VarType ot = typeOf(node.operand);
+            if (ot != VarType::ARRAY) {
+                node.setType(unaryType(node.op, ot));
+                return;
+            }
+            VarType et = node.operand->getElementType();
+            node.setType(arrayBuiltinType(node.op, et));
+            if (node.getType() == VarType::ARRAY) node.setElementType(et);
         }
 
         // Control structures
         void visit(IfElseNode &node) override {
-            node.condition->accept(*this);
-            if (typeOf(node.condition.get()) != VarType::BOOL)
+            if (typeOf(node.condition) != VarType::BOOL)
                 report(TypeMismatch, "if condition");
             node.thenBlock->accept(*this);
             if (node.elseBlock) node.elseBlock->accept(*this);
         }
         void visit(ForLoopNode &node) override {
+            // a variable declared in the init clause is local to the loop
+            VarTypes.pushScope();
             if (node.init)  node.init->accept(*this);
             if (node.condition) {
-                node.condition->accept(*this);
-                if (typeOf(node.condition.get()) != VarType::BOOL)
+                if (typeOf(node.condition) != VarType::BOOL)
                     report(TypeMismatch, "for condition");
             }
             if (node.update) node.update->accept(*this);
             node.body->accept(*this);
+            VarTypes.popScope();
         }
         void visit(WhileLoopNode &node) override {
-            node.condition->accept(*this);
-            if (typeOf(node.condition.get()) != VarType::BOOL)
+            if (typeOf(node.condition) != VarType::BOOL)
                 report(TypeMismatch, "while condition");
             node.body->accept(*this);
         }
 
         // Print
         void visit(PrintNode &node) override {
-            node.expr->accept(*this);
+            node.setType(typeOf(node.expr));
         }
 
         // Array
         void visit(ArrayNode &node) override {
-            for (auto &e : node.elements) e->accept(*this);
-            typeOf(&node);
+            // the first element decides the element type; an empty array holds ints
+            VarType et = VarType::INT;
+            if (node.count) {
+                if (typeOf(node.count) != VarType::INT) report(TypeMismatch, "array length");
+                if (auto *n = llvm::dyn_cast<IntLiteral>(node.count))
+                    if (n->value < 0) report(InvalidOperation, "negative array length");
+            }
+            if (!node.elements.empty()) {
+                et = typeOf(node.elements[0]);
+                for (auto &e : node.elements.drop_front()) {
+                    if (typeOf(e) != et) report(TypeMismatch, "array elements");
+                }
+                if (!isElementType(et)) report(InvalidOperation, varTypeName(et) + std::string(" array"));
+            }
+            node.setType(VarType::ARRAY);
+            node.setElementType(et);
         }
         void visit(ArrayAccessNode &node) override {
-            node.index->accept(*this);
-            typeOf(&node);
+            VarType at = typeOf(node.index);
+            VarType arrt = lookup(node.arrayName);
+            if (arrt != VarType::ARRAY) report(TypeMismatch, node.arrayName);
+            if (at != VarType::INT) report(TypeMismatch, "index type");
+            // the element, not the array: a[i] + 1 is scalar arithmetic
+            node.setType(arrt == VarType::ARRAY ? lookupElement(node.arrayName) : VarType::ERROR);
         }
 
         // Concat, Pow
         void visit(ConcatNode &node) override {
-            node.left->accept(*this);
-            node.right->accept(*this);
-            typeOf(&node);
+            VarType lt = typeOf(node.left);
+            VarType rt = typeOf(node.right);
+            node.setType(binaryType(BinaryOp::CONCAT, lt, rt));
         }
         void visit(PowNode &node) override {
-            node.base->accept(*this);
-            node.exponent->accept(*this);
-            typeOf(&node);
+            VarType bt = typeOf(node.base);
+            VarType et = typeOf(node.exponent);
+            node.setType(binaryType(BinaryOp::POW, bt, et));
         }
     };
 }
 
-bool Semantic::semantic(ProgramNode *root) {
+bool Semantic::semantic(ProgramNode *root, const IdentifierTable &idents) {
     if (!root) return false;
-    DeclCheck checker;
+    DeclCheck checker(idents);
     root->accept(checker);
     return checker.hasError();
 }
@@ -2,11 +2,12 @@
 #define SEMANTIC_H
 
 #include "AST.h"
+#include "identifier.h"
 
 class Semantic {
 public:
 
-    bool semantic(ProgramNode *root);
+    bool semantic(ProgramNode *root, const IdentifierTable &idents);
 };
 
 #endif 
@@ -0,0 +1,105 @@
+#include "ssa_builder.h"
+#include <cassert>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Constants.h>
+
+using namespace llvm;
+
+unsigned SSABuilder::addVariable(Type *type) {
+    types.push_back(type);
+    currentDef.emplace_back();
+    return types.size() - 1;
+}
+
+void SSABuilder::writeVariable(unsigned var, BasicBlock *block, Value *value) {
+    assert(value->getType() == types[var] && "definition does not match the variable's type");
+    currentDef[var][block] = value;
+}
+
+Value *SSABuilder::readVariable(unsigned var, BasicBlock *block) {
+    auto def = currentDef[var].find(block);
+    if (def != currentDef[var].end() && def->second) return def->second;
+    return readVariableRecursive(var, block);
+}
+
+Value *SSABuilder::readVariableRecursive(unsigned var, BasicBlock *block) {
+    Value *value;
+    if (!sealed.count(block)) {
+        // more predecessors may still come; complete the phi on sealing
+        PHINode *phi = createPhi(var, block);
+        incompletePhis[block].push_back({var, phi});
+        value = phi;
+    } else if (BasicBlock *pred = block->getSinglePredecessor()) {
+        value = readVariable(var, pred);
+    } else {
+        // the phi is recorded first so a cycle through this block ends at it
+        PHINode *phi = createPhi(var, block);
+        writeVariable(var, block, phi);
+        value = addPhiOperands(var, phi);
+    }
+    writeVariable(var, block, value);
+    return value;
+}
+
+PHINode *SSABuilder::createPhi(unsigned var, BasicBlock *block) {
+    if (block->empty()) return PHINode::Create(types[var], 2, "", block);
+    return PHINode::Create(types[var], 2, "", &block->front());
+}
+
+Value *SSABuilder::addPhiOperands(unsigned var, PHINode *phi) {
+    filling.insert(phi);
+    for (BasicBlock *pred : predecessors(phi->getParent())) {
+        phi->addIncoming(readVariable(var, pred), pred);
+    }
+    filling.erase(phi);
+    return tryRemoveTrivialPhi(phi);
+}
+
+// A phi that merges one value (besides itself) is that value. Removing it
+// can make the phis that used it trivial in turn.
+Value *SSABuilder::tryRemoveTrivialPhi(PHINode *phi) {
+    Value *same = nullptr;
+    for (Value *op : phi->incoming_values()) {
+        if (op == same || op == phi) continue;
+        if (same) return phi;
+        same = op;
+    }
+    if (!same) same = UndefValue::get(phi->getType());
+
+    SmallVector<WeakVH, 4> users;
+    for (User *user : phi->users()) {
+        if (user != phi && isa<PHINode>(user)) users.push_back(user);
+    }
+    phi->replaceAllUsesWith(same);
+    phi->eraseFromParent();
+
+    // `same` may itself be one of the users below and be replaced in turn
+    WeakTrackingVH result = same;
+    for (WeakVH &user : users) {
+        // a phi still being filled is checked once its operands are complete
+        auto *userPhi = dyn_cast_or_null<PHINode>(user);
+        if (userPhi && !filling.count(userPhi)) tryRemoveTrivialPhi(userPhi);
+    }
+    return result;
+}
+
+void SSABuilder::sealBlock(BasicBlock *block) {
+    if (!sealed.insert(block).second) return;
+    auto pending = incompletePhis.find(block);
+    if (pending == incompletePhis.end()) return;
+    SmallVector<std::pair<unsigned, PHINode *>, 4> phis = std::move(pending->second);
+    incompletePhis.erase(pending);
+    for (auto &entry : phis) addPhiOperands(entry.first, entry.second);
+}
+
+void SSABuilder::sealAll(Function &func) {
+    for (BasicBlock &block : func) sealBlock(&block);
+}
+
+void SSABuilder::reset() {
+    types.clear();
+    currentDef.clear();
+    incompletePhis.clear();
+    sealed.clear();
+    filling.clear();
+}
@@ -0,0 +1,50 @@
+#ifndef SSA_BUILDER_H
+#define SSA_BUILDER_H
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/ValueHandle.h>
+#include <vector>
+
+// On-the-fly SSA construction after Braun et al., "Simple and Efficient
+// Construction of Static Single Assignment Form" (CC 2013). Writes record
+// the current definition of a variable per block; reads walk up the
+// predecessors and place phis only where definitions meet. A block is
+// sealed once all of its predecessors are known; reads in an unsealed
+// block get an operandless phi that is completed when it is sealed.
+// Phis whose operands are all the same value are folded away again.
+class SSABuilder {
+public:
+    // a new variable of `type`; the handle is an index into this builder
+    unsigned addVariable(llvm::Type *type);
+
+    void writeVariable(unsigned var, llvm::BasicBlock *block, llvm::Value *value);
+    llvm::Value *readVariable(unsigned var, llvm::BasicBlock *block);
+
+    void sealBlock(llvm::BasicBlock *block);
+    // seals whatever the code generator left open
+    void sealAll(llvm::Function &func);
+
+    void reset();
+
+private:
+    std::vector<llvm::Type *> types;
+    // per variable, its current definition in each block; the handles
+    // follow a phi that is folded into another value
+    std::vector<llvm::DenseMap<llvm::BasicBlock *, llvm::WeakTrackingVH>> currentDef;
+    llvm::DenseMap<llvm::BasicBlock *, llvm::SmallVector<std::pair<unsigned, llvm::PHINode *>, 4>> incompletePhis;
+    llvm::SmallPtrSet<llvm::BasicBlock *, 16> sealed;
+    // phis whose operands are being added right now
+    llvm::SmallPtrSet<llvm::PHINode *, 8> filling;
+
+    llvm::Value *readVariableRecursive(unsigned var, llvm::BasicBlock *block);
+    llvm::PHINode *createPhi(unsigned var, llvm::BasicBlock *block);
+    llvm::Value *addPhiOperands(unsigned var, llvm::PHINode *phi);
+    llvm::Value *tryRemoveTrivialPhi(llvm::PHINode *phi);
+};
+
+#endif
@@ -1,17 +1,16 @@
 #!/bin/bash
 
-# Step 1: Navigate to the build directory and run the compiler
+# Step 1: Navigate to the build directory and compile straight to an object file
 cd build/code/
-./compiler "$(cat ../../input.txt)" > compiler.ll
+./compiler -f ../../input.txt --emit=obj -o compiler.o
 
-# Step 2: Compile the support library to an object file, suppressing warnings
+# Step 2: Compile the support libraries to object files, suppressing warnings
 clang -w -c ../../project_lib.c -o lib.o
+clang -w -c ../../rtMAS.c -o rtMAS.o
+clang -w -O2 -c ../../rtArray.c -o rtArray.o
 
-# Step 3: Compile the LLVM IR to an object file, suppressing warnings
-clang -w -c compiler.ll -o compiler.o
+# Step 3: Link the object files to create the executable
+clang compiler.o lib.o rtMAS.o rtArray.o -lm -o executable
 
-# Step 4: Link the object files to create the executable
-clang compiler.o lib.o -o executable
-
-# Step 5: Execute the program
+# Step 4: Execute the program
 ./executable
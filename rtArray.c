@@ -0,0 +1,555 @@
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MAS_X86 1
+#endif
+
+/* Int array kernels for arrays too long to inline as vector IR, or whose
+   length is only known at run time. Each kernel exists for AVX2, SSE2 and
+   plain C; the first call picks the widest set the CPU supports. Integer
+   arithmetic wraps like the scalar operators. */
+
+/* op follows the ARRAY_ operators */
+enum { MAS_ADD, MAS_SUB, MAS_MUL, MAS_DIV };
+
+typedef struct
+{
+    /* dst[i] = lhs[i] op rhs[i]; a scalar operand is read with step 0 */
+    void (*op)(int op, int *dst, const int *lhs, int lhsStep, const int *rhs, int rhsStep, int64_t n);
+    int (*min)(const int *a, int64_t n);
+    int (*max)(const int *a, int64_t n);
+    int (*sum)(const int *a, int64_t n);
+    void (*abs)(int *dst, const int *a, int64_t n);
+    /* the first i with a[i] == value, or -1 */
+    int (*index)(const int *a, int value, int64_t n);
+} ArrayKernels;
+
+static int applyOp(int op, int a, int b)
+{
+    switch (op)
+    {
+    case MAS_ADD: return (int)((unsigned)a + (unsigned)b);
+    case MAS_SUB: return (int)((unsigned)a - (unsigned)b);
+    case MAS_MUL: return (int)((unsigned)a * (unsigned)b);
+    default:      return a / b;
+    }
+}
+
+/* The scalar kernels also finish what the vector ones leave over, from
+   element `from` on. */
+
+static void opFrom(int op, int *dst, const int *lhs, int lhsStep, const int *rhs, int rhsStep,
+                   int64_t from, int64_t n)
+{
+    for (int64_t i = from; i < n; i++)
+        dst[i] = applyOp(op, lhs[i * lhsStep], rhs[i * rhsStep]);
+}
+
+static int minFrom(int best, const int *a, int64_t from, int64_t n)
+{
+    for (int64_t i = from; i < n; i++)
+        best = a[i] < best ? a[i] : best;
+    return best;
+}
+
+static int maxFrom(int best, const int *a, int64_t from, int64_t n)
+{
+    for (int64_t i = from; i < n; i++)
+        best = a[i] > best ? a[i] : best;
+    return best;
+}
+
+static int sumFrom(unsigned total, const int *a, int64_t from, int64_t n)
+{
+    for (int64_t i = from; i < n; i++)
+        total += (unsigned)a[i];
+    return (int)total;
+}
+
+/* INT_MIN stays INT_MIN, as with the scalar abs */
+static void absFrom(int *dst, const int *a, int64_t from, int64_t n)
+{
+    for (int64_t i = from; i < n; i++)
+        dst[i] = a[i] < 0 ? (int)(0u - (unsigned)a[i]) : a[i];
+}
+
+static int indexFrom(const int *a, int value, int64_t from, int64_t n)
+{
+    for (int64_t i = from; i < n; i++)
+        if (a[i] == value)
+            return (int)i;
+    return -1;
+}
+
+static void opScalar(int op, int *dst, const int *lhs, int lhsStep, const int *rhs, int rhsStep, int64_t n)
+{
+    opFrom(op, dst, lhs, lhsStep, rhs, rhsStep, 0, n);
+}
+static int minScalar(const int *a, int64_t n) { return minFrom(INT_MAX, a, 0, n); }
+static int maxScalar(const int *a, int64_t n) { return maxFrom(INT_MIN, a, 0, n); }
+static int sumScalar(const int *a, int64_t n) { return sumFrom(0, a, 0, n); }
+static void absScalar(int *dst, const int *a, int64_t n) { absFrom(dst, a, 0, n); }
+static int indexScalar(const int *a, int value, int64_t n) { return indexFrom(a, value, 0, n); }
+
+static const ArrayKernels scalarKernels = {opScalar, minScalar, maxScalar, sumScalar, absScalar, indexScalar};
+
+#ifdef MAS_X86
+/* SSE2 */
+
+__attribute__((target("sse2")))
+static __m128i load4(const int *p, int step, int64_t i)
+{
+    return step ? _mm_loadu_si128((const __m128i *)(p + i)) : _mm_set1_epi32(*p);
+}
+
+/* SSE2 has no 32-bit mullo: multiply the even and odd lanes as 64-bit
+   products and gather their low halves */
+__attribute__((target("sse2")))
+static __m128i mullo4(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/* nor a signed 32-bit min or max: pick lanes by a compare mask */
+__attribute__((target("sse2")))
+static __m128i select4(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+__attribute__((target("sse2")))
+static void opSSE2(int op, int *dst, const int *lhs, int lhsStep, const int *rhs, int rhsStep, int64_t n)
+{
+    int64_t i = 0;
+    if (op != MAS_DIV)
+    {
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128i a = load4(lhs, lhsStep, i), b = load4(rhs, rhsStep, i);
+            __m128i r = op == MAS_ADD ? _mm_add_epi32(a, b) : op == MAS_SUB ? _mm_sub_epi32(a, b) : mullo4(a, b);
+            _mm_storeu_si128((__m128i *)(dst + i), r);
+        }
+    }
+    opFrom(op, dst, lhs, lhsStep, rhs, rhsStep, i, n);
+}
+
+__attribute__((target("sse2")))
+static int minSSE2(const int *a, int64_t n)
+{
+    __m128i best = _mm_set1_epi32(INT_MAX);
+    int64_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        best = select4(_mm_cmplt_epi32(x, best), x, best);
+    }
+    int lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, best);
+    return minFrom(minFrom(INT_MAX, lanes, 0, 4), a, i, n);
+}
+
+__attribute__((target("sse2")))
+static int maxSSE2(const int *a, int64_t n)
+{
+    __m128i best = _mm_set1_epi32(INT_MIN);
+    int64_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        best = select4(_mm_cmpgt_epi32(x, best), x, best);
+    }
+    int lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, best);
+    return maxFrom(maxFrom(INT_MIN, lanes, 0, 4), a, i, n);
+}
+
+__attribute__((target("sse2")))
+static int sumSSE2(const int *a, int64_t n)
+{
+    __m128i total = _mm_setzero_si128();
+    int64_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        total = _mm_add_epi32(total, _mm_loadu_si128((const __m128i *)(a + i)));
+    int lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, total);
+    return sumFrom((unsigned)sumFrom(0, lanes, 0, 4), a, i, n);
+}
+
+__attribute__((target("sse2")))
+static void absSSE2(int *dst, const int *a, int64_t n)
+{
+    int64_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i sign = _mm_srai_epi32(x, 31);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_sub_epi32(_mm_xor_si128(x, sign), sign));
+    }
+    absFrom(dst, a, i, n);
+}
+
+/* compare four lanes at once and stop at the first block with a match */
+__attribute__((target("sse2")))
+static int indexSSE2(const int *a, int value, int64_t n)
+{
+    __m128i needle = _mm_set1_epi32(value);
+    int64_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(a + i)), needle);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+        if (mask)
+            return (int)(i + __builtin_ctz(mask));
+    }
+    return indexFrom(a, value, i, n);
+}
+
+static const ArrayKernels sse2Kernels = {opSSE2, minSSE2, maxSSE2, sumSSE2, absSSE2, indexSSE2};
+
+/* AVX2 */
+
+__attribute__((target("avx2")))
+static __m256i load8(const int *p, int step, int64_t i)
+{
+    return step ? _mm256_loadu_si256((const __m256i *)(p + i)) : _mm256_set1_epi32(*p);
+}
+
+__attribute__((target("avx2")))
+static void opAVX2(int op, int *dst, const int *lhs, int lhsStep, const int *rhs, int rhsStep, int64_t n)
+{
+    int64_t i = 0;
+    if (op != MAS_DIV)
+    {
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256i a = load8(lhs, lhsStep, i), b = load8(rhs, rhsStep, i);
+            __m256i r = op == MAS_ADD   ? _mm256_add_epi32(a, b)
+                        : op == MAS_SUB ? _mm256_sub_epi32(a, b)
+                                        : _mm256_mullo_epi32(a, b);
+            _mm256_storeu_si256((__m256i *)(dst + i), r);
+        }
+    }
+    opFrom(op, dst, lhs, lhsStep, rhs, rhsStep, i, n);
+}
+
+__attribute__((target("avx2")))
+static int minAVX2(const int *a, int64_t n)
+{
+    __m256i best = _mm256_set1_epi32(INT_MAX);
+    int64_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        best = _mm256_min_epi32(best, _mm256_loadu_si256((const __m256i *)(a + i)));
+    int lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, best);
+    return minFrom(minFrom(INT_MAX, lanes, 0, 8), a, i, n);
+}
+
+__attribute__((target("avx2")))
+static int maxAVX2(const int *a, int64_t n)
+{
+    __m256i best = _mm256_set1_epi32(INT_MIN);
+    int64_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        best = _mm256_max_epi32(best, _mm256_loadu_si256((const __m256i *)(a + i)));
+    int lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, best);
+    return maxFrom(maxFrom(INT_MIN, lanes, 0, 8), a, i, n);
+}
+
+__attribute__((target("avx2")))
+static int sumAVX2(const int *a, int64_t n)
+{
+    __m256i total = _mm256_setzero_si256();
+    int64_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        total = _mm256_add_epi32(total, _mm256_loadu_si256((const __m256i *)(a + i)));
+    int lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, total);
+    return sumFrom((unsigned)sumFrom(0, lanes, 0, 8), a, i, n);
+}
+
+__attribute__((target("avx2")))
+static void absAVX2(int *dst, const int *a, int64_t n)
+{
+    int64_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_abs_epi32(_mm256_loadu_si256((const __m256i *)(a + i))));
+    absFrom(dst, a, i, n);
+}
+
+__attribute__((target("avx2")))
+static int indexAVX2(const int *a, int value, int64_t n)
+{
+    __m256i needle = _mm256_set1_epi32(value);
+    int64_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(a + i)), needle);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+        if (mask)
+            return (int)(i + __builtin_ctz(mask));
+    }
+    return indexFrom(a, value, i, n);
+}
+
+static const ArrayKernels avx2Kernels = {opAVX2, minAVX2, maxAVX2, sumAVX2, absAVX2, indexAVX2};
+#endif
+
+static const ArrayKernels *selectKernels(void)
+{
+#ifdef MAS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &avx2Kernels;
+    if (__builtin_cpu_supports("sse2"))
+        return &sse2Kernels;
+#endif
+    return &scalarKernels;
+}
+
+static const ArrayKernels *kernels;
+
+static const ArrayKernels *getKernels(void)
+{
+    if (!kernels)
+        kernels = selectKernels();
+    return kernels;
+}
+
+/* dst[i] = lhs[i] op rhs[i] */
+void mas_array_op(int op, int *dst, const int *lhs, const int *rhs, int64_t n)
+{
+    getKernels()->op(op, dst, lhs, 1, rhs, 1, n);
+}
+
+/* dst[i] = array[i] op scalar, or scalar op array[i] when scalarFirst */
+void mas_array_scalar_op(int op, int *dst, const int *array, int scalar, int scalarFirst, int64_t n)
+{
+    if (scalarFirst)
+        getKernels()->op(op, dst, &scalar, 0, array, 1, n);
+    else
+        getKernels()->op(op, dst, array, 1, &scalar, 0, n);
+}
+
+/* INT_MAX for an empty array */
+int mas_array_min(const int *a, int64_t n)
+{
+    return getKernels()->min(a, n);
+}
+
+/* INT_MIN for an empty array */
+int mas_array_max(const int *a, int64_t n)
+{
+    return getKernels()->max(a, n);
+}
+
+int mas_array_sum(const int *a, int64_t n)
+{
+    return getKernels()->sum(a, n);
+}
+
+void mas_array_abs(int *dst, const int *a, int64_t n)
+{
+    getKernels()->abs(dst, a, n);
+}
+
+int mas_array_index(const int *a, int value, int64_t n)
+{
+    return getKernels()->index(a, value, n);
+}
+
+/* Float, char and bool arrays. Plain loops: the compiler vectorizes the
+   ones it can, and a float sum stays in element order so it matches the
+   inline code. Bools are packed, element i being bit i % 8 of byte i / 8. */
+
+float mas_farray_min(const float *a, int64_t n)
+{
+    float best = INFINITY;
+    for (int64_t i = 0; i < n; i++)
+        if (a[i] < best)
+            best = a[i];
+    return best;
+}
+
+float mas_farray_max(const float *a, int64_t n)
+{
+    float best = -INFINITY;
+    for (int64_t i = 0; i < n; i++)
+        if (a[i] > best)
+            best = a[i];
+    return best;
+}
+
+float mas_farray_sum(const float *a, int64_t n)
+{
+    float total = 0;
+    for (int64_t i = 0; i < n; i++)
+        total += a[i];
+    return total;
+}
+
+void mas_farray_abs(float *dst, const float *a, int64_t n)
+{
+    for (int64_t i = 0; i < n; i++)
+        dst[i] = fabsf(a[i]);
+}
+
+int mas_farray_index(const float *a, float value, int64_t n)
+{
+    for (int64_t i = 0; i < n; i++)
+        if (a[i] == value)
+            return (int)i;
+    return -1;
+}
+
+signed char mas_carray_min(const signed char *a, int64_t n)
+{
+    signed char best = SCHAR_MAX;
+    for (int64_t i = 0; i < n; i++)
+        if (a[i] < best)
+            best = a[i];
+    return best;
+}
+
+signed char mas_carray_max(const signed char *a, int64_t n)
+{
+    signed char best = SCHAR_MIN;
+    for (int64_t i = 0; i < n; i++)
+        if (a[i] > best)
+            best = a[i];
+    return best;
+}
+
+int mas_carray_index(const char *a, int value, int64_t n)
+{
+    const char *match = memchr(a, value, (size_t)n);
+    return match ? (int)(match - a) : -1;
+}
+
+/* the number of set bits among the first n */
+int mas_barray_count(const uint8_t *bits, int64_t n)
+{
+    int64_t words = n / 64, count = 0;
+    for (int64_t w = 0; w < words; w++)
+    {
+        uint64_t word;
+        memcpy(&word, bits + w * 8, sizeof word);
+        count += __builtin_popcountll(word);
+    }
+    for (int64_t i = words * 64; i < n; i++)
+        count += bits[i / 8] >> (i % 8) & 1;
+    return (int)count;
+}
+
+/* the first i whose bit equals value, or -1 */
+int mas_barray_index(const uint8_t *bits, int value, int64_t n)
+{
+    uint64_t flip = value ? 0 : ~(uint64_t)0;
+    int64_t words = n / 64;
+    for (int64_t w = 0; w < words; w++)
+    {
+        uint64_t word;
+        memcpy(&word, bits + w * 8, sizeof word);
+        word ^= flip;
+        if (word)
+            return (int)(w * 64 + __builtin_ctzll(word));
+    }
+    for (int64_t i = words * 64; i < n; i++)
+        if ((bits[i / 8] >> (i % 8) & 1) == (value != 0))
+            return (int)i;
+    return -1;
+}
+
+/* An array points at its first element, which is 64-byte aligned; its
+   reference count, its length in elements and its capacity in bytes sit in
+   the 24 bytes before it. A string is a char array ending in a NUL. The
+   count of a stack slot or a constant is negative, and it is never changed
+   or freed. */
+enum { MAS_ARRAY_ALIGN = 64 };
+
+typedef struct
+{
+    int64_t refs;
+    int64_t length;
+    int64_t capacity;
+} ArrayHeader;
+
+static ArrayHeader *headerOf(const void *a)
+{
+    return (ArrayHeader *)a - 1;
+}
+
+void mas_array_retain(void *a)
+{
+    if (a && headerOf(a)->refs > 0)
+        headerOf(a)->refs++;
+}
+
+void mas_array_release(void *a)
+{
+    if (a && headerOf(a)->refs > 0 && --headerOf(a)->refs == 0)
+        free((char *)a - MAS_ARRAY_ALIGN);
+}
+
+/* An array of n elements taking `bytes` bytes for an allocation site,
+   which holds a reference to `reuse`, the buffer it got last. When nothing
+   else holds that buffer and it has room it is refilled in place. When a
+   variable still holds it, refilling would write to a shared array: the
+   site lets go of it and takes a fresh buffer instead of a copy, since the
+   caller overwrites every element anyway. */
+void *mas_array_alloc(void *reuse, int64_t n, int64_t bytes)
+{
+    if (reuse)
+    {
+        if (headerOf(reuse)->refs == 1 && headerOf(reuse)->capacity >= bytes)
+        {
+            headerOf(reuse)->length = n;
+            return reuse;
+        }
+        mas_array_release(reuse);
+    }
+    int64_t capacity = (bytes + MAS_ARRAY_ALIGN - 1) / MAS_ARRAY_ALIGN * MAS_ARRAY_ALIGN;
+    char *block = aligned_alloc(MAS_ARRAY_ALIGN, MAS_ARRAY_ALIGN + capacity);
+    if (!block)
+    {
+        fprintf(stderr, "Out of memory for an array of %lld elements\n", (long long)n);
+        exit(1);
+    }
+    void *a = block + MAS_ARRAY_ALIGN;
+    headerOf(a)->refs = 1;
+    headerOf(a)->length = n;
+    headerOf(a)->capacity = capacity;
+    return a;
+}
+
+/* element kinds of mas_array_print */
+enum { MAS_INT, MAS_FLOAT, MAS_CHAR, MAS_BOOL };
+
+/* prints [1, 2, 3], with elements formatted like print() formats scalars */
+void mas_array_print(const void *a, int kind)
+{
+    int64_t n = headerOf(a)->length;
+    putchar('[');
+    for (int64_t i = 0; i < n; i++)
+    {
+        if (i)
+            fputs(", ", stdout);
+        switch (kind)
+        {
+        case MAS_FLOAT: printf("%f", ((const float *)a)[i]); break;
+        case MAS_CHAR:  putchar(((const char *)a)[i]); break;
+        case MAS_BOOL:  fputs(((const uint8_t *)a)[i / 8] >> (i % 8) & 1 ? "true" : "false", stdout); break;
+        default:        printf("%d", ((const int *)a)[i]); break;
+        }
+    }
+    puts("]");
+}
@@ -18,4 +18,32 @@ int mas_read(char *s)
         exit(1);
     }
     return val;
-}  
\ No newline at end of file
+}
+
+/* base ** exponent by square-and-multiply, wrapping like repeated int
+   multiplies (the constant folder computes it the same way); a negative
+   exponent truncates toward zero like 1 / base ** -exponent */
+int mas_ipow(int base, int exponent)
+{
+    unsigned result = 1, square = (unsigned)base;
+    if (exponent < 0)
+    {
+        if (base == 1) return 1;
+        if (base == -1) return exponent % 2 ? -1 : 1;
+        return 0;
+    }
+    for (unsigned n = (unsigned)exponent; n; n >>= 1)
+    {
+        if (n & 1) result *= square;
+        square *= square;
+    }
+    return (int)result;
+}
+
+/* a failed run-time check; compiled code never returns from here */
+void throw_exception(const char *msg)
+{
+    fflush(stdout);
+    fprintf(stderr, "Error: %s\n", msg);
+    exit(1);
+}
@@ -0,0 +1,97 @@
+// Per-node cost of AST dispatch on a large, expression-heavy program.
+// "switch" classifies each node with one switch on its NodeKind, the way
+// Semantic and CodeGen dispatch now. "chain" tests the node against one
+// type after another, in the order the dynamic_cast chains in
+// generateValue used to. The build has no RTTI, so the chain uses isa<>
+// and shows what the sequential tests cost; dispatch_rtti_bench measures
+// real dynamic_cast chains.
+
+#include "ASTContext.h"
+#include "ast_walk.h"
+#include "dispatch_program.h"
+#include "lexer.h"
+#include "parser.h"
+#include <chrono>
+#include <string>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+
+static cl::opt<unsigned> Size("size", cl::desc("Statements in the generated program"), cl::init(50000));
+static cl::opt<unsigned> Repeats("repeat", cl::desc("Walks per dispatch; the best counts"), cl::init(10));
+
+static unsigned classifySwitch(ASTNode *node) {
+    switch (node->getKind()) {
+    case ASTNode::NK_BinaryOp: return 1;
+    case ASTNode::NK_VarRef: return 2;
+    case ASTNode::NK_IntLiteral: return 3;
+    case ASTNode::NK_FloatLiteral: return 4;
+    case ASTNode::NK_BoolLiteral: return 5;
+    case ASTNode::NK_CharLiteral: return 6;
+    case ASTNode::NK_StrLiteral: return 7;
+    case ASTNode::NK_Concat: return 8;
+    case ASTNode::NK_Array: return 9;
+    case ASTNode::NK_ArrayAccess: return 10;
+    case ASTNode::NK_UnaryOp: return 11;
+    case ASTNode::NK_Pow: return 12;
+    default: return 0;
+    }
+}
+
+static unsigned classifyChain(ASTNode *node) {
+    if (isa<BinaryOpNode>(node)) return 1;
+    if (isa<VarRefNode>(node)) return 2;
+    if (isa<IntLiteral>(node)) return 3;
+    if (isa<FloatLiteral>(node)) return 4;
+    if (isa<BoolLiteral>(node)) return 5;
+    if (isa<CharLiteral>(node)) return 6;
+    if (isa<StrLiteral>(node)) return 7;
+    if (isa<ConcatNode>(node)) return 8;
+    if (isa<ArrayNode>(node)) return 9;
+    if (isa<ArrayAccessNode>(node)) return 10;
+    if (isa<UnaryOpNode>(node)) return 11;
+    if (isa<PowNode>(node)) return 12;
+    return 0;
+}
+
+// the nodes in walk order, so both dispatches see the same sequence
+static void flatten(ASTNode *node, std::vector<ASTNode *> &out) {
+    out.push_back(node);
+    SmallVector<ASTNode *, 4> children;
+    getChildren(node, children);
+    for (auto *child : children) flatten(child, out);
+}
+
+template <typename Fn>
+static void measure(StringRef name, const std::vector<ASTNode *> &nodes, Fn classify) {
+    double best = 0;
+    unsigned checksum = 0;
+    for (unsigned i = 0; i < Repeats; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        unsigned sum = 0;
+        for (ASTNode *node : nodes) sum += classify(node);
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+        if (i == 0 || elapsed.count() < best) best = elapsed.count();
+        checksum = sum;
+    }
+    outs() << format("%-8s %6.2f ns/node  (checksum %u)\n", name.str().c_str(), best / nodes.size(), checksum);
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "MAS AST dispatch benchmark\n");
+    std::string source = makeDispatchProgram(Size);
+
+    ASTContext context;
+    Lexer lexer(source, context.getIdentifiers());
+    Parser parser(lexer, context);
+    ProgramNode *program = parser.parseProgram();
+
+    std::vector<ASTNode *> nodes;
+    flatten(program, nodes);
+    outs() << nodes.size() << " nodes\n";
+    measure("switch", nodes, classifySwitch);
+    measure("chain", nodes, classifyChain);
+    return 0;
+}
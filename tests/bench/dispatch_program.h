@@ -0,0 +1,19 @@
+#ifndef DISPATCH_PROGRAM_H
+#define DISPATCH_PROGRAM_H
+
+#include <string>
+
+// Large, expression-heavy program shared by the dispatch benchmarks, so
+// they all walk the same node sequence.
+inline std::string makeDispatchProgram(unsigned statements) {
+    std::string text = "int v0 = 1;\nfloat f = 0.5;\n";
+    for (unsigned i = 1; i < statements; ++i) {
+        std::string prev = "v" + std::to_string(i - 1);
+        text += "int v" + std::to_string(i) + " = (" + prev + " * 3 + " + std::to_string(i) +
+                ") % 7 - abs(" + prev + " - 2) + pow(" + prev + ", 2);\n";
+        if (i % 8 == 0) text += "if (" + prev + " > 3 and f < 2.5) { print(" + prev + "); }\n";
+    }
+    return text;
+}
+
+#endif
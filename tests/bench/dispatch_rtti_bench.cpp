@@ -0,0 +1,136 @@
+// Baseline for dispatch_bench: the same classification done with
+// dynamic_cast chains, the way generateValue dispatched before NodeKind.
+// The AST has no RTTI, so each node is mirrored by an object of a
+// polymorphic class per kind, and this file alone is built with -frtti.
+// "switch" classifies the same mirror objects by a kind field, so both
+// loops touch the same memory. Nothing here may give an LLVM class a
+// vtable (cl::opt, format), since LLVM itself is built without RTTI.
+
+#include "ASTContext.h"
+#include "ast_walk.h"
+#include "dispatch_program.h"
+#include "lexer.h"
+#include "parser.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct MirrorNode {
+    ASTNode::NodeKind kind;
+    explicit MirrorNode(ASTNode::NodeKind kind) : kind(kind) {}
+    virtual ~MirrorNode() = default;
+};
+
+// one class per kind, each directly below the base like the AST classes
+template <ASTNode::NodeKind K> struct Mirror : MirrorNode {
+    Mirror() : MirrorNode(K) {}
+};
+
+static std::unique_ptr<MirrorNode> mirror(ASTNode::NodeKind kind) {
+    switch (kind) {
+#define MIRROR(K) case ASTNode::K: return std::make_unique<Mirror<ASTNode::K>>();
+    MIRROR(NK_Program) MIRROR(NK_VarDecl) MIRROR(NK_MultiVarDecl) MIRROR(NK_Assign)
+    MIRROR(NK_VarRef) MIRROR(NK_IntLiteral) MIRROR(NK_FloatLiteral) MIRROR(NK_BoolLiteral)
+    MIRROR(NK_CharLiteral) MIRROR(NK_StrLiteral) MIRROR(NK_BinaryOp) MIRROR(NK_UnaryOp)
+    MIRROR(NK_Block) MIRROR(NK_IfElse) MIRROR(NK_ForLoop) MIRROR(NK_WhileLoop)
+    MIRROR(NK_ForeachLoop) MIRROR(NK_Print) MIRROR(NK_Array) MIRROR(NK_ArrayAccess)
+    MIRROR(NK_Concat) MIRROR(NK_Pow) MIRROR(NK_TryCatch) MIRROR(NK_Match)
+#undef MIRROR
+    }
+    std::abort();
+}
+
+static unsigned classifySwitch(MirrorNode *node) {
+    switch (node->kind) {
+    case ASTNode::NK_BinaryOp: return 1;
+    case ASTNode::NK_VarRef: return 2;
+    case ASTNode::NK_IntLiteral: return 3;
+    case ASTNode::NK_FloatLiteral: return 4;
+    case ASTNode::NK_BoolLiteral: return 5;
+    case ASTNode::NK_CharLiteral: return 6;
+    case ASTNode::NK_StrLiteral: return 7;
+    case ASTNode::NK_Concat: return 8;
+    case ASTNode::NK_Array: return 9;
+    case ASTNode::NK_ArrayAccess: return 10;
+    case ASTNode::NK_UnaryOp: return 11;
+    case ASTNode::NK_Pow: return 12;
+    default: return 0;
+    }
+}
+
+template <ASTNode::NodeKind K> static bool is(MirrorNode *node) {
+    return dynamic_cast<Mirror<K> *>(node) != nullptr;
+}
+
+static unsigned classifyDynamicCast(MirrorNode *node) {
+    if (is<ASTNode::NK_BinaryOp>(node)) return 1;
+    if (is<ASTNode::NK_VarRef>(node)) return 2;
+    if (is<ASTNode::NK_IntLiteral>(node)) return 3;
+    if (is<ASTNode::NK_FloatLiteral>(node)) return 4;
+    if (is<ASTNode::NK_BoolLiteral>(node)) return 5;
+    if (is<ASTNode::NK_CharLiteral>(node)) return 6;
+    if (is<ASTNode::NK_StrLiteral>(node)) return 7;
+    if (is<ASTNode::NK_Concat>(node)) return 8;
+    if (is<ASTNode::NK_Array>(node)) return 9;
+    if (is<ASTNode::NK_ArrayAccess>(node)) return 10;
+    if (is<ASTNode::NK_UnaryOp>(node)) return 11;
+    if (is<ASTNode::NK_Pow>(node)) return 12;
+    return 0;
+}
+
+// the nodes in walk order, as dispatch_bench sees them
+static void flatten(ASTNode *node, std::vector<std::unique_ptr<MirrorNode>> &out) {
+    out.push_back(mirror(node->getKind()));
+    llvm::SmallVector<ASTNode *, 4> children;
+    getChildren(node, children);
+    for (auto *child : children) flatten(child, out);
+}
+
+template <typename Fn>
+static void measure(const char *name, const std::vector<MirrorNode *> &nodes, unsigned repeats,
+                    Fn classify) {
+    double best = 0;
+    unsigned checksum = 0;
+    for (unsigned i = 0; i < repeats; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        unsigned sum = 0;
+        for (MirrorNode *node : nodes) sum += classify(node);
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+        if (i == 0 || elapsed.count() < best) best = elapsed.count();
+        checksum = sum;
+    }
+    std::printf("%-12s %6.2f ns/node  (checksum %u)\n", name, best / nodes.size(), checksum);
+}
+
+// --size=N and --repeat=N, as in dispatch_bench
+static unsigned option(int argc, char **argv, const char *name, unsigned value) {
+    size_t length = std::strlen(name);
+    for (int i = 1; i < argc; ++i)
+        if (std::strncmp(argv[i], name, length) == 0 && argv[i][length] == '=')
+            value = std::strtoul(argv[i] + length + 1, nullptr, 10);
+    return value;
+}
+
+int main(int argc, char **argv) {
+    unsigned size = option(argc, argv, "--size", 50000);
+    unsigned repeats = option(argc, argv, "--repeat", 10);
+    std::string source = makeDispatchProgram(size);
+
+    ASTContext context;
+    Lexer lexer(source, context.getIdentifiers());
+    Parser parser(lexer, context);
+    ProgramNode *program = parser.parseProgram();
+
+    std::vector<std::unique_ptr<MirrorNode>> owned;
+    flatten(program, owned);
+    std::vector<MirrorNode *> nodes;
+    for (auto &node : owned) nodes.push_back(node.get());
+    std::printf("%zu nodes\n", nodes.size());
+    measure("switch", nodes, repeats, classifySwitch);
+    measure("dynamic_cast", nodes, repeats, classifyDynamicCast);
+    return 0;
+}
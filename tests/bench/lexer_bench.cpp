@@ -0,0 +1,145 @@
+// Lexer throughput on identifier-heavy input, in MB/s, for the
+// token-at-a-time Lexer and the pre-lexed TokenStream. Identifiers are
+// the common case, and many of them start like a keyword or share its
+// length, which is what keyword recognition has to reject quickly; the
+// words of the input are also classified on their own, by keywordKind
+// and by the compare chain the lexer used before it.
+
+#include "char_class.h"
+#include "lexer.h"
+#include <chrono>
+#include <string>
+#include <vector>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+
+static cl::opt<unsigned> SizeMB("size", cl::desc("Input size in MB"), cl::init(16));
+static cl::opt<unsigned> Repeats("repeat", cl::desc("Runs per lexer; the best counts"), cl::init(5));
+
+static std::string makeInput(size_t bytes) {
+    static const char *const names[] = {
+        "index", "indices", "printer", "in", "iffy", "format", "floaty", "whiled",
+        "counter", "total_sum", "x", "y2", "strings", "charge", "arrays", "maxim",
+        "length_of", "tryhard", "matched", "sum_all", "powder", "absent", "concat2",
+    };
+    const size_t count = sizeof(names) / sizeof(names[0]);
+    std::string text;
+    text.reserve(bytes + 128);
+    for (size_t i = 0; text.size() < bytes; ++i) {
+        text += "int ";
+        text += names[i % count];
+        text += " = ";
+        text += names[(i * 7 + 3) % count];
+        text += " + ";
+        text += names[(i * 5 + 1) % count];
+        text += " * 42; if (";
+        text += names[(i * 3 + 2) % count];
+        text += " < 10) { print(";
+        text += names[(i * 11 + 4) % count];
+        text += "); }\n";
+    }
+    return text;
+}
+
+// one string compare after another, in the order of the old lexer
+static Token::TokenKind keywordChain(StringRef text) {
+    if (text == "int") return Token::KW_int;
+    if (text == "bool") return Token::KW_bool;
+    if (text == "float") return Token::KW_float;
+    if (text == "char") return Token::KW_char;
+    if (text == "string") return Token::KW_string;
+    if (text == "array") return Token::KW_array;
+    if (text == "if") return Token::KW_if;
+    if (text == "else") return Token::KW_else;
+    if (text == "while") return Token::KW_while;
+    if (text == "for") return Token::KW_for;
+    if (text == "foreach") return Token::KW_foreach;
+    if (text == "in") return Token::KW_in;
+    if (text == "print") return Token::KW_print;
+    if (text == "true") return Token::KW_true;
+    if (text == "false") return Token::KW_false;
+    if (text == "try") return Token::KW_try;
+    if (text == "catch") return Token::KW_catch;
+    if (text == "error") return Token::KW_error;
+    if (text == "match") return Token::KW_match;
+    if (text == "concat") return Token::KW_concat;
+    if (text == "pow") return Token::KW_pow;
+    if (text == "abs") return Token::KW_abs;
+    if (text == "length") return Token::KW_length;
+    if (text == "min") return Token::KW_min;
+    if (text == "max") return Token::KW_max;
+    if (text == "and") return Token::and_op;
+    if (text == "or") return Token::or_op;
+    if (text == "not") return Token::not_op;
+    if (text == "index") return Token::KW_index;
+    if (text == "sum") return Token::KW_sum;
+    return Token::identifier;
+}
+
+// the identifier-shaped words of the input, keywords included
+static std::vector<StringRef> splitWords(const std::string &input) {
+    std::vector<StringRef> words;
+    const char *p = input.data(), *end = p + input.size();
+    while (p < end) {
+        if (charclass::isAlpha(*p)) {
+            const char *wordEnd = charclass::skipIdentBody(p + 1, end);
+            words.emplace_back(p, wordEnd - p);
+            p = wordEnd;
+        } else {
+            ++p;
+        }
+    }
+    return words;
+}
+
+// best of Repeats runs of `run` over `bytes` of input; `run` returns a
+// count that is printed so the work cannot be optimized away
+template <typename Fn>
+static void measure(StringRef name, size_t bytes, StringRef unit, Fn run) {
+    double best = 0;
+    size_t count = 0;
+    for (unsigned i = 0; i < Repeats; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        count = run();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        if (i == 0 || elapsed.count() < best) best = elapsed.count();
+    }
+    outs() << format("%-12s %8.1f MB/s  %zu %s\n", name.str().c_str(),
+                     bytes / best / (1024 * 1024), count, unit.str().c_str());
+}
+
+template <typename Fn>
+static size_t countKeywords(const std::vector<StringRef> &words, Fn classify) {
+    size_t keywords = 0;
+    for (StringRef word : words) keywords += classify(word) != Token::identifier;
+    return keywords;
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "MAS lexer throughput benchmark\n");
+    std::string input = makeInput(size_t(SizeMB) * 1024 * 1024);
+
+    measure("Lexer", input.size(), "tokens", [&] {
+        IdentifierTable idents;
+        Lexer lexer(input, idents);
+        size_t tokens = 0;
+        while (lexer.nextToken().kind != Token::eof) ++tokens;
+        return tokens;
+    });
+    measure("TokenStream", input.size(), "tokens", [&] {
+        IdentifierTable idents;
+        TokenStream tokens(input, idents);
+        return tokens.size();
+    });
+
+    // rates are over the bytes of the words alone
+    std::vector<StringRef> words = splitWords(input);
+    size_t wordBytes = 0;
+    for (StringRef word : words) wordBytes += word.size();
+    measure("keywordKind", wordBytes, "keywords", [&] { return countKeywords(words, keywordKind); });
+    measure("chain", wordBytes, "keywords", [&] { return countKeywords(words, keywordChain); });
+    return 0;
+}
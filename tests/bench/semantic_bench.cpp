@@ -0,0 +1,68 @@
+// Semantic analysis of long left-associative chains, a + a + a + ...,
+// at n, 2n and 4n terms. Each node's type is computed once and cached, so
+// the time should roughly double with each step; a pass that re-derives
+// subtree types would quadruple instead.
+
+#include "ASTContext.h"
+#include "lexer.h"
+#include "parser.h"
+#include "semantic.h"
+#include <chrono>
+#include <string>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+
+// each term is one level of recursion in the checker, so very long chains
+// need a larger stack than the default
+static cl::opt<unsigned> Size("size", cl::desc("Terms in the shortest chain"), cl::init(4000));
+static cl::opt<unsigned> Repeats("repeat", cl::desc("Runs per length; the best counts"), cl::init(5));
+
+static std::string makeChain(unsigned terms) {
+    std::string text = "int a = 1;\nfloat f = 2.5;\nint b = a";
+    for (unsigned i = 1; i < terms; ++i) text += i % 3 ? " + a" : " * a";
+    text += ";\nfloat g = f";
+    for (unsigned i = 1; i < terms; ++i) text += i % 2 ? " + a" : " - f";
+    text += ";\nprint(b);\nprint(g);\n";
+    return text;
+}
+
+// best time of Repeats checks in microseconds, or a negative value if the
+// program did not type-check
+static double measure(unsigned terms) {
+    std::string source = makeChain(terms);
+    double best = 0;
+    for (unsigned i = 0; i < Repeats; ++i) {
+        ASTContext context;
+        Lexer lexer(source, context.getIdentifiers());
+        Parser parser(lexer, context);
+        ProgramNode *program = parser.parseProgram();
+
+        auto begin = std::chrono::steady_clock::now();
+        Semantic semantic;
+        bool failed = semantic.semantic(program, context.getIdentifiers());
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - begin;
+        if (failed) return -1;
+        if (i == 0 || elapsed.count() < best) best = elapsed.count();
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "MAS semantic analysis stress benchmark\n");
+    double previous = 0;
+    for (unsigned terms = Size; terms <= 4 * Size; terms *= 2) {
+        double micros = measure(terms);
+        if (micros < 0) {
+            errs() << "semantic analysis rejected the " << terms << "-term chain\n";
+            return 1;
+        }
+        outs() << format("%8u terms %10.1f us", terms, micros);
+        if (previous > 0) outs() << format("  x%.2f", micros / previous);
+        outs() << "\n";
+        previous = micros;
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+# Compiles one program to a file with --emit and checks what was written.
+#   COMPILER  the compiler executable
+#   SOURCE    the .mas program
+#   KIND      the --emit kind: ll, bc, asm or obj
+#   FLAGS     extra compiler flags, space separated
+#   OUTPUT    file to write
+#   MAGIC     optional hex bytes the file must start with
+#   CONTAINS  optional |-separated strings the file must contain
+#   ENTRY     optional |-separated strings the entry block of textual IR
+#             must contain; every alloca must then be in that block
+#   LATER     optional |-separated strings the IR after the entry block
+#             must contain
+
+separate_arguments(flags UNIX_COMMAND "${FLAGS}")
+file(REMOVE ${OUTPUT})
+execute_process(COMMAND ${COMPILER} -f ${SOURCE} --emit=${KIND} -o ${OUTPUT} ${flags}
+                ERROR_VARIABLE err
+                RESULT_VARIABLE status)
+if(NOT status EQUAL 0 OR NOT EXISTS ${OUTPUT})
+  message(FATAL_ERROR "--emit=${KIND} exited with ${status}\n${err}")
+endif()
+
+if(MAGIC)
+  string(LENGTH "${MAGIC}" digits)
+  math(EXPR bytes "${digits} / 2")
+  file(READ ${OUTPUT} head LIMIT ${bytes} HEX)
+  if(NOT head STREQUAL "${MAGIC}")
+    message(FATAL_ERROR "${OUTPUT} starts with ${head}, expected ${MAGIC}")
+  endif()
+endif()
+
+function(require_all text where needles)
+  string(REPLACE "|" ";" needles "${needles}")
+  foreach(needle ${needles})
+    string(FIND "${text}" "${needle}" found)
+    if(found EQUAL -1)
+      message(FATAL_ERROR "${where} does not contain '${needle}'")
+    endif()
+  endforeach()
+endfunction()
+
+if(CONTAINS)
+  file(READ ${OUTPUT} text)
+  require_all("${text}" "${OUTPUT}" "${CONTAINS}")
+endif()
+
+if(ENTRY OR LATER)
+  # blocks are separated by blank lines in textual IR
+  file(READ ${OUTPUT} text)
+  string(FIND "${text}" "\nentry:" begin)
+  if(begin EQUAL -1)
+    message(FATAL_ERROR "${OUTPUT} has no entry block")
+  endif()
+  string(SUBSTRING "${text}" ${begin} -1 text)
+  string(FIND "${text}" "\n\n" end)
+  string(SUBSTRING "${text}" 0 ${end} entry)
+  string(SUBSTRING "${text}" ${end} -1 later)
+  if(ENTRY)
+    require_all("${entry}" "the entry block" "${ENTRY}")
+    string(FIND "${later}" " = alloca " found)
+    if(NOT found EQUAL -1)
+      message(FATAL_ERROR "an alloca is outside the entry block\n${later}")
+    endif()
+  endif()
+  if(LATER)
+    require_all("${later}" "the IR after the entry block" "${LATER}")
+  endif()
+endif()
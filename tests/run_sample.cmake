@@ -0,0 +1,29 @@
+# Runs one sample program under the JIT and checks what it printed.
+#   COMPILER  the compiler executable
+#   SOURCE    the .mas program
+#   FLAGS     extra compiler flags, space separated
+#   EXPECTED  file holding the exact stdout
+#   ERROR     optional file holding text stderr must contain; the run
+#             must then fail instead of exiting 0
+
+separate_arguments(flags UNIX_COMMAND "${FLAGS}")
+execute_process(COMMAND ${COMPILER} -f ${SOURCE} --run ${flags}
+                OUTPUT_VARIABLE out
+                ERROR_VARIABLE err
+                RESULT_VARIABLE status)
+
+file(READ ${EXPECTED} expected)
+if(NOT out STREQUAL expected)
+  message(FATAL_ERROR "stdout differs\n--- expected\n${expected}--- got\n${out}--- stderr\n${err}")
+endif()
+
+if(ERROR)
+  file(READ ${ERROR} message)
+  string(STRIP "${message}" message)
+  string(FIND "${err}" "${message}" found)
+  if(status EQUAL 0 OR found EQUAL -1)
+    message(FATAL_ERROR "expected a failure with '${message}', got status ${status}\n${err}")
+  endif()
+elseif(NOT status EQUAL 0)
+  message(FATAL_ERROR "exited with ${status}\n${err}")
+endif()